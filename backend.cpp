@@ -0,0 +1,27 @@
+#include "backend.h"
+
+#include <atomic>
+#include <stdexcept>
+
+namespace {
+std::atomic<bool> logging{true};
+}
+
+void set_backend_logging(bool enabled) {
+    logging = enabled;
+}
+
+bool backend_logging() {
+    return logging;
+}
+
+std::unique_ptr<Backend> make_backend(const std::string& model_path, size_t sequences) {
+    if (model_path == "mock" || model_path.rfind("mock:", 0) == 0) {
+        return make_mock_backend(model_path.size() > 5 ? model_path.substr(5) : "", sequences);
+    }
+#ifdef COMMITGEN_WITH_LLAMA
+    return make_llama_backend(model_path, sequences);
+#else
+    throw std::runtime_error("Built without llama.cpp; only mock: models are available");
+#endif
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using Token = int32_t;
+
+// Tokens appended to one sequence by a decode call
+struct SequenceTokens {
+    int seq = 0;
+    const Token* tokens = nullptr;
+    size_t n = 0;
+    bool logits = true;  // keep the last token's logits for sample(seq)
+};
+
+// Token-level inference engine behind CommitGen. CommitGen owns the prompt,
+// prefix reuse, stop conditions and stats; a backend tokenizes, evaluates
+// batches of tokens against up to max_sequences() independent KV sequences
+// and samples from the logits of each one's last token. Calls are serialized
+// by CommitGen.
+class Backend {
+public:
+    virtual ~Backend() = default;
+
+    // Loads the model; runs on CommitGen's init thread. False on failure.
+    virtual bool load() = 0;
+
+    // BOS is added and chat-template special tokens are recognized
+    virtual std::vector<Token> tokenize(const std::string& text) = 0;
+    virtual std::string token_to_piece(Token token) = 0;
+    virtual bool is_eog(Token token) = 0;
+
+    // Drops the sequence's KV entries from position pos on; false if the
+    // backend had to drop all of them
+    virtual bool truncate(int seq, size_t pos) = 0;
+
+    // Appends tokens to their sequences in one evaluation, at most
+    // batch_size() in total and one entry per sequence
+    virtual bool decode(const std::vector<SequenceTokens>& batch) = 0;
+
+    virtual size_t max_sequences() const = 0;
+    virtual size_t batch_size() const = 0;
+    virtual size_t context_size() const = 0;  // per sequence
+
+    // Starts a new message; sampling is seeded so results are reproducible
+    virtual void reset_sampler(int seq) = 0;
+    virtual Token sample(int seq) = 0;
+};
+
+// The server owns stderr, so it turns off the inference library's own logging
+// before loading; on by default
+void set_backend_logging(bool enabled);
+bool backend_logging();
+
+// "mock:<options>" selects the mock backend, anything else is a GGUF path.
+// `sequences` is how many messages can be generated at once.
+std::unique_ptr<Backend> make_backend(const std::string& model_path, size_t sequences = 1);
+
+std::unique_ptr<Backend> make_llama_backend(const std::string& model_path, size_t sequences);
+
+// Deterministic stand-in for benchmarks and tests; see mock_backend.cpp for options
+std::unique_ptr<Backend> make_mock_backend(const std::string& options, size_t sequences);
@@ -0,0 +1,238 @@
+// bench.cpp - End-to-end generation benchmark over a corpus of diffs
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "commitgen.h"
+#include "json.h"
+
+namespace fs = std::filesystem;
+
+// ANSI color codes
+namespace Color {
+const std::string RESET = "\033[0m";
+const std::string RED = "\033[31m";
+const std::string CYAN = "\033[36m";
+const std::string BOLD = "\033[1m";
+const std::string DIM = "\033[2m";
+}  // namespace Color
+
+// Progress goes to stderr so stdout stays machine readable
+void print_status(const std::string& msg) {
+    std::cerr << Color::CYAN << "[" << Color::RESET << "•" << Color::CYAN << "] " << Color::RESET << msg << std::endl;
+}
+
+void print_error(const std::string& msg) {
+    std::cerr << Color::RED << "[✗] " << Color::RESET << msg << std::endl;
+}
+
+struct Options {
+    std::string model_path;
+    std::string corpus_dir;
+    std::string output_file;
+    int runs = 3;
+    int warmup = 1;
+};
+
+struct Diff {
+    std::string name;
+    std::string size_class;
+    std::string text;
+};
+
+// Samples for one size class
+struct ClassResult {
+    size_t diffs = 0;
+    size_t bytes = 0;
+    std::vector<double> prefill_tps;
+    std::vector<double> decode_tps;
+    std::vector<double> ttft_ms;
+    std::vector<double> latency_ms;
+    uint64_t prompt_tokens = 0;
+    uint64_t cached_tokens = 0;
+    uint64_t completion_tokens = 0;
+};
+
+// Without subdirectories, diffs are classed by size; the largest class is
+// truncated to MAX_DIFF_BYTES by the generator
+std::string size_class(size_t bytes) {
+    if (bytes < 512)
+        return "xs";
+    if (bytes < 2048)
+        return "s";
+    if (bytes < MAX_DIFF_BYTES)
+        return "m";
+    return "l";
+}
+
+std::vector<Diff> load_corpus(const std::string& dir) {
+    std::vector<Diff> corpus;
+    auto add = [&](const fs::path& path, const std::string& cls) {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        std::string text = ss.str();
+        corpus.push_back({path.filename().string(), cls.empty() ? size_class(text.size()) : cls, text});
+    };
+
+    // Each subdirectory is a class of its own
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        if (entry.is_directory()) {
+            for (const auto& file : fs::directory_iterator(entry.path())) {
+                if (file.is_regular_file())
+                    add(file.path(), entry.path().filename().string());
+            }
+        } else if (entry.is_regular_file()) {
+            add(entry.path(), "");
+        }
+    }
+
+    std::sort(corpus.begin(), corpus.end(), [](const Diff& a, const Diff& b) {
+        return a.size_class != b.size_class ? a.size_class < b.size_class : a.name < b.name;
+    });
+    return corpus;
+}
+
+std::string class_json(const ClassResult& r) {
+    return "{\"diffs\":" + std::to_string(r.diffs) + ",\"samples\":" + std::to_string(r.latency_ms.size())
+           + ",\"mean_bytes\":" + std::to_string(r.diffs ? r.bytes / r.diffs : 0)
+           + ",\"prompt_tokens\":" + std::to_string(r.prompt_tokens)
+           + ",\"cached_tokens\":" + std::to_string(r.cached_tokens)
+           + ",\"completion_tokens\":" + std::to_string(r.completion_tokens)
+           + ",\"prefill_tokens_per_second\":" + percentiles_json(percentiles(r.prefill_tps))
+           + ",\"decode_tokens_per_second\":" + percentiles_json(percentiles(r.decode_tps))
+           + ",\"ttft_ms\":" + percentiles_json(percentiles(r.ttft_ms))
+           + ",\"latency_ms\":" + percentiles_json(percentiles(r.latency_ms)) + "}";
+}
+
+void record_sample(ClassResult& r, const GenerationStats& stats, double latency_seconds) {
+    r.prompt_tokens += stats.prompt_tokens;
+    r.cached_tokens += stats.cached_tokens;
+    r.completion_tokens += stats.completion_tokens;
+    if (stats.prefill_seconds > 0)
+        r.prefill_tps.push_back((stats.prompt_tokens - stats.cached_tokens) / stats.prefill_seconds);
+    if (stats.decode_seconds > 0 && stats.completion_tokens > 0)
+        r.decode_tps.push_back(stats.completion_tokens / stats.decode_seconds);
+    r.ttft_ms.push_back(stats.first_token_seconds * 1000.0);
+    r.latency_ms.push_back(latency_seconds * 1000.0);
+}
+
+void show_usage(const std::string& prog_name) {
+    std::cout << Color::BOLD << "USAGE:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " <model_path> <diff_dir> [options]\n\n";
+    std::cout << Color::BOLD << "OPTIONS:" << Color::RESET << "\n";
+    std::cout << "  --runs <n>            Timed passes over the corpus (default 3)\n";
+    std::cout << "  --warmup <n>          Untimed passes first (default 1)\n";
+    std::cout << "  --out <file>          Write the JSON report to a file instead of stdout\n\n";
+    std::cout << "Files directly in <diff_dir> are grouped by size (xs < 512 B, s < 2 KB,\n";
+    std::cout << "m < " << MAX_DIFF_BYTES << " B, l = truncated); each subdirectory is a class of its own.\n";
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            show_usage(argv[0]);
+            return 0;
+        } else if (arg == "--runs" && i + 1 < argc) {
+            opts.runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            opts.warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--out" && i + 1 < argc) {
+            opts.output_file = argv[++i];
+        } else if (arg[0] != '-') {
+            positional.push_back(arg);
+        } else {
+            print_error("Unknown option: " + arg);
+            return 1;
+        }
+    }
+    if (positional.size() != 2) {
+        show_usage(argv[0]);
+        return 1;
+    }
+    opts.model_path = positional[0];
+    opts.corpus_dir = positional[1];
+
+    try {
+        std::vector<Diff> corpus = load_corpus(opts.corpus_dir);
+        if (corpus.empty()) {
+            print_error("No diffs in " + opts.corpus_dir);
+            return 1;
+        }
+
+        print_status("Loading model: " + opts.model_path);
+        auto load_start = std::chrono::steady_clock::now();
+        CommitGen generator(opts.model_path);
+        while (!generator.is_ready() && !generator.load_failed()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (generator.load_failed()) {
+            print_error("Failed to load model: " + opts.model_path);
+            return 1;
+        }
+        double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+
+        std::map<std::string, ClassResult> classes;
+        for (const auto& diff : corpus) {
+            classes[diff.size_class].diffs++;
+            classes[diff.size_class].bytes += diff.text.size();
+        }
+        ClassResult overall;
+        overall.diffs = corpus.size();
+        for (const auto& diff : corpus) {
+            overall.bytes += diff.text.size();
+        }
+
+        for (int pass = 0; pass < opts.warmup + opts.runs; pass++) {
+            bool timed = pass >= opts.warmup;
+            print_status(std::string(timed ? "Run " : "Warmup ")
+                         + std::to_string(timed ? pass - opts.warmup + 1 : pass + 1) + ": "
+                         + std::to_string(corpus.size()) + " diffs");
+            for (const auto& diff : corpus) {
+                GenerationStats stats;
+                auto start = std::chrono::steady_clock::now();
+                generator.generate(diff.text, &stats);
+                double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (!timed)
+                    continue;
+                record_sample(classes[diff.size_class], stats, latency);
+                record_sample(overall, stats, latency);
+            }
+        }
+
+        std::string report = "{\"model\":" + json_string(opts.model_path) + ",\"runs\":" + std::to_string(opts.runs)
+                             + ",\"warmup\":" + std::to_string(opts.warmup) + ",\"load_seconds\":"
+                             + std::to_string(load_seconds) + ",\"peak_rss_bytes\":" + std::to_string(peak_rss_bytes())
+                             + ",\"overall\":" + class_json(overall) + ",\"classes\":{";
+        bool first = true;
+        for (const auto& [name, result] : classes) {
+            report += std::string(first ? "" : ",") + json_string(name) + ":" + class_json(result);
+            first = false;
+        }
+        report += "}}\n";
+
+        if (opts.output_file.empty()) {
+            std::cout << report;
+        } else {
+            std::ofstream(opts.output_file) << report;
+            print_status("Wrote " + opts.output_file);
+        }
+    } catch (const std::exception& e) {
+        print_error(e.what());
+        return 1;
+    }
+    return 0;
+}
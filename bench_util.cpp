@@ -0,0 +1,53 @@
+#include "bench_util.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+Percentiles percentiles(std::vector<double> samples) {
+    Percentiles p;
+    if (samples.empty())
+        return p;
+
+    std::sort(samples.begin(), samples.end());
+    auto rank = [&](double q) {
+        size_t i = static_cast<size_t>(std::ceil(q * samples.size()));
+        return samples[std::min(std::max<size_t>(i, 1), samples.size()) - 1];
+    };
+
+    double sum = 0;
+    for (double s : samples) {
+        sum += s;
+    }
+    p.count = samples.size();
+    p.mean = sum / samples.size();
+    p.min = samples.front();
+    p.p50 = rank(0.50);
+    p.p90 = rank(0.90);
+    p.p95 = rank(0.95);
+    p.p99 = rank(0.99);
+    p.max = samples.back();
+    return p;
+}
+
+std::string percentiles_json(const Percentiles& p) {
+    char buf[256];
+    std::snprintf(buf, sizeof(buf),
+                  "{\"count\":%zu,\"mean\":%.3f,\"min\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p95\":%.3f,\"p99\":%.3f,"
+                  "\"max\":%.3f}",
+                  p.count, p.mean, p.min, p.p50, p.p90, p.p95, p.p99, p.max);
+    return buf;
+}
+
+size_t peak_rss_bytes() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss;  // bytes on macOS
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;  // kilobytes on Linux
+#endif
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Shared by the benchmark and replay tools
+
+struct Percentiles {
+    size_t count = 0;
+    double mean = 0;
+    double min = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+// Nearest-rank percentiles of the samples
+Percentiles percentiles(std::vector<double> samples);
+
+// {"count":..,"mean":..,"p50":..,...}
+std::string percentiles_json(const Percentiles& p);
+
+// Highest resident set size of this process so far
+size_t peak_rss_bytes();
@@ -0,0 +1,202 @@
+#include "capture.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t CAPTURE_VERSION = 1;
+constexpr size_t ALIGN = 8;
+
+size_t padded(size_t n) {
+    return (n + ALIGN - 1) & ~(ALIGN - 1);
+}
+
+std::string encode_fields(const std::map<std::string, std::string>& fields) {
+    std::string out;
+    for (const auto& [key, value] : fields) {
+        out += key + ": " + value + "\n";
+    }
+    return out;
+}
+
+std::map<std::string, std::string> decode_fields(const char* p, size_t n) {
+    std::map<std::string, std::string> fields;
+    std::string text(p, n);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos)
+            end = text.size();
+        std::string line = text.substr(pos, end - pos);
+        size_t colon = line.find(": ");
+        if (colon != std::string::npos)
+            fields[line.substr(0, colon)] = line.substr(colon + 2);
+        pos = end + 1;
+    }
+    return fields;
+}
+
+// Size of the record at offset if it is complete and well formed, else 0
+size_t record_size(const char* data, size_t size, size_t offset) {
+    if (offset + sizeof(CaptureRecordHeader) > size)
+        return 0;
+    CaptureRecordHeader h;
+    std::memcpy(&h, data + offset, sizeof(h));
+    size_t payload = (size_t)h.fields_len + h.diff_len + h.output_len;
+    if (h.magic != CAPTURE_RECORD_MAGIC || h.size != padded(sizeof(h) + payload) || offset + h.size > size)
+        return 0;
+    return h.size;
+}
+
+}  // namespace
+
+CaptureWriter::~CaptureWriter() {
+    if (fd >= 0)
+        close(fd);
+}
+
+void CaptureWriter::open(const std::string& path) {
+    // Captures hold source code, so keep them private to the server's user
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open capture file " + path + ": " + strerror(errno));
+
+    struct stat st;
+    fstat(fd, &st);
+    size_t size = st.st_size;
+    if (size == 0) {
+        CaptureFileHeader header = {};
+        std::memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+        header.version = CAPTURE_VERSION;
+        if (::write(fd, &header, sizeof(header)) != sizeof(header))
+            throw std::runtime_error("Cannot write capture file " + path);
+        return;
+    }
+
+    // Continue an existing log, dropping a tail left by a crash mid-append
+    void* mem = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+        throw std::runtime_error("Cannot map capture file " + path);
+    const char* data = static_cast<const char*>(mem);
+    bool valid = size >= sizeof(CaptureFileHeader) && std::memcmp(data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0;
+    size_t end = sizeof(CaptureFileHeader);
+    while (valid) {
+        size_t n = record_size(data, size, end);
+        if (n == 0)
+            break;
+        end += n;
+    }
+    munmap(mem, size);
+
+    if (!valid) {
+        close(fd);
+        fd = -1;
+        throw std::runtime_error(path + " is not a commitgen capture file");
+    }
+    if (end < size && ftruncate(fd, end) != 0)
+        throw std::runtime_error("Cannot repair capture file " + path);
+}
+
+bool CaptureWriter::append(const CaptureRecord& record) {
+    if (fd < 0)
+        return false;
+
+    std::string fields = encode_fields(record.fields);
+    CaptureRecordHeader h = {};
+    h.magic = CAPTURE_RECORD_MAGIC;
+    h.id = record.id;
+    h.arrival_unix_us = record.arrival_unix_us;
+    h.queue_us = record.queue_us;
+    h.total_us = record.total_us;
+    h.uid = record.uid;
+    h.status = record.failed ? 1 : 0;
+    h.prompt_tokens = record.prompt_tokens;
+    h.completion_tokens = record.completion_tokens;
+    h.fields_len = fields.size();
+    h.diff_len = record.diff.size();
+    h.output_len = record.output.size();
+    h.size = padded(sizeof(h) + fields.size() + record.diff.size() + record.output.size());
+
+    std::string buf(h.size, '\0');
+    char* p = &buf[0];
+    std::memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    std::memcpy(p, fields.data(), fields.size());
+    p += fields.size();
+    std::memcpy(p, record.diff.data(), record.diff.size());
+    p += record.diff.size();
+    std::memcpy(p, record.output.data(), record.output.size());
+
+    // One write per record keeps appends whole even with several writers
+    std::lock_guard<std::mutex> lock(mtx);
+    ssize_t n;
+    do {
+        n = ::write(fd, buf.data(), buf.size());
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)buf.size();
+}
+
+CaptureReader::CaptureReader(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open capture file " + path + ": " + strerror(errno));
+
+    struct stat st;
+    fstat(fd, &st);
+    size = st.st_size;
+    if (size < sizeof(CaptureFileHeader)) {
+        close(fd);
+        throw std::runtime_error(path + " is not a commitgen capture file");
+    }
+
+    void* mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+        throw std::runtime_error("Cannot map capture file " + path);
+    data = static_cast<const char*>(mem);
+
+    if (std::memcmp(data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+        munmap(const_cast<char*>(data), size);
+        data = nullptr;
+        throw std::runtime_error(path + " is not a commitgen capture file");
+    }
+}
+
+CaptureReader::~CaptureReader() {
+    if (data)
+        munmap(const_cast<char*>(data), size);
+}
+
+bool CaptureReader::next(size_t& offset, CaptureRecord& record) const {
+    size_t n = record_size(data, size, offset);
+    if (n == 0)
+        return false;
+
+    CaptureRecordHeader h;
+    std::memcpy(&h, data + offset, sizeof(h));
+    const char* p = data + offset + sizeof(h);
+
+    record.id = h.id;
+    record.arrival_unix_us = h.arrival_unix_us;
+    record.queue_us = h.queue_us;
+    record.total_us = h.total_us;
+    record.uid = h.uid;
+    record.failed = h.status != 0;
+    record.prompt_tokens = h.prompt_tokens;
+    record.completion_tokens = h.completion_tokens;
+    record.fields = decode_fields(p, h.fields_len);
+    p += h.fields_len;
+    record.diff.assign(p, h.diff_len);
+    p += h.diff_len;
+    record.output.assign(p, h.output_len);
+
+    offset += n;
+    return true;
+}
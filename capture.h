@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Request capture log for replaying production traffic. The file is a small
+// header followed by 8-byte aligned records, each appended with one write() so
+// a crash can only leave a truncated tail, which readers ignore. Readers mmap
+// the file and walk the records in place.
+//
+//   CaptureFileHeader
+//   CaptureRecordHeader, fields, diff, output, padding
+//   ...
+constexpr char CAPTURE_MAGIC[8] = {'C', 'G', 'C', 'A', 'P', 'T', 'R', '1'};
+constexpr uint32_t CAPTURE_RECORD_MAGIC = 0x43524543;  // "CERC"
+
+struct CaptureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct CaptureRecordHeader {
+    uint32_t magic;
+    uint32_t size;  // whole record including padding
+    uint64_t id;
+    int64_t arrival_unix_us;
+    int64_t queue_us;
+    int64_t total_us;
+    uint32_t uid;
+    uint32_t status;  // 0 ok, 1 error
+    uint32_t prompt_tokens;
+    uint32_t completion_tokens;
+    uint32_t fields_len;  // request fields as "key: value\n" lines
+    uint32_t diff_len;
+    uint32_t output_len;
+    uint32_t reserved;
+};
+
+struct CaptureRecord {
+    uint64_t id = 0;
+    int64_t arrival_unix_us = 0;
+    int64_t queue_us = 0;
+    int64_t total_us = 0;
+    uint32_t uid = 0;
+    bool failed = false;
+    uint32_t prompt_tokens = 0;
+    uint32_t completion_tokens = 0;
+    std::map<std::string, std::string> fields;
+    std::string diff;
+    std::string output;
+};
+
+class CaptureWriter {
+public:
+    ~CaptureWriter();
+
+    // Opens path for appending, writing the file header if it is new; throws on failure
+    void open(const std::string& path);
+    bool is_open() const { return fd >= 0; }
+
+    bool append(const CaptureRecord& record);
+
+private:
+    int fd = -1;
+    std::mutex mtx;
+};
+
+// Read-only mapping of a capture file
+class CaptureReader {
+public:
+    // Throws if the file cannot be mapped or is not a capture log
+    explicit CaptureReader(const std::string& path);
+    ~CaptureReader();
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    // Decodes the record at offset and advances it; false at the end or a truncated tail
+    bool next(size_t& offset, CaptureRecord& record) const;
+
+    size_t begin() const { return sizeof(CaptureFileHeader); }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+};
@@ -1,22 +1,39 @@
 // client.cpp - Interactive commit message generator
+#include <fcntl.h>
 #include <signal.h>
+#include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <unistd.h>
 
-#include <array>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "difffilter.h"
+#include "diffsplit.h"
+#include "json.h"
+#include "protocol.h"
+#include "stats_page.h"
+#include "text_util.h"
+#include "trace.h"
+
 namespace fs = std::filesystem;
 
 // ANSI color codes
@@ -32,9 +49,9 @@ const std::string BOLD = "\033[1m";
 const std::string DIM = "\033[2m";
 }  // namespace Color
 
-const std::string REQUEST_PIPE = "/tmp/commitgen_request";
-const std::string RESPONSE_PIPE = "/tmp/commitgen_response";
 const std::string PID_FILE = "/tmp/commitgen_server.pid";
+const std::string AUTOSTART_LOCK = "/tmp/commitgen_autostart.lock";
+const std::string SERVER_LOG = "/tmp/commitgen_server.log";
 
 // Get single keypress without waiting for Enter
 char get_keypress() {
@@ -66,11 +83,162 @@ bool is_server_running() {
     std::ifstream pid_file(PID_FILE);
     pid_t server_pid;
     if (pid_file >> server_pid) {
-        return (kill(server_pid, 0) == 0);
+        // EPERM: alive, but owned by another user on a shared host
+        return (kill(server_pid, 0) == 0 || errno == EPERM);
     }
     return false;
 }
 
+// ========== AUTOSTART ==========
+// "model = <path>" and "idle_timeout = <seconds>" lines in the config file;
+// COMMITGEN_MODEL overrides the model
+struct AutostartConfig {
+    std::string model;
+    int idle_timeout = 600;
+};
+
+bool server_autostarted = false;
+
+std::string config_path() {
+    const char* xdg = getenv("XDG_CONFIG_HOME");
+    if (xdg && *xdg) {
+        return std::string(xdg) + "/commitgen/config";
+    }
+    const char* home = getenv("HOME");
+    return home ? std::string(home) + "/.config/commitgen/config" : "";
+}
+
+AutostartConfig load_autostart_config() {
+    AutostartConfig config;
+    std::ifstream in(config_path());
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        trim_right(key, " \t");
+        trim_right(value, " \t\r");
+        value.erase(0, value.find_first_not_of(" \t"));
+        if (key == "model") {
+            config.model = value;
+        } else if (key == "idle_timeout") {
+            config.idle_timeout = std::atoi(value.c_str());
+        }
+    }
+
+    const char* env_model = getenv("COMMITGEN_MODEL");
+    if (env_model && *env_model) {
+        config.model = env_model;
+    }
+    const char* home = getenv("HOME");
+    if (home && config.model.rfind("~/", 0) == 0) {
+        config.model = std::string(home) + config.model.substr(1);
+    }
+    return config;
+}
+
+// The server installed next to this binary, otherwise whatever is on PATH
+std::string server_binary() {
+    char self[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (n > 0) {
+        std::string path(self, n);
+        path = path.substr(0, path.rfind('/') + 1) + "commitgen-server";
+        if (access(path.c_str(), X_OK) == 0) {
+            return path;
+        }
+    }
+    return "commitgen-server";
+}
+
+// Double fork so the server is neither our child nor in our session
+bool spawn_server(const AutostartConfig& config) {
+    std::string server = server_binary();
+    std::string idle = std::to_string(config.idle_timeout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        setsid();
+        if (fork() != 0) {
+            _exit(0);
+        }
+        int null_fd = open("/dev/null", O_RDWR);
+        int log_fd = open(SERVER_LOG.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+        dup2(null_fd, STDIN_FILENO);
+        dup2(log_fd >= 0 ? log_fd : null_fd, STDOUT_FILENO);
+        dup2(log_fd >= 0 ? log_fd : null_fd, STDERR_FILENO);
+        close(null_fd);
+        if (log_fd >= 0) {
+            close(log_fd);
+        }
+        if (config.idle_timeout > 0) {
+            execlp(server.c_str(), server.c_str(), "--start", config.model.c_str(), "--idle-timeout", idle.c_str(),
+                   (char*)nullptr);
+        } else {
+            execlp(server.c_str(), server.c_str(), "--start", config.model.c_str(), (char*)nullptr);
+        }
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    return true;
+}
+
+// Connects to the server, starting it from the configured model if nothing is
+// listening. The server listens before it loads the model, so the first
+// request simply waits in its queue. Returns -1 if there is no server.
+int connect_or_autostart(int wait_ms = 5000) {
+    int fd = connect_server();
+    if (fd >= 0) {
+        return fd;
+    }
+    AutostartConfig config = load_autostart_config();
+    if (config.model.empty()) {
+        return -1;
+    }
+
+    // Clients starting at the same moment must not race to spawn two servers
+    int lock_fd = open(AUTOSTART_LOCK.c_str(), O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd >= 0) {
+        flock(lock_fd, LOCK_EX);
+    }
+    fd = connect_server();
+    if (fd < 0) {
+        std::cout << Color::CYAN << "→ " << Color::RESET << "Starting server with " << config.model << Color::DIM
+                  << " (log: " << SERVER_LOG << ")" << Color::RESET << std::endl;
+        if (spawn_server(config)) {
+            server_autostarted = true;
+            for (int i = 0; i < wait_ms / 25 && (fd = connect_server()) < 0; i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(25));
+            }
+        }
+    }
+    if (lock_fd >= 0) {
+        close(lock_fd);
+    }
+    return fd;
+}
+
+// A server is running, can be started on demand, or sits behind an activation socket
+bool server_available() {
+    if (is_server_running() || !load_autostart_config().model.empty()) {
+        return true;
+    }
+    int fd = connect_server();
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
 // Print functions
 void print_error(const std::string& msg) {
     std::cerr << Color::RED << "✗ " << Color::RESET << msg << std::endl;
@@ -124,6 +292,93 @@ void print_divider() {
     std::cout << Color::DIM << "─────────────────────────────────────────" << Color::RESET << std::endl;
 }
 
+// ========== PROFILING (--profile) ==========
+struct Profile {
+    bool enabled = false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::string> order;
+    std::map<std::string, double> client_ms;
+    std::map<std::string, double> server;  // summed response fields
+    int requests = 0;
+};
+
+Profile profile;
+
+// Times one client phase for --profile and records it as a trace span
+class Phase {
+public:
+    explicit Phase(const char* name) : span(name, "client"), name(name), start(std::chrono::steady_clock::now()) {}
+
+    ~Phase() {
+        if (!profile.enabled)
+            return;
+        if (!profile.client_ms.count(name))
+            profile.order.push_back(name);
+        profile.client_ms[name] +=
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    trace::Span span;
+
+private:
+    const char* name;
+    std::chrono::steady_clock::time_point start;
+};
+
+void record_server_profile(const Message& response) {
+    if (!profile.enabled || response.get("id").empty())
+        return;
+    profile.requests++;
+    for (const char* key : {"queue_ms", "tokenize_ms", "prefill_tokens", "prefill_ms", "cached_tokens",
+                            "prompt_tokens", "decode_tokens", "decode_ms", "ttft_ms", "diff_ms"}) {
+        profile.server[key] += std::atof(response.get(key, "0").c_str());
+    }
+}
+
+void print_profile() {
+    auto row = [](const std::string& label, double ms, const std::string& extra = "") {
+        char line[128];
+        std::snprintf(line, sizeof(line), "    %-12s %10.1f ms", label.c_str(), ms);
+        std::cout << line;
+        if (!extra.empty())
+            std::cout << Color::DIM << extra << Color::RESET;
+        std::cout << "\n";
+    };
+    auto rate = [](double tokens, double ms) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "   (%.0f tokens, %.1f tok/s)", tokens, ms > 0 ? tokens * 1000.0 / ms : 0.0);
+        return std::string(buf);
+    };
+
+    std::cout << "\n" << Color::BOLD << "Profile" << Color::RESET << "\n";
+    print_divider();
+    std::cout << "  " << Color::CYAN << "client" << Color::RESET << "\n";
+    for (const auto& name : profile.order) {
+        row(name, profile.client_ms[name]);
+    }
+
+    if (profile.requests > 0) {
+        auto& srv = profile.server;
+        std::cout << "  " << Color::CYAN << "server" << Color::RESET << Color::DIM << " (" << profile.requests
+                  << " request" << (profile.requests == 1 ? "" : "s") << ")" << Color::RESET << "\n";
+        if (srv["diff_ms"] > 0)
+            row("git diff", srv["diff_ms"]);
+        row("queue", srv["queue_ms"]);
+        row("tokenize", srv["tokenize_ms"]);
+        row("prefill", srv["prefill_ms"], rate(srv["prefill_tokens"], srv["prefill_ms"]));
+        row("decode", srv["decode_ms"], rate(srv["decode_tokens"], srv["decode_ms"]));
+        row("first token", srv["ttft_ms"]);
+        char cache[96];
+        std::snprintf(cache, sizeof(cache), "    %-12s %10.0f / %.0f prompt tokens reused", "cache",
+                      srv["cached_tokens"], srv["prompt_tokens"]);
+        std::cout << cache << "\n";
+    }
+
+    double total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - profile.start).count();
+    row("total", total);
+    print_divider();
+}
+
 // Check if path is a git repository
 bool is_git_repo(const std::string& path) {
     std::string git_dir = path + "/.git";
@@ -139,19 +394,11 @@ std::string execute_command(const std::string& cmd, const std::string& working_d
     }
     full_cmd += " 2>&1";
 
-    std::array<char, 256> buffer;
-    std::string result;
-
     std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(full_cmd.c_str(), "r"), pclose);
     if (!pipe) {
         throw std::runtime_error("Failed to execute command: " + cmd);
     }
-
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
-    }
-
-    return result;
+    return read_all(pipe.get());
 }
 
 // Execute command silently (for git operations)
@@ -161,23 +408,19 @@ int execute_silent(const std::string& cmd, const std::string& working_dir = "")
         full_cmd = "cd \"" + working_dir + "\" && " + cmd;
     }
     full_cmd += " >/dev/null 2>&1";
+
+    Phase phase("commit");
+    phase.span.arg("cmd", cmd);
     return system(full_cmd.c_str());
 }
 
 // Get list of changed files
 std::vector<std::string> get_changed_files(const std::string& repo_path, bool staged = true) {
+    Phase phase("git list");
     std::string cmd = staged ? "git diff --cached --name-only" : "git diff --name-only";
     std::string output = execute_command(cmd, repo_path);
 
-    std::vector<std::string> files;
-    std::istringstream iss(output);
-    std::string line;
-    while (std::getline(iss, line)) {
-        if (!line.empty()) {
-            files.push_back(line);
-        }
-    }
-    return files;
+    return split_lines(output);
 }
 
 // Get git diff for specific file
@@ -186,6 +429,9 @@ std::string get_git_diff(const std::string& repo_path, const std::string& file_p
         throw std::runtime_error("Not a git repository: " + repo_path);
     }
 
+    Phase phase("git diff");
+    phase.span.arg("file", file_path);
+
     std::string cmd = "git diff";
     if (staged) {
         cmd += " --cached";
@@ -196,55 +442,613 @@ std::string get_git_diff(const std::string& repo_path, const std::string& file_p
     }
 
     std::string diff = execute_command(cmd, repo_path);
+    trim_right(diff, "\n ");
+    return diff;
+}
+
+// The diff as the model should see it, with .commitgenignore applied
+std::string get_filtered_diff(const std::string& repo_path, const std::string& file_path = "", bool staged = true) {
+    std::string diff = get_git_diff(repo_path, file_path, staged);
+    Phase phase("diff filter");
+    return DiffFilter::load(repo_path).apply(diff);
+}
+
+// Send one request and wait for its result; error results are returned, not thrown
+Message exchange(Message msg) {
+    int fd;
+    {
+        Phase phase("connect");
+        fd = connect_or_autostart();
+    }
+    if (fd < 0) {
+        throw std::runtime_error("Failed to connect to server");
+    }
+    Connection conn(fd);
 
-    while (!diff.empty() && (diff.back() == '\n' || diff.back() == ' ')) {
-        diff.pop_back();
+    if (trace::enabled()) {
+        msg.fields["trace"] = "1";
+    }
+    {
+        Phase phase("send");
+        phase.span.arg("bytes", (long long)msg.body.size());
+        if (!conn.write(msg)) {
+            throw std::runtime_error("Failed to send request to server");
+        }
     }
 
-    return diff;
+    Phase wait_phase("wait");
+    auto start = std::chrono::steady_clock::now();
+    // A server we just started answers only after loading the model
+    const auto timeout = std::chrono::seconds(server_autostarted ? 300 : 60);
+
+    std::cout << Color::DIM << "Generating" << std::flush;
+
+    while (std::chrono::steady_clock::now() - start < timeout) {
+        if (!conn.wait_readable(500)) {
+            std::cout << "." << std::flush;
+            continue;
+        }
+
+        Message response;
+        if (!conn.read(response)) {
+            std::cout << Color::RESET << std::endl;
+            throw std::runtime_error("Server closed the connection");
+        }
+        clear_line();
+        std::cout << Color::RESET;
+        wait_phase.span.set_request(std::strtoull(response.get("id", "0").c_str(), nullptr, 10));
+        trace::add_raw(response.get("trace"));
+        record_server_profile(response);
+        return response;
+    }
+
+    std::cout << Color::RESET << std::endl;
+    throw std::runtime_error("Server timeout");
 }
 
-// Send request to server
+// Send a diff to the server
 std::string send_request(const std::string& request) {
-    if (!is_server_running()) {
-        throw std::runtime_error("Server not running. Start with: commitgen-server --start <model_path>");
+    Message msg;
+    msg.type = "generate";
+    msg.body = request;
+    Message response = exchange(msg);
+    if (response.get("status") != "ok") {
+        throw std::runtime_error(response.body);
     }
+    return response.body;
+}
 
-    std::ofstream request_pipe(REQUEST_PIPE);
-    if (!request_pipe) {
+// Ask the server to pre-generate for this repository whenever its index
+// changes; `reply` is the server's answer or the error
+bool register_watch(const std::string& repo_path, std::string& reply) {
+    int fd = connect_or_autostart();
+    if (fd < 0) {
+        reply = "Failed to connect to server";
+        return false;
+    }
+    Connection conn(fd);
+
+    Message msg;
+    msg.type = "watch";
+    msg.fields["path"] = repo_path;
+    Message response;
+    if (!conn.write(msg) || !conn.read(response)) {
+        reply = "Server closed the connection";
+        return false;
+    }
+    reply = response.body;
+    return response.get("status") == "ok";
+}
+
+// Let the server read the changes itself (cleared by --local-diff)
+bool server_side_diff = true;
+
+// Generate a message for the staged or unstaged changes, optionally limited
+// to one file. Asks the server to read the repository first and falls back to
+// running git here when the server cannot (older server, different user,
+// unsupported repository). False when there is nothing to commit.
+bool generate_message(const std::string& repo_path, const std::string& file, bool staged, std::string& message) {
+    // The server only takes paths inside the checkout, relative to its top
+    if (server_side_diff && (file.empty() || (file[0] != '/' && file.find("..") == std::string::npos))) {
+        Message msg;
+        msg.type = "repo";
+        msg.fields["path"] = repo_path;
+        msg.fields["mode"] = staged ? "staged" : "unstaged";
+        if (!file.empty())
+            msg.fields["file"] = file;
+        Message response = exchange(msg);
+        if (response.get("status") == "ok") {
+            message = response.body;
+            return true;
+        }
+        if (response.get("code") == "empty")
+            return false;
+        if (response.get("code") != "unsupported" && response.body.rfind("Unknown request type", 0) != 0)
+            throw std::runtime_error(response.body);
+    }
+
+    std::string diff = get_filtered_diff(repo_path, file, staged);
+    if (diff.empty())
+        return false;
+    message = send_request(diff);
+    return true;
+}
+
+// ========== BATCHES (--repos, --range) ==========
+
+// Requests in flight at once; the server batches up to its --parallel of them
+constexpr size_t MAX_CONCURRENT_REQUESTS = 32;
+
+// Calls fn(0) .. fn(count - 1) from a pool of threads
+void for_each_concurrently(size_t count, const std::function<void(size_t)>& fn) {
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < std::min(count, MAX_CONCURRENT_REQUESTS); t++) {
+        threads.emplace_back([&] {
+            for (size_t i; (i = next++) < count;) {
+                fn(i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// Starts the server once up front rather than from every thread
+bool ensure_server() {
+    int fd = connect_or_autostart();
+    if (fd < 0) {
+        print_error("Failed to connect to server");
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+// Checkouts in dir and below it, nested ones and submodules included;
+// symlinks are not followed
+std::vector<std::string> find_repositories(const std::string& dir) {
+    std::vector<std::string> repos;
+    if (is_git_repo(dir)) {
+        repos.push_back(dir);
+    }
+    std::error_code ec;
+    fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->path().filename() == ".git") {
+            it.disable_recursion_pending();
+            continue;
+        }
+        if (!it->is_symlink(ec) && it->is_directory(ec) && is_git_repo(it->path().string())) {
+            repos.push_back(it->path().string());
+        }
+    }
+    std::sort(repos.begin(), repos.end());
+    return repos;
+}
+
+// One request on a connection of its own, with no progress output, so many
+// can run side by side; waits for as long as the server keeps it open
+Message quiet_exchange(const Message& msg) {
+    int fd = connect_or_autostart();
+    if (fd < 0) {
         throw std::runtime_error("Failed to connect to server");
     }
-    request_pipe << request;
-    request_pipe.close();
+    Connection conn(fd);
+    Message response;
+    if (!conn.write(msg) || !conn.read(response)) {
+        throw std::runtime_error("Server closed the connection");
+    }
+    return response;
+}
 
-    std::string response;
+struct RepoResult {
+    std::string path;
+    std::string status;   // "ok", "empty" or "error"
+    std::string message;  // the commit message, or what went wrong
+    double ms = 0;
+};
+
+// generate_message() for one of many repositories at once
+RepoResult generate_for_repo(const std::string& repo_path, bool staged) {
+    RepoResult result;
+    result.path = repo_path;
     auto start = std::chrono::steady_clock::now();
-    const auto timeout = std::chrono::seconds(60);
+    try {
+        Message response;
+        bool local = !server_side_diff;
+        if (!local) {
+            Message msg;
+            msg.type = "repo";
+            msg.fields["path"] = repo_path;
+            msg.fields["mode"] = staged ? "staged" : "unstaged";
+            response = quiet_exchange(msg);
+            local = response.get("code") == "unsupported" || response.body.rfind("Unknown request type", 0) == 0;
+        }
+        if (local) {
+            std::string diff = execute_command(staged ? "git diff --cached" : "git diff", repo_path);
+            trim_right(diff, "\n ");
+            diff = DiffFilter::load(repo_path).apply(diff);
+            if (diff.empty()) {
+                response = Message();
+                response.fields["code"] = "empty";
+            } else {
+                Message msg;
+                msg.type = "generate";
+                msg.body = diff;
+                response = quiet_exchange(msg);
+            }
+        }
 
-    std::cout << Color::DIM << "Generating";
-    int dots = 0;
+        if (response.get("status") == "ok") {
+            result.status = "ok";
+            result.message = response.body;
+            trim_right(result.message, "\n ");
+        } else if (response.get("code") == "empty") {
+            result.status = "empty";
+        } else {
+            result.status = "error";
+            result.message = response.body;
+        }
+    } catch (const std::exception& e) {
+        result.status = "error";
+        result.message = e.what();
+    }
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
 
-    while (std::chrono::steady_clock::now() - start < timeout) {
-        std::ifstream response_pipe(RESPONSE_PIPE);
-        if (response_pipe) {
-            std::stringstream buffer;
-            buffer << response_pipe.rdbuf();
-            response = buffer.str();
-            if (!response.empty()) {
-                response_pipe.close();
-                clear_line();
-                return response;
+// Generates for every repository under dir at once and prints one JSON
+// document: {"repositories": [{"path", "status", "message", "ms"}...], ...}.
+// Exits non-zero if any repository failed.
+int run_repos(const std::string& dir, bool staged) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> repos = find_repositories(dir);
+    if (repos.empty()) {
+        print_error("No git repositories under " + dir);
+        return 1;
+    }
+
+    if (!ensure_server()) {
+        return 1;
+    }
+
+    std::vector<RepoResult> results(repos.size());
+    for_each_concurrently(repos.size(), [&](size_t i) { results[i] = generate_for_repo(repos[i], staged); });
+
+    bool failed = false;
+    std::string out = "{\"repositories\":[";
+    for (size_t i = 0; i < results.size(); i++) {
+        const RepoResult& r = results[i];
+        failed = failed || r.status == "error";
+        char ms[32];
+        std::snprintf(ms, sizeof(ms), "%.1f", r.ms);
+        out += std::string(i ? "," : "") + "\n  {\"path\":" + json_string(r.path) + ",\"status\":"
+               + json_string(r.status) + ",\"message\":" + json_string(r.message) + ",\"ms\":" + ms + "}";
+    }
+    char elapsed[32];
+    std::snprintf(elapsed, sizeof(elapsed), "%.1f",
+                  std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    std::cout << out << "\n],\"elapsed_ms\":" << elapsed << "}" << std::endl;
+    return failed ? 1 : 0;
+}
+
+// Non-merge commits in a rev-list range such as "main..topic", oldest first;
+// throws with git's complaint if it is not a range git understands
+std::vector<std::string> commits_in_range(const std::string& repo_path, const std::string& range) {
+    if (range.empty() || range[0] == '-') {
+        throw std::runtime_error("Invalid range: " + range);
+    }
+    std::string output =
+        execute_command("git rev-list --no-merges --reverse '" + escape_for_shell(range) + "'", repo_path);
+    std::vector<std::string> commits = split_lines(output);
+    for (const auto& commit : commits) {
+        if (commit.size() != 40 || commit.find_first_not_of("0123456789abcdef") != std::string::npos) {
+            trim_right(output, "\n ");
+            throw std::runtime_error(output);
+        }
+    }
+    return commits;
+}
+
+// What `git show` would print for the commit's changes, in the format of `git diff --cached`
+std::string commit_diff(const std::string& repo_path, const std::string& commit) {
+    std::string diff = execute_command("git diff-tree -p -M --root --no-commit-id --no-color " + commit, repo_path);
+    trim_right(diff, "\n ");
+    return diff;
+}
+
+// Proposes a message for every commit in the range. All of them are sent at
+// once and each is printed as a JSON line as soon as it is ready:
+// {"index", "commit", "subject", "status", "message", "ms"}, where index is
+// the position in the range (oldest first) and subject the current summary.
+int run_range(const std::string& repo_path, const std::string& range) {
+    std::vector<std::string> commits;
+    try {
+        commits = commits_in_range(repo_path, range);
+    } catch (const std::exception& e) {
+        print_error(e.what());
+        return 1;
+    }
+    if (commits.empty()) {
+        print_warning("No commits in " + range);
+        return 0;
+    }
+    if (!ensure_server()) {
+        return 1;
+    }
+
+    DiffFilter filter = DiffFilter::load(repo_path);
+    std::mutex out_mtx;
+    std::atomic<bool> failed{false};
+    for_each_concurrently(commits.size(), [&](size_t i) {
+        const std::string& commit = commits[i];
+        auto start = std::chrono::steady_clock::now();
+        std::string subject = execute_command("git log -1 --format=%s " + commit, repo_path);
+        trim_right(subject, "\n ");
+
+        std::string status = "ok";
+        std::string message;
+        try {
+            std::string diff = filter.apply(commit_diff(repo_path, commit));
+            if (diff.empty()) {
+                status = "empty";
+            } else {
+                Message msg;
+                msg.type = "generate";
+                msg.body = diff;
+                Message response = quiet_exchange(msg);
+                message = response.body;
+                trim_right(message, "\n ");
+                if (response.get("status") != "ok")
+                    status = "error";
             }
+        } catch (const std::exception& e) {
+            status = "error";
+            message = e.what();
         }
+        if (status == "error")
+            failed = true;
+
+        char ms[32];
+        std::snprintf(ms, sizeof(ms), "%.1f",
+                      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        std::string line = "{\"index\":" + std::to_string(i) + ",\"commit\":" + json_string(commit)
+                           + ",\"subject\":" + json_string(subject) + ",\"status\":" + json_string(status)
+                           + ",\"message\":" + json_string(message) + ",\"ms\":" + ms + "}";
+        std::lock_guard<std::mutex> lock(out_mtx);
+        std::cout << line << std::endl;
+    });
+    return failed ? 1 : 0;
+}
 
-        if (++dots % 10 == 0) {
-            std::cout << "." << std::flush;
+// ========== PER-HUNK SUMMARIES (--hunks) ==========
+
+// Summarizes every hunk of the changes, optionally in one file, with a batch
+// of summary-line requests: each prompt is one file header plus one hunk, so
+// a huge file costs many short sequences instead of one truncated one. Files
+// without hunks (mode or rename only) get one summary for the file; binaries
+// and files the diff filter drops get none.
+int run_hunks(const std::string& repo_path, const std::string& file, bool staged) {
+    std::string diff = get_git_diff(repo_path, file, staged);
+    if (diff.empty()) {
+        print_warning(staged ? "No staged changes found" : "No unstaged changes found");
+        return 1;
+    }
+    std::vector<FileDiff> files = split_diff(diff + "\n");
+    DiffFilter filter = DiffFilter::load(repo_path);
+
+    struct Hunk {
+        size_t file;
+        std::string label;  // the "@@" line
+        std::string text;   // empty for files .commitgenignore leaves out
+        std::string summary;
+        bool failed = false;
+    };
+    std::vector<Hunk> hunks;
+    for (size_t f = 0; f < files.size(); f++) {
+        if (filter.skips(files[f])) {
+            hunks.push_back({f, "", "", files[f].binary ? "binary, not shown" : "not shown (.commitgenignore)",
+                             false});
+            continue;
+        }
+        if (files[f].hunks.empty()) {
+            hunks.push_back({f, "", files[f].text(), "", false});
+        }
+        for (size_t h = 0; h < files[f].hunks.size(); h++) {
+            const std::string& hunk = files[f].hunks[h];
+            hunks.push_back({f, hunk.substr(0, hunk.find('\n')), files[f].hunk_text(h), "", false});
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
 
-    std::cout << Color::RESET << std::endl;
-    throw std::runtime_error("Server timeout");
+    if (!ensure_server()) {
+        return 1;
+    }
+    print_info("Summarizing " + std::to_string(hunks.size()) + " hunk(s) in " + std::to_string(files.size())
+               + " file(s)");
+    for_each_concurrently(hunks.size(), [&](size_t i) {
+        if (hunks[i].text.empty())
+            return;
+        Message msg;
+        msg.type = "generate";
+        msg.fields["summary"] = "1";
+        msg.body = hunks[i].text;
+        try {
+            Message response = quiet_exchange(msg);
+            hunks[i].failed = response.get("status") != "ok";
+            // Older servers answer with the whole message
+            hunks[i].summary = hunks[i].failed ? response.body : first_line(response.body);
+        } catch (const std::exception& e) {
+            hunks[i].failed = true;
+            hunks[i].summary = e.what();
+        }
+    });
+
+    bool failed = false;
+    for (size_t i = 0; i < hunks.size(); i++) {
+        const Hunk& hunk = hunks[i];
+        if (i == 0 || hunks[i - 1].file != hunk.file) {
+            const FileDiff& f = files[hunk.file];
+            std::cout << "\n"
+                      << Color::BOLD << f.path << Color::RESET << Color::DIM << "  +" << f.added << " -" << f.removed
+                      << Color::RESET << "\n";
+        }
+        if (!hunk.label.empty()) {
+            std::cout << "  " << Color::CYAN << hunk.label << Color::RESET << "\n";
+        }
+        if (hunk.failed) {
+            failed = true;
+            std::cout << "    " << Color::RED << "✗ " << Color::RESET << hunk.summary << "\n";
+        } else if (hunk.text.empty()) {
+            std::cout << "    " << Color::DIM << hunk.summary << Color::RESET << "\n";
+        } else {
+            std::cout << "    " << hunk.summary << "\n";
+        }
+    }
+    std::cout << std::flush;
+    return failed ? 1 : 0;
+}
+
+// ========== prepare-commit-msg HOOK (--hook) ==========
+
+// git waits for the hook before it opens the editor, so it gets a hard budget
+constexpr int HOOK_BUDGET_MS = 300;
+
+const std::string HOOK_PLACEHOLDER =
+    "# commitgen: still generating a message for these changes. Abort with an empty\n"
+    "# message and commit again to get it, or run commitgen.\n";
+
+// One response, or false at the deadline or when the server hangs up
+bool read_until(Connection& conn, Message& response, std::chrono::steady_clock::time_point deadline) {
+    // Round up so a timeout really is past the deadline
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    return left.count() > 0 && conn.wait_readable((int)left.count()) && conn.read(response);
+}
+
+// Sends `msg` on a new connection and waits until the deadline. Leaving early
+// is fine: the server finishes the job anyway and keeps the message in its
+// result cache for the next attempt.
+bool hook_exchange(const Message& msg, Message& response, std::chrono::steady_clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    int fd = connect_or_autostart((int)std::max<int64_t>(0, left.count()));
+    if (fd < 0)
+        return false;
+    Connection conn(fd);
+    return conn.write(msg) && read_until(conn, response, deadline);
+}
+
+// Puts the suggestion (or the placeholder) above whatever git prepared
+bool prepend_to_file(const std::string& path, const std::string& text) {
+    std::ifstream in(path, std::ios::binary);
+    std::string existing((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text << existing;
+    return bool(out);
+}
+
+// No answer in time leaves a note; no server at all leaves the file alone
+int hook_gave_up(const std::string& msg_file, std::chrono::steady_clock::time_point deadline) {
+    if (std::chrono::steady_clock::now() >= deadline)
+        prepend_to_file(msg_file, HOOK_PLACEHOLDER);
+    return 0;
+}
+
+// `commitgen --hook prepare-commit-msg <file> [<source> [<sha>]]`: never
+// prompts, never fails the commit, and returns within the budget
+int run_hook(const std::string& hook, const std::vector<std::string>& args, const std::string& repo_path,
+             int budget_ms) {
+    if (hook != "prepare-commit-msg") {
+        print_error("Unsupported hook: " + hook);
+        return 1;
+    }
+    if (args.empty()) {
+        print_error("Usage: commitgen --hook prepare-commit-msg <file> [<source> [<sha>]]");
+        return 1;
+    }
+    // -m, -F, merges, squashes and amends already come with a message
+    std::string source = args.size() > 1 ? args[1] : "";
+    if (source == "message" || source == "merge" || source == "squash" || source == "commit")
+        return 0;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(budget_ms);
+    const std::string& msg_file = args[0];
+
+    // `git commit -a` and `git commit <paths>` stage into a temporary index
+    // that only git itself knows how to read
+    const char* index_file = getenv("GIT_INDEX_FILE");
+    bool temporary_index = index_file && *index_file && fs::path(index_file).filename() != "index";
+
+    Message response;
+    bool answered = false;
+    if (server_side_diff && !temporary_index) {
+        Message msg;
+        msg.type = "repo";
+        msg.fields["path"] = repo_path;
+        msg.fields["mode"] = "staged";
+        if (!hook_exchange(msg, response, deadline))
+            return hook_gave_up(msg_file, deadline);
+        if (response.get("code") == "empty")
+            return 0;
+        answered = response.get("status") == "ok"
+                   || (response.get("code") != "unsupported" && response.body.rfind("Unknown request type", 0) != 0);
+    }
+    if (!answered) {
+        std::string diff = get_filtered_diff(repo_path, "", true);
+        if (diff.empty())
+            return 0;
+        Message msg;
+        msg.type = "generate";
+        msg.body = diff;
+        if (!hook_exchange(msg, response, deadline))
+            return hook_gave_up(msg_file, deadline);
+    }
+
+    if (response.get("status") != "ok")
+        return 0;
+    std::string message = response.body;
+    trim_right(message, "\n ");
+    prepend_to_file(msg_file, message + "\n");
+    return 0;
+}
+
+// Installs the hook into this repository's hooks directory (core.hooksPath aware)
+int install_hook(const std::string& repo_path) {
+    std::string path = execute_command("git rev-parse --git-path hooks/prepare-commit-msg", repo_path);
+    trim_right(path, "\n ");
+    if (path.empty()) {
+        print_error("Cannot find the hooks directory");
+        return 1;
+    }
+    if (path[0] != '/')
+        path = repo_path + "/" + path;
+
+    std::ifstream existing(path);
+    std::string content((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+    if (!content.empty() && content.find("commitgen") == std::string::npos) {
+        print_error("A prepare-commit-msg hook already exists: " + path);
+        std::cout << Color::DIM << "Call \"commitgen --hook prepare-commit-msg \"$@\"\" from it instead" << Color::RESET
+                  << std::endl;
+        return 1;
+    }
+
+    char self[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    std::string binary = n > 0 ? std::string(self, n) : "commitgen";
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    std::ofstream out(path, std::ios::trunc);
+    out << "#!/bin/sh\n"
+        << "# Suggests a commit message; installed by commitgen --install-hook\n"
+        << "exec '" << escape_for_shell(binary) << "' --hook prepare-commit-msg \"$@\"\n";
+    out.close();
+    if (!out || chmod(path.c_str(), 0755) != 0) {
+        print_error("Failed to write " + path);
+        return 1;
+    }
+    print_success("Installed " + path);
+    return 0;
 }
 
 // Commit result structure
@@ -275,32 +1079,19 @@ CommitResult interactive_commit(const std::string& repo_path, const std::string&
     std::cout << Color::BOLD << Color::BLUE << "│" << Color::RESET << "\n";
     std::cout << Color::BOLD << Color::BLUE << "└──────────────────────────────────────────┘" << Color::RESET << "\n";
 
-    // Get diff
-    std::string diff;
-    try {
-        diff = get_git_diff(repo_path, file, true);
-    } catch (...) {
-        diff = execute_command("git diff --cached -- \"" + file + "\"", repo_path);
-    }
-
-    if (diff.empty()) {
-        print_warning("No diff available for this file");
-        return result;
-    }
-
     // Generate commit message
     std::string commit_msg;
     try {
-        commit_msg = send_request(diff);
+        if (!generate_message(repo_path, file, true, commit_msg)) {
+            print_warning("No diff available for this file");
+            return result;
+        }
     } catch (const std::exception& e) {
         print_error(e.what());
         return result;
     }
 
-    // Trim
-    while (!commit_msg.empty() && (commit_msg.back() == '\n' || commit_msg.back() == ' ')) {
-        commit_msg.pop_back();
-    }
+    trim_right(commit_msg, "\n ");
 
     result.message = commit_msg;
 
@@ -420,12 +1211,30 @@ void show_usage(const std::string& prog_name) {
               << "            Interactive mode: commit each file separately\n";
     std::cout << "  " << Color::GREEN << "-a, --all" << Color::RESET
               << "             Generate single commit for all staged changes\n";
+    std::cout << "  " << Color::GREEN << "-H, --hunks" << Color::RESET
+              << "           Summarize each hunk separately, all at once\n";
     std::cout << "  " << Color::GREEN << "-u, --unstaged" << Color::RESET
               << "        Use unstaged changes instead of staged\n";
     std::cout << "  " << Color::GREEN << "-l, --list" << Color::RESET << "            List changed files\n";
     std::cout << "  " << Color::GREEN << "-s, --status" << Color::RESET << "          Check server status\n";
+    std::cout << "  " << Color::GREEN << "-w, --watch" << Color::RESET
+              << "           Have the server pre-generate as changes are staged\n";
     std::cout << "  " << Color::GREEN << "-y, --yes" << Color::RESET
               << "             Auto-accept all commits (no prompts)\n";
+    std::cout << "  " << Color::GREEN << "--profile" << Color::RESET
+              << "             Print a client/server latency breakdown\n";
+    std::cout << "  " << Color::GREEN << "--trace <file>" << Color::RESET
+              << "        Write a Chrome trace of this run (client and server spans)\n";
+    std::cout << "  " << Color::GREEN << "--install-hook" << Color::RESET
+              << "        Suggest messages in git's editor via a prepare-commit-msg hook\n";
+    std::cout << "  " << Color::GREEN << "--hook <name> <args>" << Color::RESET
+              << "  Run as a git hook (prepare-commit-msg), within --budget ms (default 300)\n";
+    std::cout << "  " << Color::GREEN << "--repos <dir>" << Color::RESET
+              << "         Generate for every repository under a directory at once, as JSON\n";
+    std::cout << "  " << Color::GREEN << "--range <A..B>" << Color::RESET
+              << "        Propose a message for every commit in a range, as JSON lines\n";
+    std::cout << "  " << Color::GREEN << "--local-diff" << Color::RESET
+              << "          Run git diff here instead of letting the server read the repository\n";
     std::cout << "  " << Color::GREEN << "-h, --help" << Color::RESET << "            Show this help message\n\n";
 
     std::cout << Color::BOLD << "EXAMPLES:" << Color::RESET << "\n";
@@ -438,20 +1247,40 @@ void show_usage(const std::string& prog_name) {
     std::cout << Color::DIM << "  # Generate commit for a specific file" << Color::RESET << "\n";
     std::cout << "  " << prog_name << " -f src/main.cpp\n\n";
 
+    std::cout << Color::DIM << "  # One-line summary of each hunk in a large file" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " --hunks -f src/main.cpp\n\n";
+
     std::cout << Color::DIM << "  # Interactive mode for another repository" << Color::RESET << "\n";
-    std::cout << "  " << prog_name << " --path ~/projects/myapp --each\n";
+    std::cout << "  " << prog_name << " --path ~/projects/myapp --each\n\n";
+
+    std::cout << Color::DIM << "  # Staged changes of every checkout under ~/src" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " --repos ~/src > messages.json\n\n";
+
+    std::cout << Color::DIM << "  # Suggested rewordings for a branch's commits" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " --range main..HEAD\n";
 }
 
 // Parse arguments
 struct Options {
     std::string repo_path = ".";
     std::string file_path = "";
+    std::string trace_file = "";
+    std::string repos_dir;
+    std::string range;
     bool staged = true;
     bool list_files = false;
     bool show_status = false;
     bool show_help = false;
     bool each_file = false;
+    bool hunks = false;
     bool auto_accept = false;
+    bool profile = false;
+    bool local_diff = false;
+    bool watch = false;
+    bool install_hook = false;
+    std::string hook;
+    std::vector<std::string> hook_args;
+    int budget_ms = HOOK_BUDGET_MS;
 };
 
 Options parse_args(int argc, char** argv) {
@@ -473,10 +1302,33 @@ Options parse_args(int argc, char** argv) {
             opts.each_file = false;
         } else if (arg == "-e" || arg == "--each") {
             opts.each_file = true;
+        } else if (arg == "-H" || arg == "--hunks") {
+            opts.hunks = true;
         } else if ((arg == "-p" || arg == "--path") && i + 1 < argc) {
             opts.repo_path = argv[++i];
         } else if ((arg == "-f" || arg == "--file") && i + 1 < argc) {
             opts.file_path = argv[++i];
+        } else if (arg == "--profile") {
+            opts.profile = true;
+        } else if (arg == "--local-diff") {
+            opts.local_diff = true;
+        } else if (arg == "--repos" && i + 1 < argc) {
+            opts.repos_dir = argv[++i];
+        } else if (arg == "--range" && i + 1 < argc) {
+            opts.range = argv[++i];
+        } else if (arg == "-w" || arg == "--watch") {
+            opts.watch = true;
+        } else if (arg == "--install-hook") {
+            opts.install_hook = true;
+        } else if (arg == "--budget" && i + 1 < argc) {
+            opts.budget_ms = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--hook" && i + 1 < argc) {
+            // Everything after the hook name is git's arguments to the hook
+            opts.hook = argv[++i];
+            opts.hook_args.assign(argv + i + 1, argv + argc);
+            break;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            opts.trace_file = argv[++i];
         } else if (arg[0] != '-') {
             opts.file_path = arg;
         } else if (arg == "-y" || arg == "--yes") {
@@ -514,8 +1366,34 @@ int main(int argc, char** argv) {
         return 0;
     }
 
+    if (opts.trace_file.empty() && getenv("COMMITGEN_TRACE")) {
+        opts.trace_file = getenv("COMMITGEN_TRACE");
+    }
+    if (!opts.trace_file.empty()) {
+        trace::set_process_name("commitgen");
+        trace::enable(opts.trace_file);
+        std::atexit(trace::close);
+    }
+    if (opts.profile) {
+        profile.enabled = true;
+        std::atexit(print_profile);
+    }
+    server_side_diff = !opts.local_diff;
+
+    if (!opts.hook.empty()) {
+        return run_hook(opts.hook, opts.hook_args, opts.repo_path, opts.budget_ms);
+    }
+
     if (opts.show_status) {
-        if (is_server_running()) {
+        // Read straight from the server's shared stats page, no round trip
+        ServerStats stats;
+        if (read_server_stats(stats) && (kill(stats.pid, 0) == 0 || errno == EPERM)) {
+            print_success("Server is running (PID " + std::to_string(stats.pid) + ")");
+            for (const auto& [label, value] : describe_stats(stats)) {
+                std::cout << "  " << Color::DIM << label << std::string(10 - label.size(), ' ') << Color::RESET
+                          << value << "\n";
+            }
+        } else if (is_server_running()) {
             print_success("Server is running");
         } else {
             print_error("Server is not running");
@@ -524,11 +1402,36 @@ int main(int argc, char** argv) {
         return 0;
     }
 
+    if (!opts.repos_dir.empty()) {
+        char resolved[PATH_MAX];
+        if (!realpath(opts.repos_dir.c_str(), resolved)) {
+            print_error("No such directory: " + opts.repos_dir);
+            return 1;
+        }
+        if (!server_available()) {
+            print_error("Server is not running");
+            return 1;
+        }
+        return run_repos(resolved, opts.staged);
+    }
+
     if (!is_git_repo(opts.repo_path)) {
         print_error("Not a git repository: " + opts.repo_path);
         return 1;
     }
 
+    if (opts.install_hook) {
+        return install_hook(opts.repo_path);
+    }
+
+    if (!opts.range.empty()) {
+        if (!server_available()) {
+            print_error("Server is not running");
+            return 1;
+        }
+        return run_range(opts.repo_path, opts.range);
+    }
+
     if (opts.list_files) {
         auto files = get_changed_files(opts.repo_path, opts.staged);
         if (files.empty()) {
@@ -543,12 +1446,35 @@ int main(int argc, char** argv) {
         return 0;
     }
 
-    if (!is_server_running()) {
+    if (!server_available()) {
         print_error("Server is not running");
-        std::cout << Color::DIM << "Start with: commitgen-server --start <model_path>" << Color::RESET << std::endl;
+        std::cout << Color::DIM << "Start with: commitgen-server --start <model_path>\n"
+                  << "or put \"model = <model_path>\" in " << config_path() << " to start it on demand"
+                  << Color::RESET << std::endl;
         return 1;
     }
 
+    if (opts.watch) {
+        std::string reply;
+        if (!register_watch(opts.repo_path, reply)) {
+            print_error(reply);
+            return 1;
+        }
+        print_success(reply);
+        std::cout << Color::DIM << "Staged changes are pre-generated in the background from now on" << Color::RESET
+                  << std::endl;
+        return 0;
+    }
+
+    if (opts.hunks) {
+        try {
+            return run_hunks(opts.repo_path, opts.file_path, opts.staged);
+        } catch (const std::exception& e) {
+            print_error(e.what());
+            return 1;
+        }
+    }
+
     // ========== EACH FILE MODE ==========
     if (opts.each_file) {
         auto files = get_changed_files(opts.repo_path, opts.staged);
@@ -599,9 +1525,14 @@ int main(int argc, char** argv) {
 
     // ========== SINGLE COMMIT MODE (default) ==========
     try {
-        std::string diff = get_git_diff(opts.repo_path, opts.file_path, opts.staged);
+        if (!opts.file_path.empty()) {
+            print_info("Generating commit for: " + opts.file_path);
+        } else {
+            print_info(opts.staged ? "Generating commit for staged changes" : "Generating commit for unstaged changes");
+        }
 
-        if (diff.empty()) {
+        std::string commit_msg;
+        if (!generate_message(opts.repo_path, opts.file_path, opts.staged, commit_msg)) {
             if (!opts.file_path.empty()) {
                 print_warning("No changes in file: " + opts.file_path);
             } else {
@@ -616,19 +1547,7 @@ int main(int argc, char** argv) {
             return 1;
         }
 
-        if (!opts.file_path.empty()) {
-            print_info("Generating commit for: " + opts.file_path);
-        } else {
-            auto files = get_changed_files(opts.repo_path, opts.staged);
-            print_info("Generating commit for " + std::to_string(files.size()) + " file(s)");
-        }
-
-        std::string commit_msg = send_request(diff);
-
-        // Trim
-        while (!commit_msg.empty() && (commit_msg.back() == '\n' || commit_msg.back() == ' ')) {
-            commit_msg.pop_back();
-        }
+        trim_right(commit_msg, "\n ");
 
         std::cout << "\n" << Color::BOLD << "Suggested commit message:" << Color::RESET << "\n";
         std::cout << Color::YELLOW << "─────────────────────────────────────────" << Color::RESET << "\n";
@@ -1,5 +1,6 @@
 #include "commitgen.h"
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <chrono>
@@ -13,36 +14,77 @@
 #include <thread>
 #include <vector>
 
-#include "llama.h"
+#include "backend.h"
+#include "probes.h"
+#include "text_util.h"
+#include "trace.h"
 
 struct CommitGen::Impl {
-    llama_model* model = nullptr;
-    llama_context* ctx = nullptr;
-    const llama_vocab* vocab = nullptr;
+    std::unique_ptr<Backend> backend;
     std::mutex mtx;
     std::atomic<bool> ready{false};
+    std::atomic<bool> failed{false};
     std::future<void> init_future;
-};
 
-CommitGen::CommitGen(const std::string& model_path) : impl(std::make_unique<Impl>()) {
-    impl->init_future = std::async(std::launch::async, [this, model_path]() {
-// Only set log callback in server mode to avoid client interference
-#ifdef SERVER_MODE
-        llama_log_set([](enum ggml_log_level, const char*, void*) {}, nullptr);
-#endif
+    // A KV sequence and the message being generated in it
+    struct Sequence {
+        std::vector<Token> cached;  // tokens currently held in the backend's KV cache
+        bool busy = false;
+        uint64_t serial = 0;
+        uint64_t tag = 0;
+        uint64_t request = 0;
+        bool tracing = false;
+        GenerationStats* stats = nullptr;
+        TokenCallback on_token;
+
+        std::vector<Token> prompt;
+        size_t kept = 0;       // prompt prefix reused from the previous message
+        size_t prefilled = 0;  // prompt tokens in the KV cache
+        Token next = 0;        // sampled and still to be decoded
+        int sampled = 0;
+        int consecutive_newlines = 0;
+        std::string result;
+
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point prefill_start;
+        std::chrono::steady_clock::time_point decode_start;
+        int64_t prefill_start_us = 0;
+        int64_t decode_start_us = 0;
+    };
+    std::vector<Sequence> sequences;
+    uint64_t next_serial = 1;
+
+    // Finished messages not yet handed out by step() or generate()
+    struct Done {
+        uint64_t serial;
+        Finished message;
+    };
+    std::vector<Done> done;
+
+    // Called with mtx held
+    int begin(uint64_t tag, const std::string& diff, GenerationStats* stats, TokenCallback on_token);
+    void step();
+    void advance(int seq);
+    void finish(int seq);
+    void abandon();
+};
 
-        llama_model_params model_params = llama_model_default_params();
-        impl->model = llama_model_load_from_file(model_path.c_str(), model_params);
+namespace {
 
-        if (!impl->model)
-            return;
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
-        llama_context_params ctx_params = llama_context_default_params();
-        ctx_params.n_ctx = 4096;
-        impl->ctx = llama_init_from_model(impl->model, ctx_params);
-        impl->vocab = llama_model_get_vocab(impl->model);
+}  // namespace
 
-        impl->ready = true;
+CommitGen::CommitGen(const std::string& model_path, size_t parallel) : impl(std::make_unique<Impl>()) {
+    impl->backend = make_backend(model_path, parallel);
+    impl->sequences.resize(impl->backend->max_sequences());
+    impl->init_future = std::async(std::launch::async, [this]() {
+        if (impl->backend->load())
+            impl->ready = true;
+        else
+            impl->failed = true;
     });
 }
 
@@ -50,18 +92,19 @@ CommitGen::~CommitGen() {
     if (impl->init_future.valid()) {
         impl->init_future.wait();
     }
-    if (impl->ctx)
-        llama_free(impl->ctx);
-    if (impl->model)
-        llama_model_free(impl->model);
 }
 
 bool CommitGen::is_ready() const {
     return impl->ready.load();
 }
 
-std::string build_prompt(const std::string& diff) {
-    return R"(<|im_start|>system
+bool CommitGen::load_failed() const {
+    return impl->failed.load();
+}
+
+namespace {
+
+const char PROMPT_HEAD[] = R"(<|im_start|>system
 You are a commit message generator. Write a clear, natural commit message.
 
 Rules:
@@ -79,91 +122,318 @@ Disable playground build by default
 The CMake configuration now has BUILD_PLAYGROUND disabled by default to streamline the build process. Users who need the playground examples can enable it manually in their local configuration.
 <|im_end|>
 <|im_start|>user
-)" + diff
-        + R"(
+)";
+
+const char PROMPT_TAIL[] = R"(
 <|im_end|>
 <|im_start|>assistant
 )";
-}
 
-std::string CommitGen::generate(const std::string& diff) {
-    if (!is_ready())
-        return "";
-
-    std::lock_guard<std::mutex> lock(impl->mtx);
-
-    // Clear the KV cache
-    llama_memory_t mem = llama_get_memory(impl->ctx);
-    llama_memory_seq_rm(mem, 0, 0, -1);
+}  // namespace
 
-    std::string input = diff.substr(0, 4000);
-    std::string prompt = build_prompt(input);  // Fixed: was using `diff` instead of `input`
-    std::vector<llama_token> tokens(prompt.size() + 16);
-    int n_tokens =
-        llama_tokenize(impl->vocab, prompt.c_str(), (int)prompt.size(), tokens.data(), (int)tokens.size(), true, true);
-    if (n_tokens < 0)
-        return "";
-    tokens.resize(n_tokens);
+std::string build_prompt(const std::string& diff) {
+    std::string prompt;
+    prompt.reserve(sizeof(PROMPT_HEAD) + diff.size() + sizeof(PROMPT_TAIL));
+    prompt.append(PROMPT_HEAD, sizeof(PROMPT_HEAD) - 1);
+    prompt.append(diff);
+    prompt.append(PROMPT_TAIL, sizeof(PROMPT_TAIL) - 1);
+    return prompt;
+}
 
-    llama_batch batch = llama_batch_get_one(tokens.data(), (int)tokens.size());
-    if (llama_decode(impl->ctx, batch) != 0)
-        return "";
+// Tokenizes the prompt into the free sequence that already holds the longest
+// prefix of it; -1 if every sequence is busy
+int CommitGen::Impl::begin(uint64_t tag, const std::string& diff, GenerationStats* stats, TokenCallback on_token) {
+    if (std::all_of(sequences.begin(), sequences.end(), [](const Sequence& s) { return s.busy; }))
+        return -1;
 
-    llama_sampler* sampler = llama_sampler_chain_init(llama_sampler_chain_default_params());
-    llama_sampler_chain_add(sampler, llama_sampler_init_temp(0.3f));
-    llama_sampler_chain_add(sampler, llama_sampler_init_top_p(0.9f, 1));
-    llama_sampler_chain_add(sampler, llama_sampler_init_dist(42));
+    auto start = std::chrono::steady_clock::now();
+    uint64_t request = trace::current_request();
 
-    std::string stop_str = "<|im_end|>";
+    std::string input = diff.substr(0, MAX_DIFF_BYTES);
+    std::string prompt = build_prompt(input);  // Fixed: was using `diff` instead of `input`
+    std::vector<Token> tokens;
+    CG_PROBE2(tokenize__start, request, prompt.size());
+    {
+        trace::Span span("tokenize");
+        tokens = backend->tokenize(prompt);
+        span.arg("tokens", (long long)tokens.size());
+    }
+    CG_PROBE2(tokenize__end, request, tokens.size());
+
+    // Keep the KV entries for the prefix shared with the sequence's previous
+    // prompt (the system prompt at least) and only decode the rest. One token
+    // is always decoded so the sampler gets fresh logits.
+    int seq = -1;
+    size_t n_keep = 0;
+    for (size_t i = 0; i < sequences.size(); i++) {
+        const std::vector<Token>& cached = sequences[i].cached;
+        if (sequences[i].busy)
+            continue;
+        size_t n = 0;
+        while (n < cached.size() && n + 1 < tokens.size() && cached[n] == tokens[n]) {
+            n++;
+        }
+        if (seq < 0 || n > n_keep) {
+            seq = (int)i;
+            n_keep = n;
+        }
+    }
 
-    std::string result;
-    int consecutive_newlines = 0;
+    Sequence& s = sequences[seq];
+    s.busy = true;
+    s.serial = next_serial++;
+    s.tag = tag;
+    s.request = request;
+    s.tracing = trace::active();
+    s.stats = stats;
+    s.on_token = std::move(on_token);
+    s.sampled = 0;
+    s.consecutive_newlines = 0;
+    s.result.clear();
+    s.start = start;
+    if (tokens.empty()) {
+        s.prompt.clear();
+        s.kept = 0;
+        s.prefilled = 0;
+        finish(seq);
+        return seq;
+    }
+    if (stats) {
+        stats->prompt_tokens = (int)tokens.size();
+        stats->tokenize_seconds = seconds_since(start);
+    }
 
-    for (int i = 0; i < 512; i++) {  // Increased from 100 to 512
-        llama_token new_token = llama_sampler_sample(sampler, impl->ctx, -1);
-        if (llama_vocab_is_eog(impl->vocab, new_token))
-            break;
+    if (!backend->truncate(seq, n_keep)) {
+        n_keep = 0;
+    }
+    s.cached.assign(tokens.begin(), tokens.begin() + n_keep);
+    if (stats)
+        stats->cached_tokens = (int)n_keep;
+    s.prompt = std::move(tokens);
+    s.kept = n_keep;
+    s.prefilled = n_keep;
+    s.prefill_start = std::chrono::steady_clock::now();
+    s.prefill_start_us = s.tracing ? trace::now_us() : 0;
+    return seq;
+}
 
-        char buf[256];
-        int len = llama_token_to_piece(impl->vocab, new_token, buf, sizeof(buf), 0, true);
-        if (len < 0)
+// One batch: a token for every message past its prompt, then prompt chunks
+// (n_batch at most) in the room left, so new prompts never stall running ones
+void CommitGen::Impl::step() {
+    size_t n_batch = backend->batch_size();
+    std::vector<SequenceTokens> batch;
+    std::vector<bool> prefill;
+    size_t total = 0;
+
+    for (size_t i = 0; i < sequences.size() && total < n_batch; i++) {
+        Sequence& s = sequences[i];
+        if (!s.busy || s.prefilled < s.prompt.size())
             continue;
-
-        std::string piece(buf, len);
-        result.append(piece);
-
-        // Stop at <|im_end|> token
-        if (result.find(stop_str) != std::string::npos) {
-            result = result.substr(0, result.find(stop_str));
-            break;
+        CG_PROBE3(decode__step, s.request, s.sampled - 1, s.cached.size());
+        batch.push_back({(int)i, &s.next, 1, true});
+        prefill.push_back(false);
+        total++;
+    }
+    for (size_t i = 0; i < sequences.size() && total < n_batch; i++) {
+        Sequence& s = sequences[i];
+        if (!s.busy || s.prefilled == s.prompt.size())
+            continue;
+        size_t n_chunk = std::min(n_batch - total, s.prompt.size() - s.prefilled);
+        CG_PROBE3(prefill__chunk, s.request, n_chunk, s.prefilled);
+        batch.push_back({(int)i, s.prompt.data() + s.prefilled, n_chunk, s.prefilled + n_chunk == s.prompt.size()});
+        prefill.push_back(true);
+        total += n_chunk;
+    }
+    if (batch.empty())
+        return;
+
+    if (!backend->decode(batch)) {
+        // A message that fails mid-prompt comes back empty, one that fails
+        // while generating keeps what it has
+        for (size_t k = 0; k < batch.size(); k++) {
+            Sequence& s = sequences[batch[k].seq];
+            if (prefill[k]) {
+                backend->truncate(batch[k].seq, 0);
+                s.cached.clear();
+                s.prompt.clear();
+                s.kept = 0;
+                s.prefilled = 0;
+            }
+            finish(batch[k].seq);
         }
+        return;
+    }
 
-        // Stop after 3 consecutive newlines (end of message)
-        if (piece == "\n") {
-            consecutive_newlines++;
-            if (consecutive_newlines >= 3)
-                break;
-        } else if (piece.find_first_not_of(" \t") != std::string::npos) {
-            consecutive_newlines = 0;
+    for (size_t k = 0; k < batch.size(); k++) {
+        const SequenceTokens& entry = batch[k];
+        Sequence& s = sequences[entry.seq];
+        s.cached.insert(s.cached.end(), entry.tokens, entry.tokens + entry.n);
+        if (prefill[k]) {
+            s.prefilled += entry.n;
+            if (s.prefilled < s.prompt.size())
+                continue;
+
+            if (s.stats)
+                s.stats->prefill_seconds = seconds_since(s.prefill_start);
+            if (s.tracing) {
+                int64_t now = trace::now_us();
+                trace::record("prefill", "commitgen", s.prefill_start_us, now - s.prefill_start_us, s.request,
+                              "\"tokens\":" + std::to_string(s.prompt.size() - s.kept)
+                                  + ",\"cached\":" + std::to_string(s.kept));
+                s.decode_start_us = now;
+            }
+            backend->reset_sampler(entry.seq);
+            s.decode_start = std::chrono::steady_clock::now();
         }
+        advance(entry.seq);
+    }
+}
 
-        batch = llama_batch_get_one(&new_token, 1);
-        if (llama_decode(impl->ctx, batch) != 0)
-            break;
+// Samples the sequence's next token and checks the stop conditions
+void CommitGen::Impl::advance(int seq) {
+    Sequence& s = sequences[seq];
+    Token new_token = backend->sample(seq);
+    int i = s.sampled++;
+    CG_PROBE3(sample, s.request, new_token, i);
+    if (s.stats && i == 0) {
+        s.stats->first_token_seconds = seconds_since(s.start);
+        s.decode_start = std::chrono::steady_clock::now();
     }
+    if (backend->is_eog(new_token))
+        return finish(seq);
+    if (s.stats)
+        s.stats->completion_tokens++;
+
+    std::string piece = backend->token_to_piece(new_token);
+    s.result.append(piece);
+
+    // Stop at <|im_end|> token
+    const std::string stop_str = "<|im_end|>";
+    size_t stop = s.result.find(stop_str);
+    if (stop != std::string::npos) {
+        s.result.resize(stop);
+        return finish(seq);
+    }
+
+    if (s.on_token && !s.on_token(piece))
+        return finish(seq);
+
+    // Stop after 3 consecutive newlines (end of message)
+    if (piece == "\n") {
+        s.consecutive_newlines++;
+        if (s.consecutive_newlines >= 3)
+            return finish(seq);
+    } else if (piece.find_first_not_of(" \t") != std::string::npos) {
+        s.consecutive_newlines = 0;
+    }
+
+    if (s.sampled >= MAX_NEW_TOKENS)
+        return finish(seq);
+    s.next = new_token;
+}
 
-    llama_sampler_free(sampler);
+void CommitGen::Impl::finish(int seq) {
+    Sequence& s = sequences[seq];
+    bool decoded = !s.prompt.empty() && s.prefilled == s.prompt.size();
+    if (decoded && s.tracing) {
+        trace::record("decode", "commitgen", s.decode_start_us, trace::now_us() - s.decode_start_us, s.request,
+                      "\"tokens\":" + std::to_string(s.cached.size() - s.prompt.size()));
+    }
+    if (decoded && s.stats) {
+        s.stats->decode_seconds = seconds_since(s.decode_start);
+        s.stats->context_used = (int)s.cached.size();
+        s.stats->context_size = (int)backend->context_size();
+    }
 
     // Clean up result
     // Remove quotes if present
+    std::string& result = s.result;
     if (!result.empty() && result[0] == '"')
         result.erase(0, 1);
     if (!result.empty() && result.back() == '"')
         result.pop_back();
 
-    // Trim trailing whitespace
-    while (!result.empty() && (result.back() == '\n' || result.back() == ' '))
-        result.pop_back();
+    trim_right(result, "\n ");
 
-    return result;
+    done.push_back({s.serial, {s.tag, std::move(result)}});
+    s.busy = false;
+    s.stats = nullptr;
+    s.on_token = nullptr;
+    s.result.clear();
+}
+
+// After an exception nothing is known about the sequences; drop them all
+void CommitGen::Impl::abandon() {
+    for (size_t i = 0; i < sequences.size(); i++) {
+        backend->truncate((int)i, 0);
+        sequences[i].cached.clear();
+        sequences[i].busy = false;
+        sequences[i].on_token = nullptr;
+    }
+}
+
+std::string CommitGen::generate(const std::string& diff, GenerationStats* stats, const TokenCallback& on_token) {
+    if (!is_ready())
+        return "";
+
+    std::lock_guard<std::mutex> lock(impl->mtx);
+    try {
+        int seq;
+        while ((seq = impl->begin(0, diff, stats, on_token)) < 0) {
+            impl->step();
+        }
+        uint64_t serial = impl->sequences[seq].serial;
+        for (;;) {
+            for (auto it = impl->done.begin(); it != impl->done.end(); ++it) {
+                if (it->serial == serial) {
+                    std::string result = std::move(it->message.result);
+                    impl->done.erase(it);
+                    return result;
+                }
+            }
+            impl->step();
+        }
+    } catch (...) {
+        impl->abandon();
+        throw;
+    }
+}
+
+size_t CommitGen::parallel() const {
+    return impl->sequences.size();
+}
+
+size_t CommitGen::running() const {
+    std::lock_guard<std::mutex> lock(impl->mtx);
+    return std::count_if(impl->sequences.begin(), impl->sequences.end(),
+                         [](const Impl::Sequence& s) { return s.busy; });
+}
+
+bool CommitGen::start(uint64_t tag, const std::string& diff, GenerationStats* stats, TokenCallback on_token) {
+    if (!is_ready())
+        return false;
+
+    std::lock_guard<std::mutex> lock(impl->mtx);
+    try {
+        return impl->begin(tag, diff, stats, std::move(on_token)) >= 0;
+    } catch (...) {
+        impl->abandon();
+        throw;
+    }
+}
+
+std::vector<CommitGen::Finished> CommitGen::step() {
+    std::lock_guard<std::mutex> lock(impl->mtx);
+    try {
+        impl->step();
+    } catch (...) {
+        impl->abandon();
+        throw;
+    }
+    std::vector<Finished> out;
+    for (auto& done : impl->done) {
+        out.push_back(std::move(done.message));
+    }
+    impl->done.clear();
+    return out;
 }
@@ -1,14 +1,62 @@
 #pragma once
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <memory>
+#include <vector>
+
+// Diff bytes fed to the model; anything beyond is dropped
+constexpr size_t MAX_DIFF_BYTES = 4000;
+
+// Upper bound on generated tokens per message
+constexpr int MAX_NEW_TOKENS = 512;
+
+// Called with each generated piece; return false to stop generating
+using TokenCallback = std::function<bool(const std::string& piece)>;
+
+struct GenerationStats {
+    int prompt_tokens = 0;
+    int completion_tokens = 0;
+    int cached_tokens = 0;  // prompt prefix reused from the previous request's KV cache
+
+    double tokenize_seconds = 0;
+    double prefill_seconds = 0;
+    double first_token_seconds = 0;  // from the start of generate()
+    double decode_seconds = 0;
+
+    int context_used = 0;
+    int context_size = 0;
+};
+
+// The chat prompt wrapped around a diff
+std::string build_prompt(const std::string& diff);
 
 class CommitGen {
 public:
-    CommitGen(const std::string& model_path);
+    // Up to `parallel` messages can be generated at once, each in its own KV sequence
+    CommitGen(const std::string& model_path, size_t parallel = 1);
     ~CommitGen();
 
     bool is_ready() const;
-    std::string generate(const std::string& diff);
+    bool load_failed() const;
+    std::string generate(const std::string& diff, GenerationStats* stats = nullptr,
+                         const TokenCallback& on_token = nullptr);
+
+    // Continuous batching, driven from one thread: start() claims a free
+    // sequence for a diff, and each step() samples and decodes one token for
+    // every running message in a single batch, prefilling newly started
+    // prompts alongside. Messages leave as they finish, so others can start
+    // without waiting for the whole batch. `stats` must outlive the message.
+    struct Finished {
+        uint64_t tag = 0;
+        std::string result;
+    };
+    size_t parallel() const;
+    size_t running() const;
+    // False when every sequence is busy
+    bool start(uint64_t tag, const std::string& diff, GenerationStats* stats = nullptr,
+               TokenCallback on_token = nullptr);
+    std::vector<Finished> step();
 
 private:
     struct Impl;
@@ -0,0 +1,264 @@
+#include "commitgen_c.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "commitgen.h"
+
+// Exceptions never cross the C boundary; they become NULL / -1 plus
+// commitgen_last_error(), or a FAILED request.
+namespace {
+
+thread_local std::string last_error;
+
+struct Request {
+    std::string diff;
+    commitgen_token_fn on_token = nullptr;
+    void* user = nullptr;
+    std::atomic<bool> cancel{false};
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    commitgen_status status = COMMITGEN_QUEUED;
+    std::string unread;  // streamed text not yet taken by commitgen_request_read
+    std::string result;
+    std::string error;
+
+    void finish(commitgen_status s, std::string text = "") {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            status = s;
+            (s == COMMITGEN_DONE ? result : error) = std::move(text);
+        }
+        cv.notify_all();
+    }
+
+    bool finished() const { return status > COMMITGEN_RUNNING; }
+};
+
+}  // namespace
+
+struct commitgen_request {
+    std::shared_ptr<Request> state;
+};
+
+struct commitgen_engine {
+    std::unique_ptr<CommitGen> generator;
+    std::thread worker;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<Request>> queue;
+    std::shared_ptr<Request> running;
+    bool stopping = false;
+
+    void run() {
+        // Queued requests wait for the model
+        while (!generator->is_ready() && !generator->load_failed()) {
+            std::unique_lock<std::mutex> lock(mtx);
+            if (cv.wait_for(lock, std::chrono::milliseconds(5), [this] { return stopping; }))
+                break;
+        }
+
+        for (;;) {
+            std::shared_ptr<Request> req;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                req = queue.front();
+                queue.pop_front();
+                running = req;
+            }
+            process(*req);
+            std::lock_guard<std::mutex> lock(mtx);
+            running.reset();
+        }
+    }
+
+    void process(Request& req) {
+        if (req.cancel) {
+            req.finish(COMMITGEN_CANCELLED);
+            return;
+        }
+        if (!generator->is_ready()) {
+            req.finish(COMMITGEN_FAILED, "Model failed to load");
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(req.mtx);
+            req.status = COMMITGEN_RUNNING;
+        }
+        req.cv.notify_all();
+
+        try {
+            std::string message = generator->generate(req.diff, nullptr, [&req](const std::string& piece) {
+                if (req.cancel)
+                    return false;
+                if (req.on_token) {
+                    if (!req.on_token(piece.data(), piece.size(), req.user))
+                        req.cancel = true;
+                } else {
+                    std::lock_guard<std::mutex> lock(req.mtx);
+                    req.unread += piece;
+                }
+                req.cv.notify_all();
+                return !req.cancel.load();
+            });
+            if (req.cancel)
+                req.finish(COMMITGEN_CANCELLED);
+            else
+                req.finish(COMMITGEN_DONE, message);
+        } catch (const std::exception& e) {
+            req.finish(COMMITGEN_FAILED, e.what());
+        }
+    }
+};
+
+extern "C" {
+
+int commitgen_api_version(void) {
+    return COMMITGEN_API_VERSION;
+}
+
+const char* commitgen_last_error(void) {
+    return last_error.c_str();
+}
+
+commitgen_engine* commitgen_engine_create(const char* model_path) {
+    if (!model_path) {
+        last_error = "model_path is NULL";
+        return nullptr;
+    }
+    try {
+        auto engine = std::make_unique<commitgen_engine>();
+        engine->generator = std::make_unique<CommitGen>(model_path);
+        commitgen_engine* raw = engine.get();
+        engine->worker = std::thread([raw] { raw->run(); });
+        return engine.release();
+    } catch (const std::exception& e) {
+        last_error = e.what();
+        return nullptr;
+    }
+}
+
+int commitgen_engine_wait_ready(commitgen_engine* engine, int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+        if (engine->generator->is_ready())
+            return 1;
+        if (engine->generator->load_failed()) {
+            last_error = "Model failed to load";
+            return -1;
+        }
+        if (timeout_ms >= 0 && std::chrono::steady_clock::now() >= deadline)
+            return 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+void commitgen_engine_free(commitgen_engine* engine) {
+    if (!engine)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(engine->mtx);
+        engine->stopping = true;
+        for (auto& req : engine->queue) {
+            req->finish(COMMITGEN_CANCELLED);
+        }
+        engine->queue.clear();
+        if (engine->running)
+            engine->running->cancel = true;
+    }
+    engine->cv.notify_all();
+    engine->worker.join();
+    delete engine;
+}
+
+commitgen_request* commitgen_submit_stream(commitgen_engine* engine, const char* diff, size_t len,
+                                           commitgen_token_fn on_token, void* user) {
+    if (!engine || (!diff && len > 0)) {
+        last_error = "engine or diff is NULL";
+        return nullptr;
+    }
+    try {
+        auto req = std::make_shared<Request>();
+        req->diff.assign(diff ? diff : "", len);
+        req->on_token = on_token;
+        req->user = user;
+        {
+            std::lock_guard<std::mutex> lock(engine->mtx);
+            engine->queue.push_back(req);
+        }
+        engine->cv.notify_all();
+        return new commitgen_request{req};
+    } catch (const std::exception& e) {
+        last_error = e.what();
+        return nullptr;
+    }
+}
+
+commitgen_request* commitgen_submit(commitgen_engine* engine, const char* diff, size_t len) {
+    return commitgen_submit_stream(engine, diff, len, nullptr, nullptr);
+}
+
+commitgen_status commitgen_request_status(const commitgen_request* request) {
+    std::lock_guard<std::mutex> lock(request->state->mtx);
+    return request->state->status;
+}
+
+commitgen_status commitgen_request_wait(commitgen_request* request, int timeout_ms) {
+    Request& req = *request->state;
+    std::unique_lock<std::mutex> lock(req.mtx);
+    if (timeout_ms < 0)
+        req.cv.wait(lock, [&req] { return req.finished(); });
+    else
+        req.cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&req] { return req.finished(); });
+    return req.status;
+}
+
+size_t commitgen_request_read(commitgen_request* request, char* buf, size_t cap, int timeout_ms) {
+    Request& req = *request->state;
+    std::unique_lock<std::mutex> lock(req.mtx);
+    auto ready = [&req] { return !req.unread.empty() || req.finished(); };
+    if (timeout_ms < 0)
+        req.cv.wait(lock, ready);
+    else
+        req.cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+
+    size_t n = std::min(cap, req.unread.size());
+    req.unread.copy(buf, n);
+    req.unread.erase(0, n);
+    return n;
+}
+
+const char* commitgen_request_result(const commitgen_request* request) {
+    std::lock_guard<std::mutex> lock(request->state->mtx);
+    return request->state->status == COMMITGEN_DONE ? request->state->result.c_str() : nullptr;
+}
+
+const char* commitgen_request_error(const commitgen_request* request) {
+    std::lock_guard<std::mutex> lock(request->state->mtx);
+    return request->state->status == COMMITGEN_FAILED ? request->state->error.c_str() : nullptr;
+}
+
+void commitgen_request_cancel(commitgen_request* request) {
+    request->state->cancel = true;
+}
+
+void commitgen_request_free(commitgen_request* request) {
+    if (!request)
+        return;
+    request->state->cancel = true;
+    delete request;
+}
+
+}  // extern "C"
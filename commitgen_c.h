@@ -0,0 +1,97 @@
+/* commitgen_c.h - C API for generating commit messages in-process
+ *
+ * Links against libcommitgen_c. An engine owns a model and one generation
+ * thread; requests are queued FIFO and run one at a time. Every function is
+ * safe to call from any thread. Strings are UTF-8; returned pointers stay
+ * valid until the object they came from is freed.
+ *
+ *     commitgen_engine* engine = commitgen_engine_create("model.gguf");
+ *     commitgen_request* req = commitgen_submit(engine, diff, diff_len);
+ *     char buf[256];
+ *     size_t n;
+ *     while (commitgen_request_status(req) <= COMMITGEN_RUNNING) {
+ *         if ((n = commitgen_request_read(req, buf, sizeof(buf), 100)) > 0)
+ *             show(buf, n);
+ *     }
+ *     puts(commitgen_request_result(req));
+ *     commitgen_request_free(req);
+ *     commitgen_engine_free(engine);
+ */
+#ifndef COMMITGEN_C_H
+#define COMMITGEN_C_H
+
+#include <stddef.h>
+
+#define COMMITGEN_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped on incompatible changes; compare with commitgen_api_version() */
+#define COMMITGEN_API_VERSION 1
+
+typedef struct commitgen_engine commitgen_engine;
+typedef struct commitgen_request commitgen_request;
+
+typedef enum commitgen_status {
+    COMMITGEN_QUEUED = 0,
+    COMMITGEN_RUNNING = 1,
+    COMMITGEN_DONE = 2,
+    COMMITGEN_FAILED = 3,
+    COMMITGEN_CANCELLED = 4
+} commitgen_status;
+
+/* Called on the engine thread with each generated piece (not NUL-terminated).
+ * Return 0 to cancel the request. */
+typedef int (*commitgen_token_fn)(const char* piece, size_t len, void* user);
+
+COMMITGEN_API int commitgen_api_version(void);
+
+/* Why the last call on this thread returned NULL or -1 */
+COMMITGEN_API const char* commitgen_last_error(void);
+
+/* Starts loading the model in the background; "mock:<options>" selects the
+ * mock backend. Returns NULL if the model can't be opened at all. */
+COMMITGEN_API commitgen_engine* commitgen_engine_create(const char* model_path);
+
+/* 1 once loaded, 0 on timeout, -1 if loading failed. timeout_ms < 0 waits forever. */
+COMMITGEN_API int commitgen_engine_wait_ready(commitgen_engine* engine, int timeout_ms);
+
+/* Cancels queued and running requests, then frees the engine. Request handles
+ * stay valid until freed. */
+COMMITGEN_API void commitgen_engine_free(commitgen_engine* engine);
+
+/* Queues a diff; requests submitted before the model is loaded wait for it */
+COMMITGEN_API commitgen_request* commitgen_submit(commitgen_engine* engine, const char* diff, size_t len);
+
+/* Like commitgen_submit, but pieces go to on_token instead of commitgen_request_read */
+COMMITGEN_API commitgen_request* commitgen_submit_stream(commitgen_engine* engine, const char* diff, size_t len,
+                                                         commitgen_token_fn on_token, void* user);
+
+COMMITGEN_API commitgen_status commitgen_request_status(const commitgen_request* request);
+
+/* Waits until the request finishes; returns its status. timeout_ms < 0 waits forever. */
+COMMITGEN_API commitgen_status commitgen_request_wait(commitgen_request* request, int timeout_ms);
+
+/* Copies up to cap bytes of text generated since the last read, waiting up to
+ * timeout_ms for some. Returns 0 if there is none yet or the request is over. */
+COMMITGEN_API size_t commitgen_request_read(commitgen_request* request, char* buf, size_t cap, int timeout_ms);
+
+/* The cleaned-up message once COMMITGEN_DONE, otherwise NULL */
+COMMITGEN_API const char* commitgen_request_result(const commitgen_request* request);
+
+/* Reason for COMMITGEN_FAILED, otherwise NULL */
+COMMITGEN_API const char* commitgen_request_error(const commitgen_request* request);
+
+/* Stops the request at the next token; a no-op once it has finished */
+COMMITGEN_API void commitgen_request_cancel(commitgen_request* request);
+
+/* Cancels the request if it is still going and releases the handle */
+COMMITGEN_API void commitgen_request_free(commitgen_request* request);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMMITGEN_C_H */
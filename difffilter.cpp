@@ -0,0 +1,188 @@
+#include "difffilter.h"
+
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "text_util.h"
+
+namespace {
+
+const char* const BUILTIN_RULES[] = {
+    // Lockfiles
+    "package-lock.json", "npm-shrinkwrap.json", "yarn.lock", "pnpm-lock.yaml", "*.lock", "go.sum",
+    // Generated and minified
+    "*.min.js", "*.min.css", "*.map", "*.pb.go", "*.pb.h", "*.pb.cc", "*_pb2.py", "*_pb2_grpc.py",
+    // Vendored
+    "vendor/", "node_modules/",
+};
+
+// Value of a "<name> <bytes>" threshold line
+bool parse_threshold(const std::string& line, const char* name, size_t& value) {
+    size_t len = std::strlen(name);
+    if (line.compare(0, len, name) != 0 || line.size() <= len || (line[len] != ' ' && line[len] != '\t'))
+        return false;
+    const char* p = line.c_str() + len;
+    char* end;
+    unsigned long long n = std::strtoull(p, &end, 10);
+    if (end == p || *end != '\0')
+        return false;
+    value = n;
+    return true;
+}
+
+bool is_dir(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+}  // namespace
+
+DiffFilter::DiffFilter() {
+    for (const char* rule : BUILTIN_RULES) {
+        add_rule(rule);
+    }
+}
+
+DiffFilter DiffFilter::load(const std::string& dir) {
+    DiffFilter filter;
+    // Walk up to the directory holding .git, as git does from a subdirectory
+    std::string top = dir;
+    while (top.size() > 1 && top.back() == '/') {
+        top.pop_back();
+    }
+    while (!exists(top + "/.git")) {
+        size_t slash = top.rfind('/');
+        if (slash == std::string::npos || top.size() <= 1)
+            return filter;
+        top.erase(slash == 0 ? 1 : slash);
+    }
+    std::string path = (top == "/" ? "" : top) + "/.commitgenignore";
+    if (is_dir(path))
+        return filter;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        filter.add_rule(line);
+    }
+    return filter;
+}
+
+void DiffFilter::add_rule(const std::string& text) {
+    std::string line = text;
+    trim_right(line, " \t\r");
+    if (line.empty() || line[0] == '#')
+        return;
+    if (parse_threshold(line, "max-line-bytes", max_line_bytes)
+        || parse_threshold(line, "max-file-bytes", max_file_bytes))
+        return;
+
+    Pattern pattern;
+    if (line[0] == '!') {
+        pattern.negated = true;
+        line.erase(0, 1);
+    }
+    if (!line.empty() && line.back() == '/') {
+        pattern.directory = true;
+        line.pop_back();
+    }
+    if (!line.empty() && line[0] == '/')
+        line.erase(0, 1);  // rules are always relative to the top
+    if (line.empty())
+        return;
+    pattern.has_slash = line.find('/') != std::string::npos;
+    pattern.glob = std::move(line);
+    patterns.push_back(std::move(pattern));
+}
+
+int DiffFilter::match(const std::string& path) const {
+    for (auto it = patterns.rbegin(); it != patterns.rend(); ++it) {
+        const Pattern& p = *it;
+        bool matched = false;
+        if (p.directory) {
+            // Each parent directory, as a path prefix ("a/b") or a single name ("b")
+            size_t begin = 0;
+            for (size_t slash = path.find('/'); slash != std::string::npos && !matched;
+                 slash = path.find('/', slash + 1)) {
+                std::string dir = p.has_slash ? path.substr(0, slash) : path.substr(begin, slash - begin);
+                matched = fnmatch(p.glob.c_str(), dir.c_str(), 0) == 0;
+                begin = slash + 1;
+            }
+        } else {
+            size_t slash = path.rfind('/');
+            const char* name = p.has_slash || slash == std::string::npos ? path.c_str() : path.c_str() + slash + 1;
+            matched = fnmatch(p.glob.c_str(), name, 0) == 0;
+        }
+        if (matched)
+            return p.negated ? -1 : 1;
+    }
+    return 0;
+}
+
+bool DiffFilter::skips(const FileDiff& file) const {
+    if (file.binary)
+        return true;
+    int rule = match(file.path);
+    if (rule != 0)
+        return rule > 0;
+
+    size_t bytes = 0;
+    for (const auto& hunk : file.hunks) {
+        bytes += hunk.size();
+        // NUL bytes mean binary content diffed as text (--text, or no attributes)
+        if (std::memchr(hunk.data(), '\0', hunk.size()))
+            return true;
+        if (max_line_bytes == 0)
+            continue;
+        // Minified code: one changed line far longer than anyone writes by hand
+        const char* p = hunk.data();
+        const char* end = p + hunk.size();
+        while (p < end) {
+            const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            const char* next = nl ? nl + 1 : end;
+            if (static_cast<size_t>(next - p) > max_line_bytes + 2 && (*p == '+' || *p == '-'))
+                return true;
+            p = next;
+        }
+    }
+    return max_file_bytes != 0 && bytes > max_file_bytes;
+}
+
+std::string DiffFilter::apply(const std::string& diff) const {
+    std::vector<FileDiff> files = split_diff(diff);
+    std::vector<bool> skipped(files.size());
+    bool any = false;
+    for (size_t i = 0; i < files.size(); i++) {
+        skipped[i] = !files[i].path.empty() && skips(files[i]);
+        any |= skipped[i];
+    }
+    if (!any)
+        return diff;
+
+    // "diff" in the heading keeps an all-skipped diff recognizable as one
+    std::string out = "Files not shown in this diff:\n";
+    for (size_t i = 0; i < files.size(); i++) {
+        if (skipped[i])
+            out += file_stat(files[i]) + "\n";
+    }
+    out += "\n";
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!skipped[i])
+            out += files[i].text();
+    }
+    return out;
+}
+
+std::string file_stat(const FileDiff& file) {
+    if (file.binary)
+        return file.path + ": binary";
+    return file.path + ": +" + std::to_string(file.added) + " -" + std::to_string(file.removed);
+}
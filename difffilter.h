@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "diffsplit.h"
+
+// Leaves lockfiles, vendored and generated code, minified assets and binaries
+// out of a diff before it reaches the model, keeping one stat line per file
+// ("package-lock.json: +812 -640") so the message can still mention them.
+//
+// Rules come from a built-in list plus the repository's .commitgenignore, one
+// per line, later lines winning:
+//
+//   # comment
+//   *.lock              glob on the file name (or the whole path if it has a /)
+//   vendor/             everything under a directory of that name
+//   !Cargo.lock         keep a file an earlier rule or threshold would drop
+//                       (binaries are always dropped)
+//   max-line-bytes 1000 drop files that change a line longer than this (0 = off)
+//   max-file-bytes 65536  drop files whose hunks are larger than this (0 = off)
+class DiffFilter {
+public:
+    DiffFilter();  // built-in rules only
+
+    // Built-in rules plus the .commitgenignore at the top of the work tree
+    // holding `dir`; a missing or unreadable file adds nothing
+    static DiffFilter load(const std::string& dir);
+
+    void add_rule(const std::string& line);
+
+    bool skips(const FileDiff& file) const;
+
+    // `diff` with skipped files moved into a stat block at the top; returned
+    // unchanged when nothing is skipped
+    std::string apply(const std::string& diff) const;
+
+private:
+    struct Pattern {
+        std::string glob;
+        bool negated = false;
+        bool directory = false;  // "name/": matches any parent directory
+        bool has_slash = false;  // matched against the whole path
+    };
+
+    // Last matching pattern: 1 skip, -1 keep, 0 none
+    int match(const std::string& path) const;
+
+    std::vector<Pattern> patterns;
+    size_t max_line_bytes = 1000;
+    size_t max_file_bytes = 65536;
+};
+
+// "path: +12 -3", or "path: binary"
+std::string file_stat(const FileDiff& file);
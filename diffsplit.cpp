@@ -0,0 +1,136 @@
+#include "diffsplit.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+namespace {
+
+bool starts_with(std::string_view line, std::string_view prefix) {
+    return line.substr(0, prefix.size()) == prefix;
+}
+
+// "@@ -a,b +c,d @@": b and c default to 1 when the count is left out
+bool parse_hunk_counts(std::string_view line, long& old_lines, long& new_lines) {
+    std::string text(line.substr(0, 96));
+    const char* p = std::strchr(text.c_str(), '-');
+    if (!p)
+        return false;
+    char* end;
+    std::strtol(p + 1, &end, 10);
+    old_lines = *end == ',' ? std::strtol(end + 1, &end, 10) : 1;
+    p = std::strchr(end, '+');
+    if (!p)
+        return false;
+    std::strtol(p + 1, &end, 10);
+    new_lines = *end == ',' ? std::strtol(end + 1, &end, 10) : 1;
+    return true;
+}
+
+// Path from a "--- a/x" or "+++ b/x" line; empty for /dev/null
+std::string marker_path(std::string_view line) {
+    std::string_view path = line.substr(4);
+    path = path.substr(0, path.find('\t'));
+    while (!path.empty() && (path.back() == '\n' || path.back() == '\r')) {
+        path.remove_suffix(1);
+    }
+    if (path == "/dev/null")
+        return "";
+    if (starts_with(path, "a/") || starts_with(path, "b/"))
+        path.remove_prefix(2);
+    return std::string(path);
+}
+
+// Path from "diff --git a/x b/y", for files without ---/+++ lines (binary, mode-only)
+std::string git_header_path(std::string_view line) {
+    size_t b = line.rfind(" b/");
+    if (b == std::string_view::npos)
+        return "";
+    std::string_view path = line.substr(b + 3);
+    while (!path.empty() && (path.back() == '\n' || path.back() == '\r')) {
+        path.remove_suffix(1);
+    }
+    return std::string(path);
+}
+
+}  // namespace
+
+std::string FileDiff::text() const {
+    std::string out = header;
+    for (const auto& hunk : hunks) {
+        out += hunk;
+    }
+    return out;
+}
+
+std::string FileDiff::hunk_text(size_t i) const {
+    return header + hunks.at(i);
+}
+
+std::vector<FileDiff> split_diff(const std::string& diff) {
+    std::vector<FileDiff> files;
+    long old_left = 0;
+    long new_left = 0;
+    bool in_hunk = false;
+    std::string old_path;
+
+    const char* p = diff.data();
+    const char* end = p + diff.size();
+    while (p < end) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* next = nl ? nl + 1 : end;
+        std::string_view line(p, next - p);
+        p = next;
+
+        if (in_hunk && (old_left > 0 || new_left > 0)) {
+            // Some tools strip the space from empty context lines
+            char c = line[0] == '\n' ? ' ' : line[0];
+            if (c == ' ' || c == '-' || c == '+' || c == '\\') {
+                old_left -= c == ' ' || c == '-';
+                new_left -= c == ' ' || c == '+';
+                files.back().added += c == '+';
+                files.back().removed += c == '-';
+                files.back().hunks.back().append(line);
+                continue;
+            }
+            in_hunk = false;  // truncated hunk; read on as headers
+        }
+
+        if (in_hunk && line[0] == '\\') {
+            files.back().hunks.back().append(line);  // "\ No newline" after the last line
+            continue;
+        }
+        in_hunk = false;
+
+        bool new_file = starts_with(line, "diff ") || files.empty()
+                        || (starts_with(line, "--- ") && !files.back().hunks.empty());
+        if (new_file) {
+            files.emplace_back();
+            old_path.clear();
+            if (starts_with(line, "diff --git "))
+                files.back().path = git_header_path(line);
+        }
+        FileDiff& file = files.back();
+
+        if (starts_with(line, "@@ ") && parse_hunk_counts(line, old_left, new_left)) {
+            file.hunks.emplace_back(line);
+            in_hunk = true;
+            continue;
+        }
+        if (!file.hunks.empty()) {
+            file.hunks.back().append(line);  // stray text after a hunk
+            continue;
+        }
+
+        file.header.append(line);
+        if (starts_with(line, "--- ")) {
+            old_path = marker_path(line);
+        } else if (starts_with(line, "+++ ")) {
+            std::string path = marker_path(line);
+            file.path = path.empty() ? old_path : path;
+        } else if (starts_with(line, "Binary files ") || starts_with(line, "GIT binary patch")) {
+            file.binary = true;
+        }
+    }
+    return files;
+}
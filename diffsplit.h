@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Splits `git diff` output (or any unified diff) into files and hunks, going
+// by each hunk's line counts so content that looks like a header stays put
+
+// One file's part of a diff
+struct FileDiff {
+    std::string path;                // new name, or the old one for deletions
+    std::string header;              // "diff --git" up to the first hunk
+    std::vector<std::string> hunks;  // each starts with its "@@" line
+    size_t added = 0;
+    size_t removed = 0;
+    bool binary = false;
+
+    // The file's diff on its own, or with a single hunk
+    std::string text() const;
+    std::string hunk_text(size_t i) const;
+};
+
+std::vector<FileDiff> split_diff(const std::string& diff);
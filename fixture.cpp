@@ -0,0 +1,408 @@
+// fixture.cpp - Writes a tiny, randomly initialized llama GGUF for offline tests
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// ANSI color codes
+namespace Color {
+const std::string RESET = "\033[0m";
+const std::string RED = "\033[31m";
+const std::string GREEN = "\033[32m";
+const std::string CYAN = "\033[36m";
+const std::string BOLD = "\033[1m";
+}  // namespace Color
+
+void print_status(const std::string& msg) {
+    std::cerr << Color::CYAN << "[" << Color::RESET << "•" << Color::CYAN << "] " << Color::RESET << msg << std::endl;
+}
+
+void print_success(const std::string& msg) {
+    std::cerr << Color::GREEN << "[✓] " << Color::RESET << msg << std::endl;
+}
+
+void print_error(const std::string& msg) {
+    std::cerr << Color::RED << "[✗] " << Color::RESET << msg << std::endl;
+}
+
+// The defaults give a ~2 MB model that llama.cpp loads and runs like any other
+// llama checkpoint; the output is noise, but tokenize, prefill, KV cache ops and
+// sampling all take the real code path
+struct Options {
+    std::string output_file = "tiny.gguf";
+    uint32_t layers = 4;
+    uint32_t embd = 128;
+    uint32_t ff = 384;
+    uint32_t heads = 4;
+    uint32_t kv_heads = 2;
+    uint32_t ctx = 4096;
+    uint64_t seed = 42;
+};
+
+// --------------------
+// GGUF v3 writer
+// --------------------
+namespace gguf {
+
+constexpr uint32_t MAGIC = 0x46554747;  // "GGUF"
+constexpr uint32_t VERSION = 3;
+constexpr uint64_t ALIGNMENT = 32;
+
+enum ValueType : uint32_t { UINT32 = 4, INT32 = 5, FLOAT32 = 6, BOOL = 7, STRING = 8, ARRAY = 9 };
+enum TensorType : uint32_t { F32 = 0, F16 = 1 };
+
+// Token types from llama.cpp's vocab
+enum TokenType : int32_t { NORMAL = 1, UNKNOWN = 2, CONTROL = 3, BYTE = 6 };
+
+class Buffer {
+public:
+    template <typename T>
+    void put(T value) {
+        const char* p = reinterpret_cast<const char*>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    void put_string(const std::string& s) {
+        put<uint64_t>(s.size());
+        bytes.insert(bytes.end(), s.begin(), s.end());
+    }
+
+    void pad() {
+        while (bytes.size() % ALIGNMENT)
+            bytes.push_back(0);
+    }
+
+    std::vector<char> bytes;
+};
+
+struct Tensor {
+    std::string name;
+    std::vector<uint64_t> dims;  // innermost first
+    TensorType type;
+    std::vector<char> data;
+};
+
+class Writer {
+public:
+    void kv_u32(const std::string& key, uint32_t v) { key_header(key, UINT32).put(v); }
+    void kv_i32(const std::string& key, int32_t v) { key_header(key, INT32).put(v); }
+    void kv_f32(const std::string& key, float v) { key_header(key, FLOAT32).put(v); }
+    void kv_bool(const std::string& key, bool v) { key_header(key, BOOL).put<uint8_t>(v); }
+    void kv_string(const std::string& key, const std::string& v) { key_header(key, STRING).put_string(v); }
+
+    void kv_strings(const std::string& key, const std::vector<std::string>& v) {
+        array_header(key, STRING, v.size());
+        for (const auto& s : v)
+            kv.put_string(s);
+    }
+
+    void kv_f32s(const std::string& key, const std::vector<float>& v) {
+        array_header(key, FLOAT32, v.size());
+        for (float f : v)
+            kv.put(f);
+    }
+
+    void kv_i32s(const std::string& key, const std::vector<int32_t>& v) {
+        array_header(key, INT32, v.size());
+        for (int32_t i : v)
+            kv.put(i);
+    }
+
+    void add_tensor(Tensor t) { tensors.push_back(std::move(t)); }
+
+    // Returns the file size
+    size_t write(const std::string& path) {
+        Buffer head;
+        head.put(MAGIC);
+        head.put(VERSION);
+        head.put<uint64_t>(tensors.size());
+        head.put<uint64_t>(kv_count);
+        head.bytes.insert(head.bytes.end(), kv.bytes.begin(), kv.bytes.end());
+
+        uint64_t offset = 0;
+        for (const auto& t : tensors) {
+            head.put_string(t.name);
+            head.put<uint32_t>(t.dims.size());
+            for (uint64_t d : t.dims)
+                head.put(d);
+            head.put<uint32_t>(t.type);
+            head.put(offset);
+            offset += (t.data.size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+        head.pad();
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("Cannot write " + path);
+        out.write(head.bytes.data(), head.bytes.size());
+        static const char zeros[ALIGNMENT] = {};
+        for (const auto& t : tensors) {
+            out.write(t.data.data(), t.data.size());
+            out.write(zeros, (ALIGNMENT - t.data.size() % ALIGNMENT) % ALIGNMENT);
+        }
+        if (!out.flush())
+            throw std::runtime_error("Write failed: " + path);
+        return head.bytes.size() + offset;
+    }
+
+private:
+    Buffer& key_header(const std::string& key, ValueType type) {
+        kv_count++;
+        kv.put_string(key);
+        kv.put<uint32_t>(type);
+        return kv;
+    }
+
+    void array_header(const std::string& key, ValueType type, size_t n) {
+        key_header(key, ARRAY);
+        kv.put<uint32_t>(type);
+        kv.put<uint64_t>(n);
+    }
+
+    Buffer kv;
+    uint64_t kv_count = 0;
+    std::vector<Tensor> tensors;
+};
+
+}  // namespace gguf
+
+// IEEE half, round to nearest even
+uint16_t to_half(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    int32_t exp = (int32_t)((x >> 23) & 0xFF) - 127 + 15;
+    uint32_t mant = x & 0x7FFFFF;
+    if (exp >= 31)
+        return sign | 0x7C00;
+    if (exp <= 0) {
+        if (exp < -10)
+            return sign;
+        mant |= 0x800000;
+        uint32_t shift = 14 - exp;
+        uint32_t half = mant >> shift;
+        uint32_t rest = mant & ((1u << shift) - 1);
+        uint32_t mid = 1u << (shift - 1);
+        if (rest > mid || (rest == mid && (half & 1)))
+            half++;
+        return sign | half;
+    }
+    uint32_t half = ((uint32_t)exp << 10) | (mant >> 13);
+    uint32_t rest = mant & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return sign | half;
+}
+
+// Uniform with the given standard deviation, from raw generator bits so the
+// file is identical across standard libraries
+class Init {
+public:
+    explicit Init(uint64_t seed) : rng(seed) {}
+
+    gguf::Tensor matrix(const std::string& name, uint64_t cols, uint64_t rows, float stddev) {
+        gguf::Tensor t{name, {cols, rows}, gguf::F16, {}};
+        t.data.resize(cols * rows * sizeof(uint16_t));
+        uint16_t* out = reinterpret_cast<uint16_t*>(t.data.data());
+        float range = stddev * std::sqrt(3.0f);
+        for (uint64_t i = 0; i < cols * rows; i++) {
+            float u = (float)((rng() >> 11) * (1.0 / 9007199254740992.0));
+            out[i] = to_half((2 * u - 1) * range);
+        }
+        return t;
+    }
+
+    static gguf::Tensor ones(const std::string& name, uint64_t n) {
+        gguf::Tensor t{name, {n}, gguf::F32, {}};
+        t.data.resize(n * sizeof(float));
+        std::vector<float> values(n, 1.0f);
+        std::memcpy(t.data.data(), values.data(), t.data.size());
+        return t;
+    }
+
+private:
+    std::mt19937_64 rng;
+};
+
+// SentencePiece-style vocab: specials, byte fallback for anything else, the
+// chat template markers, then printable characters and common words. Earlier
+// pieces score higher so merges prefer them.
+struct Vocab {
+    std::vector<std::string> tokens;
+    std::vector<float> scores;
+    std::vector<int32_t> types;
+
+    void add(const std::string& piece, gguf::TokenType type) {
+        tokens.push_back(piece);
+        types.push_back(type);
+        scores.push_back(type == gguf::NORMAL ? -(float)tokens.size() : 0.0f);
+    }
+};
+
+Vocab make_vocab() {
+    const std::string SPACE = "\xE2\x96\x81";  // U+2581, SentencePiece's word boundary
+    const char* WORDS[] = {
+        "the",    "a",       "to",     "of",     "and",      "in",      "is",     "for",    "with",   "on",
+        "that",   "this",    "it",     "be",     "as",       "by",      "from",   "at",     "or",     "an",
+        "not",    "are",     "now",    "when",   "if",       "return",  "const",  "int",    "void",   "auto",
+        "std",    "string",  "size",   "include", "struct",  "class",   "static", "bool",   "true",   "false",
+        "new",    "add",     "fix",    "update", "remove",   "use",     "make",   "move",   "change", "support",
+        "server", "client",  "request", "queue", "cache",    "diff",    "commit", "message", "model", "token",
+        "file",   "files",   "error",  "test",   "build",    "config",  "option", "default", "value", "result",
+        "git",    "socket",  "thread", "lock",   "read",     "write",   "data",   "path",   "name",   "list",
+        "Add",    "Fix",     "Update", "Remove", "Use",      "Make",    "Move",   "The",    "This",   "When",
+    };
+    const char* FRAGMENTS[] = {"++", "--", "+++", "---", "@@", "::", "->", "==", "!=", "//", "  ", "    ", "();",
+                               "er", "ed",  "ing", "ion", "es", "re", "on", "at", "en", "st", "nd", "th", "an"};
+
+    Vocab v;
+    v.add("<unk>", gguf::UNKNOWN);
+    v.add("<s>", gguf::CONTROL);
+    v.add("</s>", gguf::CONTROL);
+    for (int b = 0; b < 256; b++) {
+        char piece[8];
+        std::snprintf(piece, sizeof(piece), "<0x%02X>", b);
+        v.add(piece, gguf::BYTE);
+    }
+    v.add("<|im_start|>", gguf::CONTROL);
+    v.add("<|im_end|>", gguf::CONTROL);
+
+    std::set<std::string> seen(v.tokens.begin(), v.tokens.end());
+    auto add_normal = [&](const std::string& piece) {
+        if (seen.insert(piece).second)
+            v.add(piece, gguf::NORMAL);
+    };
+    add_normal(SPACE);
+    for (char c = '!'; c <= '~'; c++) {
+        add_normal(std::string(1, c));
+    }
+    for (const char* w : WORDS) {
+        add_normal(SPACE + w);
+        add_normal(w);
+    }
+    for (const char* f : FRAGMENTS) {
+        add_normal(f);
+    }
+    return v;
+}
+
+void show_usage(const std::string& prog_name) {
+    std::cout << Color::BOLD << "USAGE:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " [options]\n\n";
+    std::cout << Color::BOLD << "OPTIONS:" << Color::RESET << "\n";
+    std::cout << "  --out <file>          Output path (default tiny.gguf)\n";
+    std::cout << "  --layers <n>          Transformer blocks (default 4)\n";
+    std::cout << "  --embd <n>            Embedding width (default 128)\n";
+    std::cout << "  --ff <n>              Feed-forward width (default 384)\n";
+    std::cout << "  --heads <n>           Attention heads (default 4)\n";
+    std::cout << "  --kv-heads <n>        KV heads (default 2)\n";
+    std::cout << "  --ctx <n>             Trained context length (default 4096)\n";
+    std::cout << "  --seed <n>            Weight initialization seed (default 42)\n\n";
+    std::cout << "The same options always produce a byte-identical file.\n\n";
+    std::cout << Color::BOLD << "EXAMPLES:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " --out build/tiny.gguf\n";
+    std::cout << "  commitgen-bench build/tiny.gguf bench/corpus\n";
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto number = [&]() { return (uint32_t)std::max(1L, std::atol(argv[++i])); };
+        if (arg == "-h" || arg == "--help") {
+            show_usage(argv[0]);
+            return 0;
+        } else if (arg == "--out" && i + 1 < argc) {
+            opts.output_file = argv[++i];
+        } else if (arg == "--layers" && i + 1 < argc) {
+            opts.layers = number();
+        } else if (arg == "--embd" && i + 1 < argc) {
+            opts.embd = number();
+        } else if (arg == "--ff" && i + 1 < argc) {
+            opts.ff = number();
+        } else if (arg == "--heads" && i + 1 < argc) {
+            opts.heads = number();
+        } else if (arg == "--kv-heads" && i + 1 < argc) {
+            opts.kv_heads = number();
+        } else if (arg == "--ctx" && i + 1 < argc) {
+            opts.ctx = number();
+        } else if (arg == "--seed" && i + 1 < argc) {
+            opts.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            print_error("Unknown option: " + arg);
+            return 1;
+        }
+    }
+    if (opts.embd % opts.heads != 0 || opts.heads % opts.kv_heads != 0 || (opts.embd / opts.heads) % 2 != 0) {
+        print_error("--embd must split into heads of even size, and --heads must be a multiple of --kv-heads");
+        return 1;
+    }
+
+    try {
+        Vocab vocab = make_vocab();
+        const uint32_t head_dim = opts.embd / opts.heads;
+        const uint32_t kv_dim = head_dim * opts.kv_heads;
+        const uint64_t n_vocab = vocab.tokens.size();
+
+        gguf::Writer w;
+        w.kv_string("general.architecture", "llama");
+        w.kv_string("general.name", "commitgen-tiny");
+        w.kv_u32("general.alignment", (uint32_t)gguf::ALIGNMENT);
+        w.kv_u32("general.file_type", 1);  // mostly F16
+        w.kv_u32("llama.context_length", opts.ctx);
+        w.kv_u32("llama.embedding_length", opts.embd);
+        w.kv_u32("llama.block_count", opts.layers);
+        w.kv_u32("llama.feed_forward_length", opts.ff);
+        w.kv_u32("llama.attention.head_count", opts.heads);
+        w.kv_u32("llama.attention.head_count_kv", opts.kv_heads);
+        w.kv_u32("llama.rope.dimension_count", head_dim);
+        w.kv_f32("llama.rope.freq_base", 10000.0f);
+        w.kv_f32("llama.attention.layer_norm_rms_epsilon", 1e-5f);
+        w.kv_u32("llama.vocab_size", (uint32_t)n_vocab);
+
+        w.kv_string("tokenizer.ggml.model", "llama");
+        w.kv_strings("tokenizer.ggml.tokens", vocab.tokens);
+        w.kv_f32s("tokenizer.ggml.scores", vocab.scores);
+        w.kv_i32s("tokenizer.ggml.token_type", vocab.types);
+        w.kv_u32("tokenizer.ggml.unknown_token_id", 0);
+        w.kv_u32("tokenizer.ggml.bos_token_id", 1);
+        w.kv_u32("tokenizer.ggml.eos_token_id", 2);
+        w.kv_bool("tokenizer.ggml.add_bos_token", true);
+        w.kv_bool("tokenizer.ggml.add_eos_token", false);
+
+        print_status("Initializing " + std::to_string(opts.layers) + " layers, vocab " + std::to_string(n_vocab));
+        Init init(opts.seed);
+        w.add_tensor(init.matrix("token_embd.weight", opts.embd, n_vocab, 0.02f));
+        for (uint32_t l = 0; l < opts.layers; l++) {
+            std::string blk = "blk." + std::to_string(l) + ".";
+            w.add_tensor(Init::ones(blk + "attn_norm.weight", opts.embd));
+            w.add_tensor(init.matrix(blk + "attn_q.weight", opts.embd, opts.embd, 0.02f));
+            w.add_tensor(init.matrix(blk + "attn_k.weight", opts.embd, kv_dim, 0.02f));
+            w.add_tensor(init.matrix(blk + "attn_v.weight", opts.embd, kv_dim, 0.02f));
+            w.add_tensor(init.matrix(blk + "attn_output.weight", opts.embd, opts.embd, 0.02f));
+            w.add_tensor(Init::ones(blk + "ffn_norm.weight", opts.embd));
+            w.add_tensor(init.matrix(blk + "ffn_gate.weight", opts.embd, opts.ff, 0.02f));
+            w.add_tensor(init.matrix(blk + "ffn_down.weight", opts.ff, opts.embd, 0.02f));
+            w.add_tensor(init.matrix(blk + "ffn_up.weight", opts.embd, opts.ff, 0.02f));
+        }
+        w.add_tensor(Init::ones("output_norm.weight", opts.embd));
+        w.add_tensor(init.matrix("output.weight", opts.embd, n_vocab, 0.02f));
+
+        size_t bytes = w.write(opts.output_file);
+        char size[32];
+        std::snprintf(size, sizeof(size), "%.1f MB", bytes / 1e6);
+        print_success("Wrote " + opts.output_file + " (" + size + ")");
+    } catch (const std::exception& e) {
+        print_error(e.what());
+        return 1;
+    }
+    return 0;
+}
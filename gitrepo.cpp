@@ -0,0 +1,990 @@
+#include "gitrepo.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "linediff.h"
+
+namespace {
+
+constexpr uint32_t MODE_TREE = 040000;
+constexpr uint32_t MODE_FILE = 0100644;
+constexpr uint32_t MODE_EXEC = 0100755;
+constexpr uint32_t MODE_LINK = 0120000;
+constexpr uint32_t MODE_GITLINK = 0160000;
+
+constexpr int MAX_DELTA_DEPTH = 4096;
+constexpr size_t BASE_CACHE_BYTES = 32 << 20;
+
+enum ObjectType { OBJ_COMMIT = 1, OBJ_TREE = 2, OBJ_BLOB = 3, OBJ_TAG = 4, OBJ_OFS_DELTA = 6, OBJ_REF_DELTA = 7 };
+
+// ---- SHA-1, for hashing work-tree files the way git stores them ----
+class Sha1 {
+public:
+    void update(const void* data, size_t len) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        length += len;
+        while (len > 0) {
+            size_t n = std::min(len, sizeof(block) - used);
+            std::memcpy(block + used, p, n);
+            used += n;
+            p += n;
+            len -= n;
+            if (used == sizeof(block)) {
+                process(block);
+                used = 0;
+            }
+        }
+    }
+
+    ObjectId finish() {
+        uint64_t bits = length * 8;
+        unsigned char pad = 0x80;
+        update(&pad, 1);
+        unsigned char zero = 0;
+        while (used != 56) {
+            update(&zero, 1);
+        }
+        unsigned char len_be[8];
+        for (int i = 0; i < 8; i++) {
+            len_be[i] = (unsigned char)(bits >> (56 - 8 * i));
+        }
+        update(len_be, 8);
+
+        ObjectId id;
+        for (int i = 0; i < 20; i++) {
+            id[i] = (unsigned char)(h[i / 4] >> (24 - 8 * (i % 4)));
+        }
+        return id;
+    }
+
+private:
+    static uint32_t rol(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+    void process(const unsigned char* p) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    uint64_t length = 0;
+    unsigned char block[64];
+    size_t used = 0;
+};
+
+ObjectId hash_blob(const std::string& content) {
+    Sha1 sha;
+    std::string header = "blob " + std::to_string(content.size());
+    sha.update(header.data(), header.size() + 1);  // with the NUL
+    sha.update(content.data(), content.size());
+    return sha.finish();
+}
+
+const ObjectId NULL_ID{};
+
+bool parse_hex(const char* hex, ObjectId& id) {
+    for (int i = 0; i < 20; i++) {
+        unsigned v;
+        if (std::sscanf(hex + 2 * i, "%2x", &v) != 1)
+            return false;
+        id[i] = (unsigned char)v;
+    }
+    return true;
+}
+
+uint32_t be32(const unsigned char* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+uint16_t be16(const unsigned char* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+std::string read_file(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw GitError("Cannot read " + path + ": " + std::strerror(errno));
+    std::string data;
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            int err = errno;
+            close(fd);
+            throw GitError("Cannot read " + path + ": " + std::strerror(err));
+        }
+        data.append(buf, n);
+    }
+    close(fd);
+    return data;
+}
+
+// Missing is an answer; anything else (EACCES for a caller who cannot read
+// the repository) is an error
+bool file_exists(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0)
+        return true;
+    if (errno == ENOENT || errno == ENOTDIR)
+        return false;
+    throw GitError("Cannot read " + path + ": " + std::strerror(errno));
+}
+
+std::string first_line(const std::string& text) {
+    return text.substr(0, text.find('\n'));
+}
+
+std::string join_path(const std::string& dir, const std::string& path) {
+    return !path.empty() && path[0] == '/' ? path : dir + "/" + path;
+}
+
+// zlib stream into a buffer; `expected` is a size hint, or exact for pack entries
+std::string inflate_all(const unsigned char* data, size_t size, size_t expected, size_t* consumed = nullptr) {
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK)
+        throw GitError("zlib init failed");
+
+    std::string out(expected > 0 ? expected : 4096, '\0');
+    zs.next_in = const_cast<unsigned char*>(data);
+    zs.avail_in = (uInt)std::min<size_t>(size, UINT32_MAX);
+    int rc;
+    do {
+        if (zs.total_out == out.size())
+            out.resize(out.size() * 2 + 1);
+        zs.next_out = reinterpret_cast<unsigned char*>(&out[zs.total_out]);
+        zs.avail_out = (uInt)(out.size() - zs.total_out);
+        rc = inflate(&zs, Z_NO_FLUSH);
+    } while (rc == Z_OK);
+    size_t total = zs.total_out;
+    if (consumed)
+        *consumed = zs.total_in;
+    inflateEnd(&zs);
+    if (rc != Z_STREAM_END)
+        throw GitError("Corrupt object data");
+    out.resize(total);
+    return out;
+}
+
+size_t delta_varint(const std::string& delta, size_t& pos) {
+    size_t value = 0;
+    int shift = 0;
+    unsigned char c;
+    do {
+        if (pos >= delta.size())
+            throw GitError("Truncated delta");
+        c = delta[pos++];
+        value |= (size_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return value;
+}
+
+std::string apply_delta(const std::string& base, const std::string& delta) {
+    size_t pos = 0;
+    if (delta_varint(delta, pos) != base.size())
+        throw GitError("Delta does not match its base");
+    std::string out;
+    out.reserve(delta_varint(delta, pos));
+
+    while (pos < delta.size()) {
+        unsigned char op = delta[pos++];
+        if (op & 0x80) {
+            size_t offset = 0, len = 0;
+            for (int i = 0; i < 4; i++) {
+                if (op & (1 << i))
+                    offset |= (size_t)(unsigned char)delta.at(pos++) << (8 * i);
+            }
+            for (int i = 0; i < 3; i++) {
+                if (op & (0x10 << i))
+                    len |= (size_t)(unsigned char)delta.at(pos++) << (8 * i);
+            }
+            if (len == 0)
+                len = 0x10000;
+            if (offset + len > base.size())
+                throw GitError("Delta copies past its base");
+            out.append(base, offset, len);
+        } else if (op) {
+            if (pos + op > delta.size())
+                throw GitError("Truncated delta");
+            out.append(delta, pos, op);
+            pos += op;
+        } else {
+            throw GitError("Invalid delta opcode");
+        }
+    }
+    return out;
+}
+
+std::string mode_string(uint32_t mode) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%06o", mode);
+    return buf;
+}
+
+// One pack: the .idx is read into memory, the .pack is mapped
+struct Pack {
+    std::string name;
+    std::string idx;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    uint32_t count = 0;
+
+    ~Pack() {
+        if (data)
+            munmap(const_cast<unsigned char*>(data), size);
+    }
+
+    const unsigned char* ids() const { return reinterpret_cast<const unsigned char*>(idx.data()) + 8 + 1024; }
+
+    bool find(const ObjectId& id, uint64_t& offset) const {
+        const unsigned char* fanout = reinterpret_cast<const unsigned char*>(idx.data()) + 8;
+        uint32_t lo = id[0] == 0 ? 0 : be32(fanout + 4 * (id[0] - 1));
+        uint32_t hi = be32(fanout + 4 * id[0]);
+        const unsigned char* table = ids();
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = std::memcmp(table + 20 * (size_t)mid, id.data(), 20);
+            if (cmp == 0) {
+                const unsigned char* off32 = table + 24 * (size_t)count;
+                uint32_t small = be32(off32 + 4 * (size_t)mid);
+                if (small & 0x80000000u) {
+                    const unsigned char* off64 = off32 + 4 * (size_t)count + 8 * (size_t)(small & 0x7fffffffu);
+                    if (off64 + 8 > reinterpret_cast<const unsigned char*>(idx.data()) + idx.size())
+                        throw GitError("Corrupt pack index " + name);
+                    offset = (uint64_t)be32(off64) << 32 | be32(off64 + 4);
+                } else {
+                    offset = small;
+                }
+                return true;
+            }
+            if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return false;
+    }
+};
+
+std::unique_ptr<Pack> open_pack(const std::string& idx_path) {
+    auto pack = std::make_unique<Pack>();
+    pack->name = idx_path;
+    pack->idx = read_file(idx_path);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(pack->idx.data());
+    if (pack->idx.size() < 8 + 1024 || be32(p) != 0xff744f63)
+        throw GitUnsupported("Unsupported pack index version: " + idx_path);
+    if (be32(p + 4) != 2)
+        throw GitUnsupported("Unsupported pack index version: " + idx_path);
+    pack->count = be32(p + 8 + 4 * 255);
+    if (pack->idx.size() < 8 + 1024 + 28 * (size_t)pack->count)
+        throw GitError("Corrupt pack index " + idx_path);
+
+    std::string pack_path = idx_path.substr(0, idx_path.size() - 4) + ".pack";
+    int fd = open(pack_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw GitError("Cannot read " + pack_path + ": " + std::strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 12) {
+        close(fd);
+        throw GitError("Corrupt pack " + pack_path);
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        throw GitError("Cannot map " + pack_path + ": " + std::strerror(errno));
+    pack->data = static_cast<const unsigned char*>(map);
+    pack->size = st.st_size;
+    return pack;
+}
+
+// Minimal config reader: "section.key" -> value, last one wins
+std::map<std::string, std::string> read_config(const std::string& path) {
+    std::map<std::string, std::string> values;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return values;
+    close(fd);
+
+    std::string section;
+    std::string text = read_file(path);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t nl = text.find('\n', pos);
+        std::string line = text.substr(pos, nl == std::string::npos ? std::string::npos : nl - pos);
+        pos = nl == std::string::npos ? text.size() : nl + 1;
+
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#' || line[start] == ';')
+            continue;
+        line = line.substr(start);
+        if (line[0] == '[') {
+            section = line.substr(1, line.find(']') - 1);
+            section = section.substr(0, section.find_first_of(" \t"));
+            continue;
+        }
+        size_t eq = line.find('=');
+        std::string key = line.substr(0, eq);
+        std::string value = eq == std::string::npos ? "true" : line.substr(eq + 1);
+        key.erase(key.find_last_not_of(" \t\r") + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r") + 1);
+        std::string name = section + "." + key;
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+        values[name] = value;
+    }
+    return values;
+}
+
+struct IndexEntry {
+    std::string path;
+    FileEntry file;
+    uint32_t size = 0;
+    uint32_t mtime_sec = 0;
+    uint32_t mtime_nsec = 0;
+    int stage = 0;
+    bool intent_to_add = false;
+    bool skip_worktree = false;
+};
+
+std::vector<IndexEntry> parse_index(const std::string& data) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    const unsigned char* end = p + data.size();
+    if (data.size() < 12 + 20 || std::memcmp(p, "DIRC", 4) != 0)
+        throw GitError("Not a git index");
+    uint32_t version = be32(p + 4);
+    if (version < 2 || version > 4)
+        throw GitUnsupported("Unsupported index version " + std::to_string(version));
+    uint32_t count = be32(p + 8);
+
+    std::vector<IndexEntry> entries;
+    entries.reserve(count);
+    const unsigned char* cur = p + 12;
+    std::string previous;
+    for (uint32_t i = 0; i < count; i++) {
+        if (cur + 62 > end)
+            throw GitError("Truncated git index");
+        IndexEntry entry;
+        entry.mtime_sec = be32(cur + 8);
+        entry.mtime_nsec = be32(cur + 12);
+        entry.file.mode = be32(cur + 24);
+        entry.size = be32(cur + 36);
+        std::memcpy(entry.file.id.data(), cur + 40, 20);
+        uint16_t flags = be16(cur + 60);
+        entry.stage = (flags >> 12) & 3;
+        const unsigned char* name = cur + 62;
+        if (flags & 0x4000) {
+            uint16_t extended = be16(cur + 62);
+            entry.skip_worktree = extended & 0x4000;
+            entry.intent_to_add = extended & 0x2000;
+            name += 2;
+        }
+
+        if (version == 4) {
+            // Prefix-compressed: drop N bytes of the previous path, then a NUL-terminated suffix
+            size_t strip = 0;
+            unsigned char c;
+            const unsigned char* q = name;
+            c = *q++;
+            strip = c & 0x7f;
+            while (c & 0x80) {
+                c = *q++;
+                strip = ((strip + 1) << 7) | (c & 0x7f);
+            }
+            const unsigned char* nul = static_cast<const unsigned char*>(std::memchr(q, 0, end - q));
+            if (!nul || strip > previous.size())
+                throw GitError("Corrupt git index");
+            entry.path = previous.substr(0, previous.size() - strip) + std::string((const char*)q, nul - q);
+            cur = nul + 1;
+        } else {
+            const unsigned char* nul = static_cast<const unsigned char*>(std::memchr(name, 0, end - name));
+            if (!nul)
+                throw GitError("Corrupt git index");
+            entry.path.assign((const char*)name, nul - name);
+            // Entries are NUL-padded to a multiple of 8 bytes
+            size_t length = (nul - cur + 8) & ~(size_t)7;
+            cur += length;
+        }
+        previous = entry.path;
+
+        if ((entry.file.mode & 0170000) == MODE_TREE)
+            throw GitUnsupported("Sparse index is not supported");
+        entries.push_back(std::move(entry));
+    }
+
+    // Extensions until the trailing checksum; only a split index changes the entries
+    while (cur + 8 <= end - 20) {
+        if (std::memcmp(cur, "link", 4) == 0)
+            throw GitUnsupported("Split index is not supported");
+        cur += 8 + be32(cur + 4);
+    }
+    return entries;
+}
+
+bool in_scope(const std::string& path, const std::string& only) {
+    return only.empty() || path == only
+           || (path.size() > only.size() && path.compare(0, only.size(), only) == 0 && path[only.size()] == '/');
+}
+
+}  // namespace
+
+std::string to_hex(const ObjectId& id) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(40, '0');
+    for (int i = 0; i < 20; i++) {
+        hex[2 * i] = digits[id[i] >> 4];
+        hex[2 * i + 1] = digits[id[i] & 15];
+    }
+    return hex;
+}
+
+// ---- GitCache ----
+
+GitCache::GitCache(size_t max_bytes) : max_bytes(max_bytes) {}
+
+bool GitCache::find_hunks(const std::string& key, std::string& hunks) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = index.find(key);
+    if (it == index.end()) {
+        miss_count++;
+        return false;
+    }
+    hit_count++;
+    lru.splice(lru.begin(), lru, it->second);
+    hunks = it->second->second;
+    return true;
+}
+
+void GitCache::store_hunks(const std::string& key, const std::string& hunks) {
+    size_t cost = key.size() + hunks.size();
+    if (cost > max_bytes / 4)
+        return;
+    std::lock_guard<std::mutex> lock(mtx);
+    if (index.count(key))
+        return;
+    lru.emplace_front(key, hunks);
+    index[key] = lru.begin();
+    bytes += cost;
+    while (bytes > max_bytes && !lru.empty()) {
+        bytes -= lru.back().first.size() + lru.back().second.size();
+        index.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+std::shared_ptr<const FileMap> GitCache::find_tree(const ObjectId& tree) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = trees.begin(); it != trees.end(); ++it) {
+        if (it->first == tree) {
+            trees.splice(trees.begin(), trees, it);
+            return trees.front().second;
+        }
+    }
+    return nullptr;
+}
+
+void GitCache::store_tree(const ObjectId& tree, std::shared_ptr<const FileMap> files) {
+    std::lock_guard<std::mutex> lock(mtx);
+    trees.emplace_front(tree, std::move(files));
+    // A handful of HEADs covers the repositories in active use
+    if (trees.size() > 16)
+        trees.pop_back();
+}
+
+uint64_t GitCache::hits() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return hit_count;
+}
+
+uint64_t GitCache::misses() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return miss_count;
+}
+
+// ---- GitRepo ----
+
+struct GitRepo::Impl {
+    std::string worktree;
+    std::string gitdir;
+    std::string commondir;
+    std::vector<std::string> object_dirs;
+    std::vector<std::unique_ptr<Pack>> packs;
+    bool trust_filemode = true;
+
+    // Delta bases decoded during this request, by (pack, offset)
+    std::map<std::pair<size_t, uint64_t>, std::pair<int, std::string>> bases;
+    size_t base_bytes = 0;
+
+    void open(const std::string& top) {
+        worktree = top;
+        while (worktree.size() > 1 && worktree.back() == '/') {
+            worktree.pop_back();
+        }
+        std::string dotgit = worktree + "/.git";
+        struct stat st;
+        if (stat(dotgit.c_str(), &st) != 0)
+            throw GitError("Not a git repository: " + worktree);
+        if (S_ISDIR(st.st_mode)) {
+            gitdir = dotgit;
+        } else {
+            std::string line = first_line(read_file(dotgit));
+            if (line.rfind("gitdir: ", 0) != 0)
+                throw GitError("Invalid gitfile: " + dotgit);
+            gitdir = join_path(worktree, line.substr(8));
+        }
+
+        // Linked worktrees keep objects and refs in the main repository
+        commondir = gitdir;
+        if (file_exists(gitdir + "/commondir"))
+            commondir = join_path(gitdir, first_line(read_file(gitdir + "/commondir")));
+
+        auto config = read_config(commondir + "/config");
+        if (config.count("extensions.objectformat") && config["extensions.objectformat"] != "sha1")
+            throw GitUnsupported("Only SHA-1 repositories are supported");
+        if (config.count("extensions.refstorage") && config["extensions.refstorage"] != "files")
+            throw GitUnsupported("Only the files ref backend is supported");
+        if (config.count("index.sparse") && config["index.sparse"] == "true")
+            throw GitUnsupported("Sparse index is not supported");
+        if (config.count("core.filemode") && config["core.filemode"] == "false")
+            trust_filemode = false;
+
+        object_dirs.push_back(commondir + "/objects");
+        std::string alternates = commondir + "/objects/info/alternates";
+        if (file_exists(alternates)) {
+            std::string text = read_file(alternates);
+            size_t pos = 0;
+            while (pos < text.size()) {
+                size_t nl = text.find('\n', pos);
+                std::string line = text.substr(pos, nl == std::string::npos ? std::string::npos : nl - pos);
+                pos = nl == std::string::npos ? text.size() : nl + 1;
+                if (!line.empty() && line[0] != '#')
+                    object_dirs.push_back(join_path(commondir + "/objects", line));
+            }
+        }
+
+        for (const auto& dir : object_dirs) {
+            std::string pack_dir = dir + "/pack";
+            DIR* d = opendir(pack_dir.c_str());
+            if (!d)
+                continue;
+            while (struct dirent* ent = readdir(d)) {
+                std::string name = ent->d_name;
+                if (name.size() > 4 && name.compare(name.size() - 4, 4, ".idx") == 0)
+                    packs.push_back(open_pack(pack_dir + "/" + name));
+            }
+            closedir(d);
+        }
+    }
+
+    std::string loose_path(const std::string& dir, const ObjectId& id) const {
+        std::string hex = to_hex(id);
+        return dir + "/" + hex.substr(0, 2) + "/" + hex.substr(2);
+    }
+
+    bool has_object(const ObjectId& id) const {
+        uint64_t offset;
+        for (const auto& pack : packs) {
+            if (pack->find(id, offset))
+                return true;
+        }
+        for (const auto& dir : object_dirs) {
+            if (file_exists(loose_path(dir, id)))
+                return true;
+        }
+        return false;
+    }
+
+    std::string read_packed(size_t pack_index, uint64_t offset, int& type, int depth) {
+        auto cached = bases.find({pack_index, offset});
+        if (cached != bases.end()) {
+            type = cached->second.first;
+            return cached->second.second;
+        }
+        if (depth > MAX_DELTA_DEPTH)
+            throw GitError("Delta chain too deep");
+
+        const Pack& pack = *packs[pack_index];
+        if (offset >= pack.size)
+            throw GitError("Corrupt pack " + pack.name);
+        const unsigned char* p = pack.data + offset;
+        const unsigned char* end = pack.data + pack.size;
+
+        unsigned char c = *p++;
+        type = (c >> 4) & 7;
+        size_t size = c & 15;
+        int shift = 4;
+        while (c & 0x80) {
+            if (p >= end)
+                throw GitError("Corrupt pack " + pack.name);
+            c = *p++;
+            size |= (size_t)(c & 0x7f) << shift;
+            shift += 7;
+        }
+
+        if (type == OBJ_OFS_DELTA || type == OBJ_REF_DELTA) {
+            std::string base;
+            if (type == OBJ_OFS_DELTA) {
+                c = *p++;
+                uint64_t back = c & 0x7f;
+                while (c & 0x80) {
+                    c = *p++;
+                    back = ((back + 1) << 7) | (c & 0x7f);
+                }
+                if (back > offset)
+                    throw GitError("Corrupt pack " + pack.name);
+                base = read_packed(pack_index, offset - back, type, depth + 1);
+            } else {
+                ObjectId base_id;
+                std::memcpy(base_id.data(), p, 20);
+                p += 20;
+                base = read_object(base_id, type, depth + 1);
+            }
+            std::string delta = inflate_all(p, end - p, size);
+            std::string object = apply_delta(base, delta);
+            remember_base(pack_index, offset, type, object);
+            return object;
+        }
+        if (type < OBJ_COMMIT || type > OBJ_TAG)
+            throw GitError("Corrupt pack " + pack.name);
+        std::string object = inflate_all(p, end - p, size);
+        if (object.size() != size)
+            throw GitError("Corrupt pack " + pack.name);
+        return object;
+    }
+
+    // Trees and commits are read many times within one diff; blobs are not
+    void remember_base(size_t pack_index, uint64_t offset, int type, const std::string& object) {
+        if (type == OBJ_BLOB || object.size() > BASE_CACHE_BYTES / 8)
+            return;
+        if (base_bytes + object.size() > BASE_CACHE_BYTES) {
+            bases.clear();
+            base_bytes = 0;
+        }
+        bases[{pack_index, offset}] = {type, object};
+        base_bytes += object.size();
+    }
+
+    std::string read_object(const ObjectId& id, int& type, int depth = 0) {
+        uint64_t offset;
+        for (size_t i = 0; i < packs.size(); i++) {
+            if (packs[i]->find(id, offset))
+                return read_packed(i, offset, type, depth);
+        }
+        for (const auto& dir : object_dirs) {
+            std::string path = loose_path(dir, id);
+            if (!file_exists(path))
+                continue;
+            std::string raw = read_file(path);
+            std::string object =
+                inflate_all(reinterpret_cast<const unsigned char*>(raw.data()), raw.size(), raw.size() * 3);
+            size_t nul = object.find('\0');
+            size_t space = object.find(' ');
+            if (nul == std::string::npos || space > nul)
+                throw GitError("Corrupt object " + to_hex(id));
+            std::string kind = object.substr(0, space);
+            type = kind == "blob" ? OBJ_BLOB : kind == "tree" ? OBJ_TREE : kind == "commit" ? OBJ_COMMIT : OBJ_TAG;
+            return object.substr(nul + 1);
+        }
+        throw GitError("Object not found: " + to_hex(id));
+    }
+
+    std::string read_typed(const ObjectId& id, int expected) {
+        int type = 0;
+        std::string object = read_object(id, type);
+        if (type != expected)
+            throw GitError("Unexpected object type for " + to_hex(id));
+        return object;
+    }
+
+    // Loose ref, then packed-refs; false for an unborn branch
+    bool resolve_ref(const std::string& name, ObjectId& id, int depth = 0) {
+        if (depth > 5)
+            throw GitError("Symbolic ref loop at " + name);
+        for (const std::string& dir : {gitdir, commondir}) {
+            std::string path = dir + "/" + name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+                continue;
+            std::string line = first_line(read_file(path));
+            if (line.rfind("ref: ", 0) == 0)
+                return resolve_ref(line.substr(5), id, depth + 1);
+            if (line.size() >= 40 && parse_hex(line.c_str(), id))
+                return true;
+            throw GitError("Invalid ref " + name);
+        }
+        std::string packed = commondir + "/packed-refs";
+        if (!file_exists(packed))
+            return false;
+        std::string text = read_file(packed);
+        std::string suffix = " " + name;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t nl = text.find('\n', pos);
+            std::string line = text.substr(pos, nl == std::string::npos ? std::string::npos : nl - pos);
+            pos = nl == std::string::npos ? text.size() : nl + 1;
+            if (line.size() == 40 + suffix.size() && line.compare(40, suffix.size(), suffix) == 0)
+                return parse_hex(line.c_str(), id);
+        }
+        return false;
+    }
+
+    void flatten_tree(const ObjectId& tree, const std::string& prefix, FileMap& files) {
+        std::string data = read_typed(tree, OBJ_TREE);
+        size_t pos = 0;
+        while (pos < data.size()) {
+            size_t space = data.find(' ', pos);
+            size_t nul = data.find('\0', space);
+            if (space == std::string::npos || nul == std::string::npos || nul + 21 > data.size())
+                throw GitError("Corrupt tree " + to_hex(tree));
+            FileEntry entry;
+            entry.mode = (uint32_t)std::strtoul(data.c_str() + pos, nullptr, 8);
+            std::string path = prefix + data.substr(space + 1, nul - space - 1);
+            std::memcpy(entry.id.data(), data.data() + nul + 1, 20);
+            pos = nul + 21;
+            if (entry.mode == MODE_TREE)
+                flatten_tree(entry.id, path + "/", files);
+            else
+                files.emplace(std::move(path), entry);
+        }
+    }
+
+    std::shared_ptr<const FileMap> head_files(GitCache* cache) {
+        ObjectId commit;
+        if (!resolve_ref("HEAD", commit))
+            return std::make_shared<FileMap>();  // unborn branch: everything staged is new
+
+        std::string data = read_typed(commit, OBJ_COMMIT);
+        ObjectId tree;
+        if (data.rfind("tree ", 0) != 0 || !parse_hex(data.c_str() + 5, tree))
+            throw GitError("Corrupt commit " + to_hex(commit));
+
+        if (cache && has_object(tree)) {
+            if (auto files = cache->find_tree(tree))
+                return files;
+        }
+        auto files = std::make_shared<FileMap>();
+        flatten_tree(tree, "", *files);
+        if (cache)
+            cache->store_tree(tree, files);
+        return files;
+    }
+
+    std::string blob(const FileEntry& entry) {
+        // Symlinks store their target as the blob
+        return read_typed(entry.id, OBJ_BLOB);
+    }
+
+    // One file's section of the diff; `old_content`/`new_content` are loaded
+    // on demand so a cache hit skips reading blobs entirely
+    void emit(RepoDiff& out, const std::string& path, const FileEntry* old_file, const FileEntry* new_file,
+              const std::string* worktree_content, GitCache* cache) {
+        std::string& text = out.text;
+        text += "diff --git a/" + path + " b/" + path + "\n";
+        if (!old_file) {
+            text += "new file mode " + mode_string(new_file->mode) + "\n";
+        } else if (!new_file) {
+            text += "deleted file mode " + mode_string(old_file->mode) + "\n";
+        } else if (old_file->mode != new_file->mode) {
+            text += "old mode " + mode_string(old_file->mode) + "\nnew mode " + mode_string(new_file->mode) + "\n";
+        }
+        out.files++;
+
+        const ObjectId& old_id = old_file ? old_file->id : NULL_ID;
+        const ObjectId& new_id = new_file ? new_file->id : NULL_ID;
+        if (old_file && new_file && old_id == new_id)
+            return;  // mode change only
+        text += "index " + to_hex(old_id).substr(0, 7) + ".." + to_hex(new_id).substr(0, 7);
+        if (old_file && new_file && old_file->mode == new_file->mode)
+            text += " " + mode_string(new_file->mode);
+        text += "\n";
+
+        // Both objects must be in this repository before a cached result is used
+        std::string key = to_hex(old_id) + to_hex(new_id);
+        std::string hunks;
+        bool cached = cache && (!old_file || has_object(old_id))
+                      && (!new_file || worktree_content || has_object(new_id)) && cache->find_hunks(key, hunks);
+        if (!cached) {
+            std::string before = old_file ? blob(*old_file) : "";
+            std::string after = worktree_content ? *worktree_content : new_file ? blob(*new_file) : "";
+            hunks = is_binary(before) || is_binary(after) ? std::string(1, '\0') : unified_hunks(before, after);
+            if (cache)
+                cache->store_hunks(key, hunks);
+        }
+
+        std::string a = old_file ? "a/" + path : "/dev/null";
+        std::string b = new_file ? "b/" + path : "/dev/null";
+        if (hunks == std::string(1, '\0')) {
+            text += "Binary files " + a + " and " + b + " differ\n";
+        } else if (!hunks.empty()) {
+            text += "--- " + a + "\n+++ " + b + "\n" + hunks;
+        }
+    }
+
+    RepoDiff staged(const std::string& only, GitCache* cache) {
+        std::string index_path = gitdir + "/index";
+        if (!file_exists(index_path))
+            return {};  // fresh repository, nothing added yet
+        std::vector<IndexEntry> entries = parse_index(read_file(index_path));
+        std::shared_ptr<const FileMap> head = head_files(cache);
+
+        FileMap index;
+        std::map<std::string, bool> unmerged;
+        for (const auto& entry : entries) {
+            if (!in_scope(entry.path, only))
+                continue;
+            if (entry.stage != 0)
+                unmerged[entry.path] = true;
+            else if (!entry.intent_to_add)
+                index.emplace(entry.path, entry.file);
+        }
+
+        RepoDiff out;
+        auto old_it = head->lower_bound(only);
+        auto new_it = index.begin();
+        while (true) {
+            while (old_it != head->end() && !in_scope(old_it->first, only) && old_it->first < only + "0") {
+                ++old_it;
+            }
+            bool old_done = old_it == head->end() || !in_scope(old_it->first, only);
+            bool new_done = new_it == index.end();
+            if (old_done && new_done)
+                break;
+
+            int cmp = old_done ? 1 : new_done ? -1 : old_it->first.compare(new_it->first);
+            const std::string& path = cmp <= 0 ? old_it->first : new_it->first;
+            const FileEntry* old_file = cmp <= 0 ? &old_it->second : nullptr;
+            const FileEntry* new_file = cmp >= 0 ? &new_it->second : nullptr;
+            bool changed = !old_file || !new_file || old_file->id != new_file->id || old_file->mode != new_file->mode;
+            bool gitlink = (old_file && old_file->mode == MODE_GITLINK) || (new_file && new_file->mode == MODE_GITLINK);
+            if (changed && !gitlink && !unmerged.count(path))
+                emit(out, path, old_file, new_file, nullptr, cache);
+            if (cmp <= 0)
+                ++old_it;
+            if (cmp >= 0)
+                ++new_it;
+        }
+        return out;
+    }
+
+    RepoDiff unstaged(const std::string& only, GitCache* cache) {
+        std::string index_path = gitdir + "/index";
+        struct stat index_st;
+        if (!file_exists(index_path) || stat(index_path.c_str(), &index_st) != 0)
+            return {};  // nothing tracked yet
+        std::vector<IndexEntry> entries = parse_index(read_file(index_path));
+
+        RepoDiff out;
+        for (const auto& entry : entries) {
+            if (entry.stage != 0 || entry.skip_worktree || entry.file.mode == MODE_GITLINK
+                || !in_scope(entry.path, only))
+                continue;
+
+            std::string path = worktree + "/" + entry.path;
+            struct stat st;
+            if (lstat(path.c_str(), &st) != 0 || !(S_ISREG(st.st_mode) || S_ISLNK(st.st_mode))) {
+                if (!entry.intent_to_add)
+                    emit(out, entry.path, &entry.file, nullptr, nullptr, cache);
+                continue;
+            }
+
+            FileEntry current;
+            if (S_ISLNK(st.st_mode))
+                current.mode = MODE_LINK;
+            else if (!trust_filemode && entry.file.mode != MODE_LINK)
+                current.mode = entry.file.mode;
+            else
+                current.mode = (st.st_mode & S_IXUSR) ? MODE_EXEC : MODE_FILE;
+
+            // Stat data matches and the file is older than the index: unchanged.
+            // Anything written in the same second as the index is compared by content.
+            bool racy = st.st_mtim.tv_sec >= index_st.st_mtim.tv_sec;
+            if (!entry.intent_to_add && !racy && current.mode == entry.file.mode && (uint32_t)st.st_size == entry.size
+                && (uint32_t)st.st_mtim.tv_sec == entry.mtime_sec && (uint32_t)st.st_mtim.tv_nsec == entry.mtime_nsec)
+                continue;
+
+            std::string content;
+            if (S_ISLNK(st.st_mode)) {
+                std::vector<char> target(st.st_size + 1);
+                ssize_t n = readlink(path.c_str(), target.data(), target.size());
+                if (n < 0)
+                    throw GitError("Cannot read link " + path + ": " + std::strerror(errno));
+                content.assign(target.data(), n);
+            } else {
+                content = read_file(path);
+            }
+            current.id = hash_blob(content);
+            if (entry.intent_to_add)
+                emit(out, entry.path, nullptr, &current, &content, cache);
+            else if (current.id != entry.file.id || current.mode != entry.file.mode)
+                emit(out, entry.path, &entry.file, &current, &content, cache);
+        }
+        return out;
+    }
+};
+
+GitRepo::GitRepo(const std::string& worktree) : impl(std::make_unique<Impl>()) {
+    impl->open(worktree);
+}
+
+GitRepo::~GitRepo() = default;
+
+const std::string& GitRepo::git_dir() const {
+    return impl->gitdir;
+}
+
+RepoDiff GitRepo::diff(DiffSide side, const std::string& only, GitCache* cache) {
+    std::string scope = only;
+    while (scope.rfind("./", 0) == 0) {
+        scope.erase(0, 2);
+    }
+    while (!scope.empty() && scope.back() == '/') {
+        scope.pop_back();
+    }
+    return side == DiffSide::Staged ? impl->staged(scope, cache) : impl->unstaged(scope, cache);
+}
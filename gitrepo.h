@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Read-only access to a git repository without running git: loose and packed
+// objects (with deltas), the index, HEAD, and `git diff`-style output built
+// from them. SHA-1 object format only.
+
+using ObjectId = std::array<unsigned char, 20>;
+
+std::string to_hex(const ObjectId& id);
+
+struct GitError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Repository features this reader does not handle (SHA-256, split or sparse
+// indexes, reftable); callers can fall back to running git
+struct GitUnsupported : GitError {
+    using GitError::GitError;
+};
+
+struct FileEntry {
+    uint32_t mode = 0;
+    ObjectId id{};
+};
+
+// Path -> entry for every file in a tree, sorted like git sorts them
+using FileMap = std::map<std::string, FileEntry>;
+
+// Work shared across requests and repositories, keyed by content hash: diff
+// hunks per blob pair and flattened HEAD trees. Entries are only used after
+// the caller's repository has shown it holds the objects they came from.
+class GitCache {
+public:
+    explicit GitCache(size_t max_bytes = 64 << 20);
+
+    bool find_hunks(const std::string& key, std::string& hunks);
+    void store_hunks(const std::string& key, const std::string& hunks);
+
+    std::shared_ptr<const FileMap> find_tree(const ObjectId& tree);
+    void store_tree(const ObjectId& tree, std::shared_ptr<const FileMap> files);
+
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    mutable std::mutex mtx;
+    size_t max_bytes;
+    size_t bytes = 0;
+    std::list<std::pair<std::string, std::string>> lru;  // most recent first
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> index;
+    std::list<std::pair<ObjectId, std::shared_ptr<const FileMap>>> trees;
+    uint64_t hit_count = 0;
+    uint64_t miss_count = 0;
+};
+
+enum class DiffSide {
+    Staged,    // index against HEAD, like `git diff --cached`
+    Unstaged,  // work tree against the index, like `git diff`
+};
+
+struct RepoDiff {
+    std::string text;
+    size_t files = 0;
+};
+
+class GitRepo {
+public:
+    // `worktree` is the top of a checkout; .git may be a directory or a gitfile
+    explicit GitRepo(const std::string& worktree);
+    ~GitRepo();
+
+    GitRepo(const GitRepo&) = delete;
+    GitRepo& operator=(const GitRepo&) = delete;
+
+    // `only` limits the diff to one file or directory, relative to the top
+    RepoDiff diff(DiffSide side, const std::string& only = "", GitCache* cache = nullptr);
+
+    // Where this checkout's index and HEAD live
+    const std::string& git_dir() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
@@ -0,0 +1,323 @@
+#include "http.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "protocol.h"
+
+namespace {
+
+constexpr size_t MAX_HEADER_BYTES = 64 * 1024;
+constexpr size_t MAX_BODY_BYTES = 256 * 1024 * 1024;
+
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+const char* reason(int status) {
+    switch (status) {
+        case 100:
+            return "Continue";
+        case 200:
+            return "OK";
+        case 400:
+            return "Bad Request";
+        case 403:
+            return "Forbidden";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 411:
+            return "Length Required";
+        case 413:
+            return "Payload Too Large";
+        case 415:
+            return "Unsupported Media Type";
+        case 431:
+            return "Request Header Fields Too Large";
+        case 500:
+            return "Internal Server Error";
+        case 503:
+            return "Service Unavailable";
+        case 505:
+            return "HTTP Version Not Supported";
+        default:
+            return "Unknown";
+    }
+}
+
+std::string lowercase(std::string s) {
+    for (char& c : s) {
+        if (c >= 'A' && c <= 'Z')
+            c = c - 'A' + 'a';
+    }
+    return s;
+}
+
+std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t");
+    size_t end = s.find_last_not_of(" \t\r");
+    return start == std::string::npos ? "" : s.substr(start, end - start + 1);
+}
+
+std::string hex(size_t n) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%zx", n);
+    return buf;
+}
+
+}  // namespace
+
+std::string HttpRequest::header(const std::string& name, const std::string& fallback) const {
+    auto it = headers.find(name);
+    return it == headers.end() ? fallback : it->second;
+}
+
+bool HttpRequest::keep_alive() const {
+    std::string connection = lowercase(header("connection"));
+    if (version == "HTTP/1.0")
+        return connection == "keep-alive";
+    return connection != "close";
+}
+
+bool HttpRequest::loopback_host() const {
+    std::string host = lowercase(header("host"));
+    if (host.empty())
+        return version == "HTTP/1.0";  // 1.1 requires it
+    if (host[0] == '[') {
+        host = host.substr(1, host.find(']') - 1);
+        return host == "::1";
+    }
+    host = host.substr(0, host.find(':'));
+    struct in_addr addr;
+    return host == "localhost" || (inet_pton(AF_INET, host.c_str(), &addr) == 1 && (ntohl(addr.s_addr) >> 24) == 127);
+}
+
+std::string HttpRequest::media_type() const {
+    std::string type = header("content-type");
+    return lowercase(trim(type.substr(0, type.find(';'))));
+}
+
+HttpConnection::HttpConnection(int fd) : sock(fd) {}
+
+HttpConnection::~HttpConnection() {
+    if (sock >= 0)
+        close(sock);
+}
+
+bool HttpConnection::fill() {
+    char chunk[64 * 1024];
+    ssize_t n;
+    do {
+        n = ::read(sock, chunk, sizeof(chunk));
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0)
+        return false;
+    buffer.append(chunk, n);
+    return true;
+}
+
+bool HttpConnection::send_all(const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(sock, data.data() + sent, data.size() - sent, SEND_FLAGS);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+bool HttpConnection::read(HttpRequest& req) {
+    error = 0;
+    size_t header_end;
+    while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (buffer.size() > MAX_HEADER_BYTES) {
+            error = 431;
+            return false;
+        }
+        if (!fill()) {
+            error = buffer.empty() ? 0 : 400;
+            return false;
+        }
+    }
+
+    req = HttpRequest();
+    size_t eol = buffer.find("\r\n");
+    std::string request_line = buffer.substr(0, eol);
+    size_t sp1 = request_line.find(' ');
+    size_t sp2 = request_line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1) {
+        error = 400;
+        return false;
+    }
+    req.method = request_line.substr(0, sp1);
+    req.target = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+    req.version = request_line.substr(sp2 + 1);
+    if (req.version != "HTTP/1.1" && req.version != "HTTP/1.0") {
+        error = 505;
+        return false;
+    }
+
+    size_t pos = eol + 2;
+    while (pos < header_end) {
+        eol = buffer.find("\r\n", pos);
+        std::string line = buffer.substr(pos, eol - pos);
+        pos = eol + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0) {
+            error = 400;
+            return false;
+        }
+        req.headers[lowercase(line.substr(0, colon))] = trim(line.substr(colon + 1));
+    }
+    buffer.erase(0, header_end + 4);
+
+    if (!req.header("transfer-encoding").empty()) {
+        error = 411;
+        return false;
+    }
+    std::string length_header = req.header("content-length", "0");
+    char* end = nullptr;
+    unsigned long long length = std::strtoull(length_header.c_str(), &end, 10);
+    if (end == length_header.c_str() || *end != '\0') {
+        error = 400;
+        return false;
+    }
+    if (length > MAX_BODY_BYTES) {
+        error = 413;
+        return false;
+    }
+
+    // curl asks before sending bodies over 1 KB
+    if (length > buffer.size() && lowercase(req.header("expect")) == "100-continue") {
+        if (!send_all("HTTP/1.1 100 Continue\r\n\r\n"))
+            return false;
+    }
+    while (buffer.size() < length) {
+        if (!fill())
+            return false;
+    }
+    req.body = buffer.substr(0, length);
+    buffer.erase(0, length);
+    return true;
+}
+
+bool HttpConnection::respond(int status, const std::string& content_type, const std::string& body, bool keep_alive,
+                             const std::string& extra_headers) {
+    std::string head = "HTTP/1.1 " + std::to_string(status) + " " + reason(status) + "\r\n";
+    head += "Content-Type: " + content_type + "\r\n";
+    head += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    head += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    head += extra_headers;
+    head += "\r\n";
+    return send_all(head + body);
+}
+
+bool HttpConnection::start_events() {
+    return send_all(
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n");
+}
+
+bool HttpConnection::send_event(const std::string& event, const std::string& data) {
+    // data must not contain newlines; callers send JSON, which escapes them
+    std::string frame = "event: " + event + "\ndata: " + data + "\n\n";
+    return send_all(hex(frame.size()) + "\r\n" + frame + "\r\n");
+}
+
+bool HttpConnection::end_events() {
+    return send_all("0\r\n\r\n");
+}
+
+int listen_http(const std::string& spec, std::string& address) {
+    if (spec.rfind("unix:", 0) == 0) {
+        address = spec.substr(5);
+        return listen_server(address);
+    }
+
+    std::string host = "127.0.0.1";
+    std::string port = spec;
+    size_t colon = spec.rfind(':');
+    if (colon != std::string::npos) {
+        host = spec.substr(0, colon);
+        port = spec.substr(colon + 1);
+    }
+    if (host == "localhost")
+        host = "127.0.0.1";
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    char* end = nullptr;
+    long port_number = std::strtol(port.c_str(), &end, 10);
+    if (port.empty() || *end != '\0' || port_number <= 0 || port_number > 65535)
+        throw std::runtime_error("Invalid HTTP port: " + spec);
+    addr.sin_port = htons((uint16_t)port_number);
+    // Nothing here authenticates beyond the local user, so never leave the machine
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 || (ntohl(addr.sin_addr.s_addr) >> 24) != 127)
+        throw std::runtime_error("HTTP host must be a loopback address: " + host);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error("Failed to listen on " + spec + ": " + std::strerror(err));
+    }
+    address = "http://" + host + ":" + std::to_string(port_number);
+    return fd;
+}
+
+bool tcp_peer_uid(int fd, uid_t& uid) {
+    struct sockaddr_in local, peer;
+    socklen_t len = sizeof(local);
+    if (getsockname(fd, reinterpret_cast<struct sockaddr*>(&local), &len) != 0 || local.sin_family != AF_INET)
+        return false;
+    len = sizeof(peer);
+    if (getpeername(fd, reinterpret_cast<struct sockaddr*>(&peer), &len) != 0)
+        return false;
+
+    // The client's own row has the peer as its local address and us as remote
+    FILE* f = std::fopen("/proc/net/tcp", "r");
+    if (!f)
+        return false;
+    char line[512];
+    bool found = false;
+    std::fgets(line, sizeof(line), f);  // header
+    while (!found && std::fgets(line, sizeof(line), f)) {
+        unsigned local_addr, local_port, rem_addr, rem_port, row_uid;
+        if (std::sscanf(line, " %*u: %X:%X %X:%X %*X %*X:%*X %*X:%*X %*X %u", &local_addr, &local_port, &rem_addr,
+                        &rem_port, &row_uid)
+            != 5)
+            continue;
+        if (local_addr == peer.sin_addr.s_addr && local_port == ntohs(peer.sin_port)
+            && rem_addr == local.sin_addr.s_addr && rem_port == ntohs(local.sin_port)) {
+            uid = row_uid;
+            found = true;
+        }
+    }
+    std::fclose(f);
+    return found;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+
+// Minimal HTTP/1.1 server side for the loopback endpoint: Content-Length
+// request bodies, keep-alive, and chunked text/event-stream responses.
+
+struct HttpRequest {
+    std::string method;
+    std::string target;
+    std::string version;
+    std::map<std::string, std::string> headers;  // names lowercased
+    std::string body;
+
+    std::string header(const std::string& name, const std::string& fallback = "") const;
+
+    // HTTP/1.1 unless "Connection: close"; HTTP/1.0 only with "keep-alive"
+    bool keep_alive() const;
+
+    // Host is localhost, 127.x.x.x or [::1], any port. A web page that points
+    // its own name at 127.0.0.1 (DNS rebinding) still sends that name here.
+    bool loopback_host() const;
+
+    // Content-Type without parameters, lowercased
+    std::string media_type() const;
+};
+
+// Buffered request reader / response writer; owns and closes the fd
+class HttpConnection {
+public:
+    explicit HttpConnection(int fd);
+    ~HttpConnection();
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    // False on EOF or a malformed request; error_status() is then the status
+    // to answer with before closing, or 0 if the peer just went away
+    bool read(HttpRequest& req);
+    int error_status() const { return error; }
+
+    bool respond(int status, const std::string& content_type, const std::string& body, bool keep_alive,
+                 const std::string& extra_headers = "");
+
+    // Server-sent events over chunked encoding, so the connection survives the stream
+    bool start_events();
+    bool send_event(const std::string& event, const std::string& data);
+    bool end_events();
+
+    int fd() const { return sock; }
+
+private:
+    bool fill();
+    bool send_all(const std::string& data);
+
+    int sock;
+    std::string buffer;
+    int error = 0;
+};
+
+// "<port>", "<host>:<port>" or "unix:<path>"; TCP hosts must be loopback.
+// Returns the listening fd and a printable address; throws on failure.
+int listen_http(const std::string& spec, std::string& address);
+
+// The local user behind a loopback TCP connection, from /proc/net/tcp
+bool tcp_peer_uid(int fd, uid_t& uid);
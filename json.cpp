@@ -0,0 +1,268 @@
+#include "json.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+std::string json_string(const std::string& value) {
+    std::string out;
+    out.reserve(value.size() + 2);
+    out += '"';
+    for (unsigned char c : value) {
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    out += '"';
+    return out;
+}
+
+const JsonValue* JsonValue::get(const std::string& key) const {
+    for (const auto& [name, value] : object) {
+        if (name == key)
+            return &value;
+    }
+    return nullptr;
+}
+
+namespace {
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : text(text) {}
+
+    JsonValue parse_document() {
+        JsonValue value = parse_value(0);
+        skip_space();
+        if (pos != text.size())
+            fail("trailing characters");
+        return value;
+    }
+
+private:
+    static constexpr int MAX_DEPTH = 256;
+
+    [[noreturn]] void fail(const std::string& what) {
+        throw std::runtime_error("Invalid JSON at offset " + std::to_string(pos) + ": " + what);
+    }
+
+    void skip_space() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\n' || text[pos] == '\r' || text[pos] == '\t'))
+            pos++;
+    }
+
+    bool consume(const char* literal) {
+        size_t n = std::strlen(literal);
+        if (text.compare(pos, n, literal) != 0)
+            return false;
+        pos += n;
+        return true;
+    }
+
+    JsonValue parse_value(int depth) {
+        if (depth > MAX_DEPTH)
+            fail("nested too deeply");
+        skip_space();
+        if (pos >= text.size())
+            fail("unexpected end");
+
+        JsonValue value;
+        char c = text[pos];
+        if (c == '{') {
+            value.type = JsonValue::Object;
+            pos++;
+            skip_space();
+            if (pos < text.size() && text[pos] == '}') {
+                pos++;
+                return value;
+            }
+            for (;;) {
+                skip_space();
+                if (pos >= text.size() || text[pos] != '"')
+                    fail("expected a key");
+                std::string key = parse_string();
+                skip_space();
+                if (pos >= text.size() || text[pos] != ':')
+                    fail("expected ':'");
+                pos++;
+                value.object.emplace_back(std::move(key), parse_value(depth + 1));
+                skip_space();
+                if (pos < text.size() && text[pos] == ',') {
+                    pos++;
+                } else if (pos < text.size() && text[pos] == '}') {
+                    pos++;
+                    return value;
+                } else {
+                    fail("expected ',' or '}'");
+                }
+            }
+        }
+        if (c == '[') {
+            value.type = JsonValue::Array;
+            pos++;
+            skip_space();
+            if (pos < text.size() && text[pos] == ']') {
+                pos++;
+                return value;
+            }
+            for (;;) {
+                value.array.push_back(parse_value(depth + 1));
+                skip_space();
+                if (pos < text.size() && text[pos] == ',') {
+                    pos++;
+                } else if (pos < text.size() && text[pos] == ']') {
+                    pos++;
+                    return value;
+                } else {
+                    fail("expected ',' or ']'");
+                }
+            }
+        }
+        if (c == '"') {
+            value.type = JsonValue::String;
+            value.string = parse_string();
+            return value;
+        }
+        if (consume("true")) {
+            value.type = JsonValue::Bool;
+            value.boolean = true;
+            return value;
+        }
+        if (consume("false")) {
+            value.type = JsonValue::Bool;
+            return value;
+        }
+        if (consume("null"))
+            return value;
+
+        const char* start = text.c_str() + pos;
+        char* end = nullptr;
+        value.number = std::strtod(start, &end);
+        if (end == start || !(c == '-' || (c >= '0' && c <= '9')))
+            fail("unexpected character");
+        value.type = JsonValue::Number;
+        pos += end - start;
+        return value;
+    }
+
+    unsigned parse_hex4() {
+        if (pos + 4 > text.size())
+            fail("truncated \\u escape");
+        unsigned code = 0;
+        for (int i = 0; i < 4; i++) {
+            char h = text[pos++];
+            code <<= 4;
+            if (h >= '0' && h <= '9')
+                code |= h - '0';
+            else if (h >= 'a' && h <= 'f')
+                code |= h - 'a' + 10;
+            else if (h >= 'A' && h <= 'F')
+                code |= h - 'A' + 10;
+            else
+                fail("bad \\u escape");
+        }
+        return code;
+    }
+
+    static void append_utf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += (char)code;
+        } else if (code < 0x800) {
+            out += (char)(0xC0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += (char)(0xE0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        } else {
+            out += (char)(0xF0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3F));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    std::string parse_string() {
+        std::string out;
+        pos++;  // opening quote
+        while (pos < text.size()) {
+            char c = text[pos++];
+            if (c == '"')
+                return out;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size())
+                break;
+            char e = text[pos++];
+            switch (e) {
+                case '"':
+                case '\\':
+                case '/':
+                    out += e;
+                    break;
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'n':
+                    out += '\n';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'u': {
+                    unsigned code = parse_hex4();
+                    // Surrogate pair
+                    if (code >= 0xD800 && code < 0xDC00 && consume("\\u")) {
+                        unsigned low = parse_hex4();
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    append_utf8(out, code);
+                    break;
+                }
+                default:
+                    fail("bad escape");
+            }
+        }
+        fail("unterminated string");
+    }
+
+    const std::string& text;
+    size_t pos = 0;
+};
+
+}  // namespace
+
+JsonValue json_parse(const std::string& text) {
+    return JsonParser(text).parse_document();
+}
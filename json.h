@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+// Quoted, escaped JSON string literal
+std::string json_string(const std::string& value);
+
+// Parsed JSON document; objects keep their keys in document order
+struct JsonValue {
+    enum Type { Null, Bool, Number, String, Array, Object } type = Null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    // Member of an object, or nullptr
+    const JsonValue* get(const std::string& key) const;
+};
+
+// Parses a complete document; throws std::runtime_error naming the offset on bad input
+JsonValue json_parse(const std::string& text);
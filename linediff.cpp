@@ -0,0 +1,272 @@
+#include "linediff.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Past this many edits a region is reported as replaced wholesale; keeps
+// pathological rewrites from going quadratic
+constexpr int MAX_EDIT_COST = 2048;
+
+// Lines keep their '\n' so a missing final newline counts as a change
+std::vector<std::string_view> split_keep_newlines(const std::string& text) {
+    std::vector<std::string_view> lines;
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* next = nl ? nl + 1 : end;
+        lines.emplace_back(p, next - p);
+        p = next;
+    }
+    return lines;
+}
+
+class Myers {
+public:
+    Myers(const std::vector<int>& a, const std::vector<int>& b)
+        : a(a), b(b), removed(a.size(), false), added(b.size(), false) {}
+
+    void run() { compare(0, (int)a.size(), 0, (int)b.size()); }
+
+    const std::vector<int>& a;
+    const std::vector<int>& b;
+    std::vector<bool> removed;
+    std::vector<bool> added;
+
+private:
+    void compare(int a_lo, int a_hi, int b_lo, int b_hi) {
+        while (a_lo < a_hi && b_lo < b_hi && a[a_lo] == b[b_lo]) {
+            a_lo++;
+            b_lo++;
+        }
+        while (a_lo < a_hi && b_lo < b_hi && a[a_hi - 1] == b[b_hi - 1]) {
+            a_hi--;
+            b_hi--;
+        }
+        if (a_lo == a_hi || b_lo == b_hi) {
+            mark(a_lo, a_hi, b_lo, b_hi);
+            return;
+        }
+
+        auto [x, y] = middle_snake(a_lo, a_hi, b_lo, b_hi);
+        if (x < 0 || (x == a_lo && y == b_lo) || (x == a_hi && y == b_hi)) {
+            mark(a_lo, a_hi, b_lo, b_hi);
+            return;
+        }
+        compare(a_lo, x, b_lo, y);
+        compare(x, a_hi, y, b_hi);
+    }
+
+    void mark(int a_lo, int a_hi, int b_lo, int b_hi) {
+        for (int i = a_lo; i < a_hi; i++) {
+            removed[i] = true;
+        }
+        for (int j = b_lo; j < b_hi; j++) {
+            added[j] = true;
+        }
+    }
+
+    // Runs the search from both ends until the paths meet and returns where to
+    // split, in absolute coordinates; (-1, -1) if the cost limit is reached
+    std::pair<int, int> middle_snake(int a_lo, int a_hi, int b_lo, int b_hi) {
+        const int* pa = a.data() + a_lo;
+        const int* pb = b.data() + b_lo;
+        int n = a_hi - a_lo;
+        int m = b_hi - b_lo;
+        int max_d = std::min((n + m + 1) / 2, MAX_EDIT_COST);
+        int offset = max_d;
+        int width = 2 * max_d + 2;
+        forward.assign(width, -1);
+        backward.assign(width, -1);
+        forward[offset + 1] = 0;
+        backward[offset + 1] = 0;
+        int delta = n - m;
+        bool odd = delta % 2 != 0;
+        int k1_start = 0, k1_end = 0, k2_start = 0, k2_end = 0;
+
+        for (int d = 0; d < max_d; d++) {
+            for (int k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2) {
+                int i1 = offset + k1;
+                int x1 = (k1 == -d || (k1 != d && forward[i1 - 1] < forward[i1 + 1])) ? forward[i1 + 1]
+                                                                                      : forward[i1 - 1] + 1;
+                int y1 = x1 - k1;
+                while (x1 < n && y1 < m && pa[x1] == pb[y1]) {
+                    x1++;
+                    y1++;
+                }
+                forward[i1] = x1;
+                if (x1 > n) {
+                    k1_end += 2;
+                } else if (y1 > m) {
+                    k1_start += 2;
+                } else if (odd) {
+                    int i2 = offset + delta - k1;
+                    if (i2 >= 0 && i2 < width && backward[i2] != -1 && x1 >= n - backward[i2])
+                        return {a_lo + x1, b_lo + y1};
+                }
+            }
+
+            for (int k2 = -d + k2_start; k2 <= d - k2_end; k2 += 2) {
+                int i2 = offset + k2;
+                int x2 = (k2 == -d || (k2 != d && backward[i2 - 1] < backward[i2 + 1])) ? backward[i2 + 1]
+                                                                                        : backward[i2 - 1] + 1;
+                int y2 = x2 - k2;
+                while (x2 < n && y2 < m && pa[n - x2 - 1] == pb[m - y2 - 1]) {
+                    x2++;
+                    y2++;
+                }
+                backward[i2] = x2;
+                if (x2 > n) {
+                    k2_end += 2;
+                } else if (y2 > m) {
+                    k2_start += 2;
+                } else if (!odd) {
+                    int i1 = offset + delta - k2;
+                    if (i1 >= 0 && i1 < width && forward[i1] != -1) {
+                        int x1 = forward[i1];
+                        int y1 = offset + x1 - i1;
+                        if (x1 >= n - x2)
+                            return {a_lo + x1, b_lo + y1};
+                    }
+                }
+            }
+        }
+        return {-1, -1};
+    }
+
+    std::vector<int> forward;
+    std::vector<int> backward;
+};
+
+// git's default hunk-header context: the nearest earlier line starting with a
+// letter, '_' or '$', trailing whitespace dropped, at most 80 bytes
+std::string_view function_context(const std::vector<std::string_view>& lines, int before) {
+    for (int i = before - 1; i >= 0; i--) {
+        std::string_view line = lines[i];
+        unsigned char c = line.empty() ? 0 : line[0];
+        if (!(std::isalpha(c) || c == '_' || c == '$'))
+            continue;
+        line = line.substr(0, std::min<size_t>(line.size(), 80));
+        while (!line.empty() && std::isspace((unsigned char)line.back())) {
+            line.remove_suffix(1);
+        }
+        return line;
+    }
+    return {};
+}
+
+std::string range(int start, int count) {
+    // Empty ranges name the line before them
+    std::string out = std::to_string(count == 0 ? start : start + 1);
+    if (count != 1)
+        out += "," + std::to_string(count);
+    return out;
+}
+
+void append_line(std::string& out, char prefix, std::string_view line) {
+    out += prefix;
+    out.append(line.data(), line.size());
+    if (line.empty() || line.back() != '\n')
+        out += "\n\\ No newline at end of file\n";
+}
+
+struct Change {
+    int a_start, a_end, b_start, b_end;
+};
+
+}  // namespace
+
+std::string unified_hunks(const std::string& a, const std::string& b, int context) {
+    if (a == b)
+        return "";
+
+    std::vector<std::string_view> a_lines = split_keep_newlines(a);
+    std::vector<std::string_view> b_lines = split_keep_newlines(b);
+
+    // Compare small integers instead of strings
+    std::unordered_map<std::string_view, int> ids;
+    auto intern = [&ids](const std::vector<std::string_view>& lines) {
+        std::vector<int> out;
+        out.reserve(lines.size());
+        for (std::string_view line : lines) {
+            out.push_back(ids.emplace(line, (int)ids.size()).first->second);
+        }
+        return out;
+    };
+    std::vector<int> a_ids = intern(a_lines);
+    std::vector<int> b_ids = intern(b_lines);
+
+    Myers myers(a_ids, b_ids);
+    myers.run();
+
+    std::vector<Change> changes;
+    int n = (int)a_lines.size(), m = (int)b_lines.size();
+    for (int i = 0, j = 0; i < n || j < m;) {
+        if (i < n && j < m && !myers.removed[i] && !myers.added[j]) {
+            i++;
+            j++;
+            continue;
+        }
+        Change change{i, i, j, j};
+        while (i < n && myers.removed[i]) {
+            i++;
+        }
+        while (j < m && myers.added[j]) {
+            j++;
+        }
+        change.a_end = i;
+        change.b_end = j;
+        changes.push_back(change);
+    }
+
+    std::string out;
+    for (size_t first = 0; first < changes.size();) {
+        // Changes whose context would touch or overlap share a hunk
+        size_t last = first;
+        while (last + 1 < changes.size() && changes[last + 1].a_start - changes[last].a_end <= 2 * context) {
+            last++;
+        }
+        int a_start = std::max(0, changes[first].a_start - context);
+        int b_start = changes[first].b_start - (changes[first].a_start - a_start);
+        int a_end = std::min(n, changes[last].a_end + context);
+        int b_end = changes[last].b_end + (a_end - changes[last].a_end);
+
+        out += "@@ -" + range(a_start, a_end - a_start) + " +" + range(b_start, b_end - b_start) + " @@";
+        std::string_view func = function_context(a_lines, a_start);
+        if (!func.empty()) {
+            out += ' ';
+            out.append(func.data(), func.size());
+        }
+        out += '\n';
+
+        int i = a_start;
+        for (size_t c = first; c <= last; c++) {
+            for (; i < changes[c].a_start; i++) {
+                append_line(out, ' ', a_lines[i]);
+            }
+            for (int k = changes[c].a_start; k < changes[c].a_end; k++) {
+                append_line(out, '-', a_lines[k]);
+            }
+            for (int k = changes[c].b_start; k < changes[c].b_end; k++) {
+                append_line(out, '+', b_lines[k]);
+            }
+            i = changes[c].a_end;
+        }
+        for (; i < a_end; i++) {
+            append_line(out, ' ', a_lines[i]);
+        }
+        first = last + 1;
+    }
+    return out;
+}
+
+bool is_binary(const std::string& content) {
+    return std::memchr(content.data(), '\0', std::min<size_t>(content.size(), 8000)) != nullptr;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+
+// Line diff for the server-side git reader: Myers' O(ND) algorithm in linear
+// space, printed as unified-diff hunks the way `git diff` does
+
+// "@@ -a,b +c,d @@ <function>" hunks turning `a` into `b` with `context`
+// lines around each change; empty when the texts are equal. A last line
+// without a newline is followed by "\ No newline at end of file".
+std::string unified_hunks(const std::string& a, const std::string& b, int context = 3);
+
+// Same test git uses: a NUL byte in the first 8000 bytes
+bool is_binary(const std::string& content);
@@ -0,0 +1,140 @@
+#include "backend.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "llama.h"
+
+namespace {
+
+class LlamaBackend : public Backend {
+public:
+    LlamaBackend(std::string path, size_t sequences)
+        : model_path(std::move(path)), samplers(std::max<size_t>(sequences, 1), nullptr),
+          positions(samplers.size(), 0), logit_rows(samplers.size(), -1) {}
+
+    ~LlamaBackend() override {
+        for (llama_sampler* sampler : samplers) {
+            if (sampler)
+                llama_sampler_free(sampler);
+        }
+        if (batch.token)
+            llama_batch_free(batch);
+        if (ctx)
+            llama_free(ctx);
+        if (model)
+            llama_model_free(model);
+    }
+
+    bool load() override {
+        if (!backend_logging())
+            llama_log_set([](enum ggml_log_level, const char*, void*) {}, nullptr);
+
+        llama_model_params model_params = llama_model_default_params();
+        model = llama_model_load_from_file(model_path.c_str(), model_params);
+        if (!model)
+            return false;
+
+        // Each sequence gets its own 4096-token slice of the KV cache
+        llama_context_params ctx_params = llama_context_default_params();
+        ctx_params.n_ctx = 4096 * (uint32_t)samplers.size();
+        ctx_params.n_seq_max = (uint32_t)samplers.size();
+        ctx_params.kv_unified = false;
+        ctx = llama_init_from_model(model, ctx_params);
+        vocab = llama_model_get_vocab(model);
+        if (!ctx)
+            return false;
+        batch = llama_batch_init((int32_t)batch_size(), 0, 1);
+        return true;
+    }
+
+    std::vector<Token> tokenize(const std::string& text) override {
+        std::vector<llama_token> tokens(text.size() + 16);
+        int n = llama_tokenize(vocab, text.c_str(), (int)text.size(), tokens.data(), (int)tokens.size(), true, true);
+        if (n < 0)
+            return {};
+        tokens.resize(n);
+        return tokens;
+    }
+
+    std::string token_to_piece(Token token) override {
+        char buf[256];
+        int len = llama_token_to_piece(vocab, token, buf, sizeof(buf), 0, true);
+        return len < 0 ? std::string() : std::string(buf, len);
+    }
+
+    bool is_eog(Token token) override { return llama_vocab_is_eog(vocab, token); }
+
+    bool truncate(int seq, size_t pos) override {
+        llama_memory_t mem = llama_get_memory(ctx);
+        if (llama_memory_seq_rm(mem, seq, (llama_pos)pos, -1)) {
+            positions[seq] = std::min(positions[seq], pos);
+            return true;
+        }
+        llama_memory_seq_rm(mem, seq, 0, -1);
+        positions[seq] = 0;
+        return false;
+    }
+
+    bool decode(const std::vector<SequenceTokens>& entries) override {
+        batch.n_tokens = 0;
+        for (const auto& entry : entries) {
+            if (batch.n_tokens + entry.n > batch_size())
+                return false;
+            for (size_t i = 0; i < entry.n; i++) {
+                int32_t row = batch.n_tokens++;
+                batch.token[row] = entry.tokens[i];
+                batch.pos[row] = (llama_pos)(positions[entry.seq] + i);
+                batch.n_seq_id[row] = 1;
+                batch.seq_id[row][0] = entry.seq;
+                batch.logits[row] = entry.logits && i + 1 == entry.n;
+            }
+        }
+        if (llama_decode(ctx, batch) != 0)
+            return false;
+
+        int32_t row = 0;
+        for (const auto& entry : entries) {
+            row += (int32_t)entry.n;
+            positions[entry.seq] += entry.n;
+            logit_rows[entry.seq] = entry.logits ? row - 1 : -1;
+        }
+        return true;
+    }
+
+    size_t max_sequences() const override { return samplers.size(); }
+
+    size_t batch_size() const override { return std::max<uint32_t>(llama_n_batch(ctx), 1); }
+
+    size_t context_size() const override { return llama_n_ctx(ctx) / samplers.size(); }
+
+    void reset_sampler(int seq) override {
+        llama_sampler*& sampler = samplers[seq];
+        if (sampler)
+            llama_sampler_free(sampler);
+        sampler = llama_sampler_chain_init(llama_sampler_chain_default_params());
+        llama_sampler_chain_add(sampler, llama_sampler_init_temp(0.3f));
+        llama_sampler_chain_add(sampler, llama_sampler_init_top_p(0.9f, 1));
+        llama_sampler_chain_add(sampler, llama_sampler_init_dist(42));
+    }
+
+    Token sample(int seq) override { return llama_sampler_sample(samplers[seq], ctx, logit_rows[seq]); }
+
+private:
+    std::string model_path;
+    llama_model* model = nullptr;
+    llama_context* ctx = nullptr;
+    const llama_vocab* vocab = nullptr;
+    llama_batch batch{};
+
+    // Per sequence: sampler, next position, and the batch row holding its logits
+    std::vector<llama_sampler*> samplers;
+    std::vector<size_t> positions;
+    std::vector<int32_t> logit_rows;
+};
+
+}  // namespace
+
+std::unique_ptr<Backend> make_llama_backend(const std::string& model_path, size_t sequences) {
+    return std::make_unique<LlamaBackend>(model_path, sequences);
+}
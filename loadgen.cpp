@@ -0,0 +1,336 @@
+// loadgen.cpp - Open-loop load generator for commitgen-server
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "protocol.h"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+// ANSI color codes
+namespace Color {
+const std::string RESET = "\033[0m";
+const std::string RED = "\033[31m";
+const std::string CYAN = "\033[36m";
+const std::string BOLD = "\033[1m";
+const std::string DIM = "\033[2m";
+}  // namespace Color
+
+void print_status(const std::string& msg) {
+    std::cerr << Color::CYAN << "[" << Color::RESET << "•" << Color::CYAN << "] " << Color::RESET << msg << std::endl;
+}
+
+void print_error(const std::string& msg) {
+    std::cerr << Color::RED << "[✗] " << Color::RESET << msg << std::endl;
+}
+
+struct Options {
+    std::string corpus_dir = "bench/corpus";
+    std::string socket_path = SOCKET_PATH;
+    size_t sessions = 8;
+    double rate = 1.0;  // arrivals per second
+    double duration = 30;  // seconds of arrivals
+    size_t requests = 0;  // stop after this many arrivals instead
+    double timeout = 60;
+    uint64_t seed = 1;
+    bool json = false;
+};
+
+// One scheduled arrival; latency is measured from `due`, not from when a
+// session got around to sending it, so a saturated server shows up as latency
+struct Arrival {
+    Clock::time_point due;
+    size_t diff;
+};
+
+struct Outcome {
+    enum Kind { OK, ERROR, TIMEOUT, CONNECT } kind;
+    double latency_ms = 0;
+    double ttft_ms = 0;
+    double server_queue_ms = 0;
+};
+
+class ArrivalQueue {
+public:
+    void push(Arrival a) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            queue.push_back(a);
+            max_backlog = std::max(max_backlog, queue.size());
+        }
+        cv.notify_one();
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+
+    bool pop(Arrival& a) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return closed || !queue.empty(); });
+        if (queue.empty())
+            return false;
+        a = queue.front();
+        queue.pop_front();
+        return true;
+    }
+
+    size_t backlog_peak() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return max_backlog;
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<Arrival> queue;
+    size_t max_backlog = 0;
+    bool closed = false;
+};
+
+std::vector<std::string> load_diffs(const std::string& dir) {
+    std::vector<std::string> diffs;
+    for (const auto& entry : fs::recursive_directory_iterator(dir)) {
+        if (!entry.is_regular_file())
+            continue;
+        std::ifstream in(entry.path(), std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        diffs.push_back(ss.str());
+    }
+    return diffs;
+}
+
+double ms_since(Clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+// Sends one streamed request over a persistent session; the connection is
+// dropped after a timeout because its late reply would desync the next request
+Outcome send_request(std::unique_ptr<Connection>& conn, const Options& opts, const std::string& diff,
+                     Clock::time_point due) {
+    Outcome out;
+    auto deadline = due + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.timeout));
+    if (Clock::now() >= deadline) {
+        // Expired while waiting for a free session; sending it would only add load
+        out.kind = Outcome::TIMEOUT;
+        return out;
+    }
+    if (!conn) {
+        int fd = connect_server(opts.socket_path);
+        if (fd < 0) {
+            out.kind = Outcome::CONNECT;
+            return out;
+        }
+        conn = std::make_unique<Connection>(fd);
+    }
+
+    Message request;
+    request.type = "generate";
+    request.fields["stream"] = "1";
+    request.body = diff;
+    if (!conn->write(request)) {
+        conn.reset();
+        out.kind = Outcome::ERROR;
+        return out;
+    }
+
+    Message msg;
+    for (;;) {
+        int remaining = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        if (remaining <= 0 || !conn->wait_readable(remaining)) {
+            conn.reset();
+            out.kind = Outcome::TIMEOUT;
+            return out;
+        }
+        if (!conn->read(msg)) {
+            conn.reset();
+            out.kind = Outcome::ERROR;
+            return out;
+        }
+        if (msg.type == "token") {
+            if (out.ttft_ms == 0)
+                out.ttft_ms = ms_since(due);
+            continue;
+        }
+        break;
+    }
+
+    out.latency_ms = ms_since(due);
+    out.server_queue_ms = std::atof(msg.get("queue_ms", "0").c_str());
+    out.kind = msg.get("status") == "ok" ? Outcome::OK : Outcome::ERROR;
+    return out;
+}
+
+void print_report(const Options& opts, const std::vector<Outcome>& outcomes, double wall_seconds,
+                  size_t backlog_peak) {
+    size_t counts[4] = {0, 0, 0, 0};
+    std::vector<double> latency, ttft, queue;
+    for (const auto& o : outcomes) {
+        counts[o.kind]++;
+        if (o.kind != Outcome::OK)
+            continue;
+        latency.push_back(o.latency_ms);
+        if (o.ttft_ms > 0)
+            ttft.push_back(o.ttft_ms);
+        queue.push_back(o.server_queue_ms);
+    }
+    double throughput = wall_seconds > 0 ? counts[Outcome::OK] / wall_seconds : 0;
+    Percentiles lat = percentiles(latency);
+    Percentiles first = percentiles(ttft);
+    Percentiles queued = percentiles(queue);
+
+    if (opts.json) {
+        char head[512];
+        std::snprintf(head, sizeof(head),
+                      "{\"sessions\":%zu,\"rate\":%.6g,\"requests\":%zu,\"ok\":%zu,\"errors\":%zu,\"timeouts\":%zu,"
+                      "\"connect_failures\":%zu,\"wall_seconds\":%.3f,\"throughput\":%.3f,\"backlog_peak\":%zu",
+                      opts.sessions, opts.rate, outcomes.size(), counts[Outcome::OK], counts[Outcome::ERROR],
+                      counts[Outcome::TIMEOUT], counts[Outcome::CONNECT], wall_seconds, throughput, backlog_peak);
+        std::cout << head << ",\"latency_ms\":" << percentiles_json(lat) << ",\"ttft_ms\":" << percentiles_json(first)
+                  << ",\"server_queue_ms\":" << percentiles_json(queued) << "}" << std::endl;
+        return;
+    }
+
+    std::printf("%s%zu requests over %.1fs%s (%.2f req/s offered, %zu sessions)\n", Color::BOLD.c_str(),
+                outcomes.size(), wall_seconds, Color::RESET.c_str(), opts.rate, opts.sessions);
+    std::printf("  ok %zu, errors %zu, timeouts %zu, connect failures %zu\n", counts[Outcome::OK],
+                counts[Outcome::ERROR], counts[Outcome::TIMEOUT], counts[Outcome::CONNECT]);
+    std::printf("  throughput %.2f req/s, client backlog peak %zu\n\n", throughput, backlog_peak);
+    std::printf("  %-14s %9s %9s %9s %9s %9s\n", "MS", "MEAN", "P50", "P95", "P99", "MAX");
+    for (const auto& [label, p] : {std::make_pair("latency", lat), std::make_pair("ttft", first),
+                                   std::make_pair("server queue", queued)}) {
+        std::printf("  %-14s %9.1f %9.1f %9.1f %9.1f %9.1f\n", label, p.mean, p.p50, p.p95, p.p99, p.max);
+    }
+}
+
+void show_usage(const std::string& prog_name) {
+    std::cout << Color::BOLD << "USAGE:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " [options]\n\n";
+    std::cout << Color::BOLD << "OPTIONS:" << Color::RESET << "\n";
+    std::cout << "  --sessions <n>        Concurrent client connections (default 8)\n";
+    std::cout << "  --rate <r>            Mean arrivals per second, Poisson (default 1)\n";
+    std::cout << "  --duration <s>        Seconds of arrivals (default 30)\n";
+    std::cout << "  --requests <n>        Stop after n arrivals instead\n";
+    std::cout << "  --timeout <s>         Per-request timeout from arrival (default 60)\n";
+    std::cout << "  --corpus <dir>        Diffs to send (default bench/corpus)\n";
+    std::cout << "  --seed <n>            Arrival and diff choice seed (default 1)\n";
+    std::cout << "  --socket <path>       Server socket (default " << SOCKET_PATH << ")\n";
+    std::cout << "  --json                Print the report as JSON\n\n";
+    std::cout << Color::BOLD << "EXAMPLES:" << Color::RESET << "\n";
+    std::cout << Color::DIM << "  # 20 developers committing every 10s on average, for a minute" << Color::RESET
+              << "\n";
+    std::cout << "  " << prog_name << " --sessions 20 --rate 2 --duration 60\n\n";
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            show_usage(argv[0]);
+            return 0;
+        } else if (arg == "--sessions" && i + 1 < argc) {
+            opts.sessions = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--rate" && i + 1 < argc) {
+            opts.rate = std::atof(argv[++i]);
+        } else if (arg == "--duration" && i + 1 < argc) {
+            opts.duration = std::atof(argv[++i]);
+        } else if (arg == "--requests" && i + 1 < argc) {
+            opts.requests = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            opts.timeout = std::atof(argv[++i]);
+        } else if (arg == "--corpus" && i + 1 < argc) {
+            opts.corpus_dir = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            opts.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--socket" && i + 1 < argc) {
+            opts.socket_path = argv[++i];
+        } else if (arg == "--json") {
+            opts.json = true;
+        } else {
+            print_error("Unknown option: " + arg);
+            return 1;
+        }
+    }
+    if (opts.rate <= 0) {
+        print_error("--rate must be positive");
+        return 1;
+    }
+
+    std::vector<std::string> diffs;
+    try {
+        diffs = load_diffs(opts.corpus_dir);
+    } catch (const std::exception& e) {
+        print_error(e.what());
+        return 1;
+    }
+    if (diffs.empty()) {
+        print_error("No diffs in " + opts.corpus_dir);
+        return 1;
+    }
+
+    ArrivalQueue arrivals;
+    std::mutex outcomes_mtx;
+    std::vector<Outcome> outcomes;
+
+    std::vector<std::thread> sessions;
+    for (size_t i = 0; i < opts.sessions; i++) {
+        sessions.emplace_back([&] {
+            std::unique_ptr<Connection> conn;
+            Arrival a;
+            while (arrivals.pop(a)) {
+                Outcome o = send_request(conn, opts, diffs[a.diff], a.due);
+                std::lock_guard<std::mutex> lock(outcomes_mtx);
+                outcomes.push_back(o);
+            }
+        });
+    }
+
+    if (!opts.json) {
+        char line[128];
+        std::snprintf(line, sizeof(line), "Offering %.6g req/s over %zu sessions", opts.rate, opts.sessions);
+        print_status(line);
+    }
+
+    // Poisson process: exponential gaps, independent of how the server keeps up
+    std::mt19937_64 rng(opts.seed);
+    std::exponential_distribution<double> gap(opts.rate);
+    auto start = Clock::now();
+    auto due = start;
+    for (size_t n = 0; opts.requests ? n < opts.requests : true; n++) {
+        due += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap(rng)));
+        if (!opts.requests && due - start > std::chrono::duration<double>(opts.duration))
+            break;
+        std::this_thread::sleep_until(due);
+        arrivals.push({due, (size_t)(rng() % diffs.size())});
+    }
+    arrivals.close();
+    for (auto& t : sessions) {
+        t.join();
+    }
+    double wall = std::chrono::duration<double>(Clock::now() - start).count();
+
+    print_report(opts, outcomes, wall, arrivals.backlog_peak());
+    size_t failed = std::count_if(outcomes.begin(), outcomes.end(), [](const Outcome& o) { return o.kind != Outcome::OK; });
+    return failed == 0 ? 0 : 2;
+}
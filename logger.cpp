@@ -0,0 +1,286 @@
+#include "logger.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+#include "json.h"
+
+namespace logger {
+namespace {
+
+// ANSI color codes, matching the rest of the server output
+const char* RESET = "\033[0m";
+const char* RED = "\033[31m";
+const char* GREEN = "\033[32m";
+const char* YELLOW = "\033[33m";
+const char* CYAN = "\033[36m";
+const char* DIM = "\033[2m";
+
+constexpr size_t RING_SLOTS = 1024;  // power of two
+constexpr size_t RECORD_BYTES = 1000;
+
+// One record: event, message, then key/value pairs, each NUL-terminated.
+// seq implements the bounded MPMC queue from Dmitry Vyukov; with one consumer
+// the dequeue side needs no atomics beyond the slot's own sequence.
+struct Slot {
+    std::atomic<size_t> seq{0};
+    Level level;
+    int64_t unix_ms;
+    uint16_t len;
+    char text[RECORD_BYTES];
+};
+
+std::array<Slot, RING_SLOTS> ring;
+std::atomic<size_t> head{0};
+size_t tail = 0;  // consumer only
+
+std::atomic<bool> started{false};
+std::atomic<bool> stopping{false};
+std::atomic<uint64_t> dropped_records{0};
+std::thread flusher;
+Level min_level = Level::Info;
+bool json_output = false;
+
+int64_t now_unix_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// Appends s plus its terminator, truncating the record when it runs out of room
+void put(char* text, uint16_t& len, const char* s, size_t n) {
+    if (len >= RECORD_BYTES)
+        return;
+    size_t room = RECORD_BYTES - len - 1;
+    n = std::min(n, room);
+    std::memcpy(text + len, s, n);
+    len += n;
+    text[len++] = '\0';
+}
+
+const char* level_name(Level level) {
+    switch (level) {
+    case Level::Debug:
+        return "debug";
+    case Level::Info:
+        return "info";
+    case Level::Warn:
+        return "warn";
+    case Level::Error:
+        return "error";
+    }
+    return "info";
+}
+
+std::string format_time(int64_t ms) {
+    time_t seconds = ms / 1000;
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+    char buf[40];
+    size_t n = std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &utc);
+    std::snprintf(buf + n, sizeof(buf) - n, ".%03dZ", (int)(ms % 1000));
+    return buf;
+}
+
+std::string format_human(Level level, const char* event, const char* message, const char* fields, const char* end) {
+    std::string out;
+    if (level == Level::Error) {
+        out = std::string(RED) + "[✗] " + RESET;
+    } else if (level == Level::Warn) {
+        out = std::string(YELLOW) + "[!] " + RESET;
+    } else if (std::strcmp(event, "request") == 0) {
+        out = std::string(YELLOW) + "[→] " + RESET;
+    } else if (std::strcmp(event, "response") == 0) {
+        out = std::string(GREEN) + "[←] " + RESET;
+    } else if (std::strcmp(event, "ok") == 0) {
+        out = std::string(GREEN) + "[✓] " + RESET;
+    } else {
+        out = std::string(CYAN) + "[" + RESET + "•" + CYAN + "] " + RESET;
+    }
+    out += message;
+
+    bool dim = fields < end;
+    if (dim)
+        out += DIM;
+    while (fields < end) {
+        const char* key = fields;
+        const char* value = key + std::strlen(key) + 1;
+        if (value >= end)
+            break;
+        out += std::string(" ") + key + "=" + value;
+        fields = value + std::strlen(value) + 1;
+    }
+    if (dim)
+        out += RESET;
+    out += "\n";
+    return out;
+}
+
+std::string format_json(Level level, int64_t ms, const char* event, const char* message, const char* fields,
+                        const char* end) {
+    std::string out = "{\"ts\":\"" + format_time(ms) + "\",\"level\":\"" + level_name(level)
+                      + "\",\"event\":" + json_string(event) + ",\"msg\":" + json_string(message);
+    while (fields < end) {
+        const char* key = fields;
+        const char* value = key + std::strlen(key) + 1;
+        if (value >= end)
+            break;
+        out += "," + json_string(key) + ":" + json_string(value);
+        fields = value + std::strlen(value) + 1;
+    }
+    out += "}\n";
+    return out;
+}
+
+void emit(Level level, int64_t ms, const char* text, uint16_t len) {
+    const char* end = text + len;
+    const char* event = text;
+    const char* message = event + std::strlen(event) + 1;
+    const char* fields = message < end ? message + std::strlen(message) + 1 : end;
+    if (message >= end)
+        message = "";
+
+    std::string line = json_output ? format_json(level, ms, event, message, fields, end)
+                                   : format_human(level, event, message, fields, end);
+    FILE* stream = level >= Level::Error && !json_output ? stderr : stdout;
+    if (stream == stderr)
+        std::fflush(stdout);  // keep both streams in record order
+    std::fwrite(line.data(), 1, line.size(), stream);
+}
+
+// Consumer side: formats everything published so far
+bool drain() {
+    bool any = false;
+    char text[RECORD_BYTES];
+    for (;;) {
+        Slot& slot = ring[tail & (RING_SLOTS - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != tail + 1)
+            break;
+        Level level = slot.level;
+        int64_t ms = slot.unix_ms;
+        uint16_t len = slot.len;
+        std::memcpy(text, slot.text, len);
+        slot.seq.store(tail + RING_SLOTS, std::memory_order_release);
+        tail++;
+
+        emit(level, ms, text, len);
+        any = true;
+    }
+    return any;
+}
+
+void flush_loop() {
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (drain()) {
+            std::fflush(stdout);
+            std::fflush(stderr);
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+}
+
+}  // namespace
+
+void configure(Level level, bool json) {
+    min_level = level;
+    json_output = json;
+}
+
+void start() {
+    if (started)
+        return;
+    for (size_t i = 0; i < RING_SLOTS; i++) {
+        ring[i].seq.store(i, std::memory_order_relaxed);
+    }
+    head = 0;
+    tail = 0;
+    stopping = false;
+    flusher = std::thread(flush_loop);
+    started = true;
+}
+
+void stop() {
+    if (!started)
+        return;
+    stopping = true;
+    flusher.join();
+    started = false;
+    drain();
+
+    uint64_t lost = dropped_records.exchange(0);
+    if (lost > 0) {
+        write(Level::Warn, "log", "Log ring overflowed", {{"dropped", std::to_string(lost)}});
+    }
+    std::fflush(stdout);
+    std::fflush(stderr);
+}
+
+bool parse_level(const std::string& name, Level& level) {
+    for (Level l : {Level::Debug, Level::Info, Level::Warn, Level::Error}) {
+        if (name == level_name(l)) {
+            level = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+void write(Level level, const char* event, const std::string& message, std::initializer_list<Field> fields) {
+    if (level < min_level)
+        return;
+
+    if (!started.load(std::memory_order_acquire)) {
+        char text[RECORD_BYTES];
+        uint16_t len = 0;
+        put(text, len, event, std::strlen(event));
+        put(text, len, message.data(), message.size());
+        for (const Field& f : fields) {
+            put(text, len, f.key, std::strlen(f.key));
+            put(text, len, f.value.data(), f.value.size());
+        }
+        emit(level, now_unix_ms(), text, len);
+        std::fflush(level >= Level::Error ? stderr : stdout);
+        return;
+    }
+
+    // Claim a slot; a full ring drops the record instead of blocking the caller
+    size_t pos = head.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &ring[pos & (RING_SLOTS - 1)];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            dropped_records.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->unix_ms = now_unix_ms();
+    slot->len = 0;
+    put(slot->text, slot->len, event, std::strlen(event));
+    put(slot->text, slot->len, message.data(), message.size());
+    for (const Field& f : fields) {
+        put(slot->text, slot->len, f.key, std::strlen(f.key));
+        put(slot->text, slot->len, f.value.data(), f.value.size());
+    }
+    slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+uint64_t dropped() {
+    return dropped_records.load(std::memory_order_relaxed);
+}
+
+}  // namespace logger
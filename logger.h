@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+
+// Asynchronous server log. Any thread may write: records go into a bounded
+// lock-free ring and a background thread formats and flushes them, so request
+// threads never block on the terminal. When the ring is full records are
+// dropped and counted rather than stalling the caller. Before start() and after
+// stop() writes are formatted synchronously.
+namespace logger {
+
+enum class Level : uint8_t {
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3,
+};
+
+struct Field {
+    const char* key;
+    std::string value;
+};
+
+// Applies to synchronous writes too, so call it before anything is logged
+void configure(Level min_level, bool json);
+
+// Spawns the flush thread; writes become asynchronous from here on
+void start();
+
+// Drains everything queued so far and joins the flush thread
+void stop();
+
+bool parse_level(const std::string& name, Level& level);
+
+// event names the record type ("request", "response", "ok", ...); in JSON
+// mode every field becomes a key of the record
+void write(Level level, const char* event, const std::string& message, std::initializer_list<Field> fields = {});
+
+uint64_t dropped();
+
+}  // namespace logger
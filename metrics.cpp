@@ -0,0 +1,135 @@
+#include "metrics.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+void Counter::inc(double amount) {
+    std::lock_guard<std::mutex> lock(mtx);
+    total += amount;
+}
+
+double Counter::value() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return total;
+}
+
+Histogram::Histogram(std::vector<double> b) : bounds(std::move(b)), counts(bounds.size(), 0) {}
+
+void Histogram::observe(double value) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = std::lower_bound(bounds.begin(), bounds.end(), value);
+    if (it != bounds.end())
+        counts[it - bounds.begin()]++;
+    count++;
+    sum += value;
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    Snapshot snap;
+    snap.bounds = bounds;
+    snap.counts.resize(counts.size());
+    uint64_t running = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        running += counts[i];
+        snap.counts[i] = running;
+    }
+    snap.count = count;
+    snap.sum = sum;
+    return snap;
+}
+
+std::vector<double> latency_buckets() {
+    return {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+}
+
+std::vector<double> throughput_buckets() {
+    return {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
+}
+
+namespace {
+
+std::string format_value(double value) {
+    if (std::isinf(value))
+        return value > 0 ? "+Inf" : "-Inf";
+    if (std::isnan(value))
+        return "NaN";
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.15g", value);
+    return buf;
+}
+
+}  // namespace
+
+void PromWriter::header(const std::string& name, const std::string& type, const std::string& help) {
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+void PromWriter::sample(const std::string& name, double value, const std::string& labels) {
+    out += name;
+    if (!labels.empty())
+        out += "{" + labels + "}";
+    out += " " + format_value(value) + "\n";
+}
+
+void PromWriter::counter(const std::string& name, const std::string& help, double value) {
+    header(name, "counter", help);
+    sample(name, value);
+}
+
+void PromWriter::gauge(const std::string& name, const std::string& help, double value) {
+    header(name, "gauge", help);
+    sample(name, value);
+}
+
+void PromWriter::histogram(const std::string& name, const std::string& help, const Histogram& hist) {
+    Histogram::Snapshot snap = hist.snapshot();
+    header(name, "histogram", help);
+    for (size_t i = 0; i < snap.bounds.size(); i++) {
+        sample(name + "_bucket", snap.counts[i], "le=\"" + format_value(snap.bounds[i]) + "\"");
+    }
+    sample(name + "_bucket", snap.count, "le=\"+Inf\"");
+    sample(name + "_sum", snap.sum);
+    sample(name + "_count", snap.count);
+}
+
+std::string prom_label(const std::string& value) {
+    std::string out;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+size_t resident_memory_bytes() {
+#ifdef __APPLE__
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+        return info.resident_size;
+    return 0;
+#else
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    if (statm >> pages >> resident)
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return 0;
+#endif
+}
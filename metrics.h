@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Counter {
+public:
+    void inc(double amount = 1.0);
+    double value() const;
+
+private:
+    mutable std::mutex mtx;
+    double total = 0;
+};
+
+class Gauge {
+public:
+    void set(double v) { current.store(v); }
+    double value() const { return current.load(); }
+
+private:
+    std::atomic<double> current{0};
+};
+
+// Cumulative histogram with fixed upper bounds, as Prometheus expects
+class Histogram {
+public:
+    explicit Histogram(std::vector<double> bounds);
+
+    void observe(double value);
+
+    struct Snapshot {
+        std::vector<double> bounds;
+        std::vector<uint64_t> counts;  // cumulative, one per bound
+        uint64_t count = 0;
+        double sum = 0;
+    };
+    Snapshot snapshot() const;
+
+private:
+    mutable std::mutex mtx;
+    std::vector<double> bounds;
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+    double sum = 0;
+};
+
+// Bucket presets
+std::vector<double> latency_buckets();
+std::vector<double> throughput_buckets();
+
+// Builds a Prometheus text-format (0.0.4) exposition
+class PromWriter {
+public:
+    void header(const std::string& name, const std::string& type, const std::string& help);
+    void sample(const std::string& name, double value, const std::string& labels = "");
+
+    void counter(const std::string& name, const std::string& help, double value);
+    void gauge(const std::string& name, const std::string& help, double value);
+    void histogram(const std::string& name, const std::string& help, const Histogram& hist);
+
+    const std::string& str() const { return out; }
+
+private:
+    std::string out;
+};
+
+// Escapes a label value for use inside label="..."
+std::string prom_label(const std::string& value);
+
+// Resident set size of this process, 0 if unknown
+size_t resident_memory_bytes();
@@ -0,0 +1,301 @@
+// microbench.cpp - Throughput of the string handling on the diff path
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_util.h"
+#include "commitgen.h"
+#include "difffilter.h"
+#include "json.h"
+#include "text_util.h"
+
+// ANSI color codes
+namespace Color {
+const std::string RESET = "\033[0m";
+const std::string RED = "\033[31m";
+const std::string CYAN = "\033[36m";
+const std::string BOLD = "\033[1m";
+const std::string DIM = "\033[2m";
+}  // namespace Color
+
+void print_status(const std::string& msg) {
+    std::cerr << Color::CYAN << "[" << Color::RESET << "•" << Color::CYAN << "] " << Color::RESET << msg << std::endl;
+}
+
+void print_error(const std::string& msg) {
+    std::cerr << Color::RED << "[✗] " << Color::RESET << msg << std::endl;
+}
+
+struct Options {
+    size_t max_size = 50 << 20;
+    double min_time = 0.2;  // seconds per case and size
+    std::string filter;
+    bool json = false;
+};
+
+const size_t SIZES[] = {1 << 10, 16 << 10, 256 << 10, 4 << 20, 50 << 20};
+
+// Kinds of synthetic input
+enum Input { DIFF, NAMES, PROSE };
+
+// One measured operation; returns something derived from the result so the
+// work can't be optimized away
+struct Case {
+    const char* name;
+    Input input;
+    std::function<size_t(const std::string&)> run;
+};
+
+// Everything on the path from `git diff` output to the model prompt
+std::vector<Case> cases() {
+    return {
+        {"read_all", DIFF,
+         [](const std::string& text) {
+             FILE* f = fmemopen(const_cast<char*>(text.data()), text.size(), "r");
+             std::string out = read_all(f);
+             fclose(f);
+             return out.size();
+         }},
+        {"split_lines", NAMES, [](const std::string& text) { return split_lines(text).size(); }},
+        // Includes the copy the server makes of the request body
+        {"trim_right", DIFF,
+         [](const std::string& text) {
+             std::string copy = text;
+             trim_right(copy, "\n ");
+             return copy.size();
+         }},
+        // A real diff matches at offset 0; text without markers is the worst case
+        {"looks_like_diff", PROSE, [](const std::string& text) { return (size_t)looks_like_diff(text); }},
+        {"build_prompt", DIFF, [](const std::string& text) { return build_prompt(text).size(); }},
+        // Built-in rules on a diff they all keep: every file and changed line is checked
+        {"diff_filter", DIFF, [](const std::string& text) { return DiffFilter().apply(text).size(); }},
+    };
+}
+
+const char* const WORDS[] = {"int",    "return", "const",  "std::string", "auto",  "if",     "for",
+                             "size_t", "value",  "result", "buffer",      "count", "config", "=",
+                             "+",      "(",      ")",      "{",           "}",     ";",      "->"};
+
+std::string random_words(std::mt19937_64& rng, size_t n) {
+    std::string line;
+    for (size_t i = 0; i < n; i++) {
+        if (i)
+            line += ' ';
+        line += WORDS[rng() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+    }
+    return line;
+}
+
+// Unified diff of roughly `bytes` bytes: file headers, hunks of context,
+// added and removed lines, some with trailing whitespace, and the trailing
+// newlines git leaves behind
+std::string make_diff(size_t bytes, std::mt19937_64& rng) {
+    std::string diff;
+    diff.reserve(bytes + 256);
+    for (size_t file = 0; diff.size() < bytes; file++) {
+        std::string path = "src/module_" + std::to_string(file % 17) + "/file_" + std::to_string(file) + ".cpp";
+        diff += "diff --git a/" + path + " b/" + path + "\nindex 3f2a1c4..9b8e7d6 100644\n--- a/" + path
+                + "\n+++ b/" + path + "\n";
+        for (int hunk = 0; hunk < 4 && diff.size() < bytes; hunk++) {
+            int line = 10 + hunk * 40;
+            diff += "@@ -" + std::to_string(line) + ",12 +" + std::to_string(line) + ",13 @@\n";
+            for (int i = 0; i < 13 && diff.size() < bytes; i++) {
+                char mark = i < 3 || i > 9 ? ' ' : (i % 2 ? '-' : '+');
+                diff += mark;
+                diff += "    " + random_words(rng, 3 + rng() % 8);
+                if (rng() % 8 == 0)
+                    diff += "  ";
+                diff += '\n';
+            }
+        }
+    }
+    diff.resize(bytes - 3);
+    diff += "\n \n";
+    return diff;
+}
+
+// `git diff --name-only` output
+std::string make_names(size_t bytes, std::mt19937_64& rng) {
+    std::string names;
+    names.reserve(bytes + 64);
+    while (names.size() < bytes) {
+        names += "src/module_" + std::to_string(rng() % 100) + "/file_" + std::to_string(rng() % 10000) + ".cpp\n";
+    }
+    return names.substr(0, bytes);
+}
+
+// Text with no diff markers, the worst case for sniffing
+std::string make_prose(size_t bytes, std::mt19937_64& rng) {
+    std::string prose;
+    prose.reserve(bytes + 256);
+    while (prose.size() < bytes) {
+        prose += random_words(rng, 12) + '\n';
+    }
+    return prose.substr(0, bytes);
+}
+
+struct Result {
+    size_t bytes = 0;
+    size_t iterations = 0;
+    double mb_per_second = 0;  // median over iterations
+};
+
+Result measure(const Case& c, const std::string& input, double min_time) {
+    using Clock = std::chrono::steady_clock;
+    static volatile size_t sink;
+    std::vector<double> rates;
+    auto start = Clock::now();
+    do {
+        auto t0 = Clock::now();
+        sink = sink + c.run(input);
+        double seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+        rates.push_back(input.size() / 1e6 / std::max(seconds, 1e-9));
+    } while (rates.size() < 3 || std::chrono::duration<double>(Clock::now() - start).count() < min_time);
+
+    Result r;
+    r.bytes = input.size();
+    r.iterations = rates.size();
+    r.mb_per_second = percentiles(rates).p50;
+    return r;
+}
+
+std::string size_label(size_t bytes) {
+    if (bytes >= (1 << 20))
+        return std::to_string(bytes >> 20) + " MB";
+    return std::to_string(bytes >> 10) + " KB";
+}
+
+// Accepts plain bytes or a K/M suffix
+bool parse_size(const std::string& text, size_t& out) {
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || value <= 0)
+        return false;
+    if (*end == 'K' || *end == 'k')
+        value *= 1 << 10;
+    else if (*end == 'M' || *end == 'm')
+        value *= 1 << 20;
+    else if (*end != '\0')
+        return false;
+    out = (size_t)value;
+    return true;
+}
+
+void print_table(const std::vector<std::pair<std::string, std::vector<Result>>>& results, size_t columns) {
+    std::printf("%s%-22s", Color::BOLD.c_str(), "MB/s");
+    for (size_t i = 0; i < columns; i++) {
+        std::printf(" %10s", size_label(SIZES[i]).c_str());
+    }
+    std::printf("%s\n", Color::RESET.c_str());
+    for (const auto& [name, row] : results) {
+        std::printf("%-22s", name.c_str());
+        for (const auto& r : row) {
+            std::printf(" %10.0f", r.mb_per_second);
+        }
+        std::printf("\n");
+    }
+}
+
+void print_json(const Options& opts, const std::vector<std::pair<std::string, std::vector<Result>>>& results) {
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "{\"min_time\":%.6g,\"cases\":{", opts.min_time);
+    std::string out = buf;
+    bool first_case = true;
+    for (const auto& [name, row] : results) {
+        out += std::string(first_case ? "" : ",") + json_string(name) + ":[";
+        first_case = false;
+        for (size_t i = 0; i < row.size(); i++) {
+            std::snprintf(buf, sizeof(buf), "%s{\"bytes\":%zu,\"iterations\":%zu,\"mb_per_second\":%.1f}",
+                          i ? "," : "", row[i].bytes, row[i].iterations, row[i].mb_per_second);
+            out += buf;
+        }
+        out += "]";
+    }
+    out += "}}";
+    std::cout << out << std::endl;
+}
+
+void show_usage(const std::string& prog_name) {
+    std::cout << Color::BOLD << "USAGE:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " [options]\n\n";
+    std::cout << Color::BOLD << "OPTIONS:" << Color::RESET << "\n";
+    std::cout << "  --max-size <bytes>    Largest input, K/M suffixes allowed (default 50M)\n";
+    std::cout << "  --min-time <seconds>  Time spent per case and size (default 0.2)\n";
+    std::cout << "  --filter <text>       Only cases whose name contains text\n";
+    std::cout << "  --json                Print results as JSON\n\n";
+    std::cout << Color::BOLD << "EXAMPLES:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << "\n";
+    std::cout << "  " << prog_name << " --filter split --max-size 4M\n";
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            show_usage(argv[0]);
+            return 0;
+        } else if (arg == "--max-size" && i + 1 < argc) {
+            if (!parse_size(argv[++i], opts.max_size)) {
+                print_error("Invalid size: " + std::string(argv[i]));
+                return 1;
+            }
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            opts.min_time = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--filter" && i + 1 < argc) {
+            opts.filter = argv[++i];
+        } else if (arg == "--json") {
+            opts.json = true;
+        } else {
+            print_error("Unknown option: " + arg);
+            return 1;
+        }
+    }
+
+    size_t columns = 0;
+    while (columns < sizeof(SIZES) / sizeof(SIZES[0]) && SIZES[columns] <= opts.max_size) {
+        columns++;
+    }
+    if (columns == 0) {
+        print_error("--max-size is below the smallest input (1 KB)");
+        return 1;
+    }
+
+    std::vector<std::pair<std::string, std::vector<Result>>> results;
+    std::map<std::pair<Input, size_t>, std::string> inputs;
+    std::mt19937_64 rng(1);
+    for (const Case& c : cases()) {
+        if (!opts.filter.empty() && std::string(c.name).find(opts.filter) == std::string::npos)
+            continue;
+        print_status(c.name);
+        std::vector<Result> row;
+        for (size_t i = 0; i < columns; i++) {
+            std::string& input = inputs[{c.input, SIZES[i]}];
+            if (input.empty()) {
+                input = c.input == DIFF    ? make_diff(SIZES[i], rng)
+                        : c.input == NAMES ? make_names(SIZES[i], rng)
+                                           : make_prose(SIZES[i], rng);
+            }
+            row.push_back(measure(c, input, opts.min_time));
+        }
+        results.emplace_back(c.name, row);
+    }
+    if (results.empty()) {
+        print_error("No case matches " + opts.filter);
+        return 1;
+    }
+
+    if (opts.json)
+        print_json(opts, results);
+    else
+        print_table(results, columns);
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include "backend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+// Mock backend: no model, deterministic output, configurable speed. Options
+// follow "mock:" as comma-separated key=value pairs:
+//
+//   prefill=<tok/s>  prompt evaluation speed (default 1000, 0 = instant)
+//   decode=<tok/s>   generation speed (default 50, 0 = instant)
+//   tokens=<n>       tokens per message (default 32)
+//   ctx=<n>          context size per sequence (default 4096)
+//   batch=<n>        batch size (default 512)
+//   load=<seconds>   simulated model load time (default 0)
+//   seed=<n>         varies the messages (default 42)
+//
+// Prompts are cut into 4-byte tokens, so prefix reuse behaves like a real
+// tokenizer on a shared system prompt. The message depends only on the
+// prompt and seed. Like a memory-bound GPU, a decode call costs one token's
+// time however many sequences it advances, plus the prompt tokens it carries.
+namespace {
+
+constexpr Token EOG = 0;
+constexpr Token BOS = 1;
+constexpr Token FIRST_WORD = 2;
+constexpr Token FIRST_PROMPT_TOKEN = 1000;
+constexpr size_t SUMMARY_WORDS = 6;
+
+const char* const WORDS[] = {
+    "\n",      " the",    " server", " client", " request", " queue",  " cache",  " diff",   " message",
+    " commit", " update", " handle", " error",  " socket",  " thread", " config", " output", " input",
+    " model",  " token",  " and",    " for",    " with",    " when",   " now",    " to",     " in",
+};
+constexpr size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+// First words of the summary line and of the body
+constexpr Token SUMMARY_START = FIRST_WORD + (Token)WORD_COUNT;
+constexpr Token BODY_START = SUMMARY_START + 1;
+
+uint64_t fnv1a(const void* data, size_t n, uint64_t hash = 1469598103934665603ull) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < n; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+class MockBackend : public Backend {
+public:
+    MockBackend(const std::string& options, size_t sequences) : sequences(std::max<size_t>(sequences, 1)) {
+        size_t pos = 0;
+        while (pos < options.size()) {
+            size_t end = options.find(',', pos);
+            if (end == std::string::npos)
+                end = options.size();
+            std::string item = options.substr(pos, end - pos);
+            pos = end + 1;
+            if (item.empty())
+                continue;
+
+            size_t eq = item.find('=');
+            if (eq == std::string::npos)
+                throw std::runtime_error("Invalid mock option: " + item);
+            std::string key = item.substr(0, eq);
+            double value = std::atof(item.c_str() + eq + 1);
+            if (key == "prefill")
+                prefill_rate = value;
+            else if (key == "decode")
+                decode_rate = value;
+            else if (key == "tokens")
+                max_tokens = (size_t)value;
+            else if (key == "ctx")
+                ctx = (size_t)value;
+            else if (key == "batch")
+                batch = std::max<size_t>((size_t)value, 1);
+            else if (key == "load")
+                load_seconds = value;
+            else if (key == "seed")
+                seed = (uint64_t)value;
+            else
+                throw std::runtime_error("Unknown mock option: " + key);
+        }
+    }
+
+    bool load() override {
+        delay(load_seconds);
+        return true;
+    }
+
+    std::vector<Token> tokenize(const std::string& text) override {
+        std::vector<Token> tokens = {BOS};
+        for (size_t i = 0; i < text.size(); i += 4) {
+            size_t n = std::min<size_t>(4, text.size() - i);
+            tokens.push_back(FIRST_PROMPT_TOKEN + (Token)(fnv1a(text.data() + i, n) % 1000000));
+        }
+        return tokens;
+    }
+
+    std::string token_to_piece(Token token) override {
+        if (token >= FIRST_WORD && token < FIRST_WORD + (Token)WORD_COUNT)
+            return WORDS[token - FIRST_WORD];
+        if (token == SUMMARY_START)
+            return "Update";
+        if (token == BODY_START)
+            return "The";
+        return "";
+    }
+
+    bool is_eog(Token token) override { return token == EOG; }
+
+    bool truncate(int seq, size_t pos) override {
+        std::vector<Token>& tokens = sequences[seq].tokens;
+        if (pos < tokens.size())
+            tokens.resize(pos);
+        return true;
+    }
+
+    bool decode(const std::vector<SequenceTokens>& batch_tokens) override {
+        size_t total = 0;
+        size_t prompt = 0;
+        bool step = false;
+        for (const auto& entry : batch_tokens) {
+            if (entry.n == 0 || sequences[entry.seq].tokens.size() + entry.n > ctx)
+                return false;
+            total += entry.n;
+            if (entry.n > 1)
+                prompt += entry.n;
+            else
+                step = true;
+        }
+        if (total == 0 || total > batch)
+            return false;
+        for (const auto& entry : batch_tokens) {
+            std::vector<Token>& tokens = sequences[entry.seq].tokens;
+            tokens.insert(tokens.end(), entry.tokens, entry.tokens + entry.n);
+        }
+        delay(prompt / prefill_rate + (step ? 1 / decode_rate : 0));
+        return true;
+    }
+
+    size_t max_sequences() const override { return sequences.size(); }
+
+    size_t batch_size() const override { return batch; }
+
+    size_t context_size() const override { return ctx; }
+
+    void reset_sampler(int seq) override { sequences[seq].generated = 0; }
+
+    // A summary line of SUMMARY_WORDS words, a blank line, then a body
+    Token sample(int seq) override {
+        Sequence& s = sequences[seq];
+        if (s.generated == 0)
+            s.rng.seed(fnv1a(s.tokens.data(), s.tokens.size() * sizeof(Token), seed));
+        if (s.generated >= max_tokens)
+            return EOG;
+
+        size_t i = s.generated++;
+        if (i == 0)
+            return SUMMARY_START;
+        if (i == SUMMARY_WORDS + 1 || i == SUMMARY_WORDS + 2)
+            return FIRST_WORD;
+        if (i == SUMMARY_WORDS + 3)
+            return BODY_START;
+        return FIRST_WORD + 1 + (Token)(s.rng() % (WORD_COUNT - 1));
+    }
+
+private:
+    static void delay(double seconds) {
+        if (seconds > 0 && seconds < 1e6)
+            std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    }
+
+    double prefill_rate = 1000;
+    double decode_rate = 50;
+    size_t max_tokens = 32;
+    size_t ctx = 4096;
+    size_t batch = 512;
+    double load_seconds = 0;
+    uint64_t seed = 42;
+
+    struct Sequence {
+        std::vector<Token> tokens;
+        size_t generated = 0;
+        std::mt19937_64 rng;
+    };
+    std::vector<Sequence> sequences;
+};
+
+}  // namespace
+
+std::unique_ptr<Backend> make_mock_backend(const std::string& options, size_t sequences) {
+    return std::make_unique<MockBackend>(options, sequences);
+}
@@ -0,0 +1,308 @@
+// perfcmp.cpp - Compares benchmark JSON against a baseline with per-metric tolerances
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "json.h"
+
+// ANSI color codes
+namespace Color {
+const std::string RESET = "\033[0m";
+const std::string RED = "\033[31m";
+const std::string GREEN = "\033[32m";
+const std::string YELLOW = "\033[33m";
+const std::string CYAN = "\033[36m";
+const std::string BOLD = "\033[1m";
+const std::string DIM = "\033[2m";
+}  // namespace Color
+
+void print_error(const std::string& msg) {
+    std::cerr << Color::RED << "[✗] " << Color::RESET << msg << std::endl;
+}
+
+void print_warning(const std::string& msg) {
+    std::cerr << Color::YELLOW << "[!] " << Color::RESET << msg << std::endl;
+}
+
+struct Options {
+    std::string baseline_file;
+    std::string current_file;
+    std::string tolerances_file = "bench/tolerances.json";
+};
+
+// How far a metric may move before it counts as a regression. A change is
+// allowed up to |baseline| * tolerance + slack in the bad direction.
+struct Rule {
+    std::string pattern;  // dotted path, "*" matches one segment
+    enum Better { LOWER, HIGHER, EQUAL } better = LOWER;
+    double tolerance = 0;
+    double slack = 0;
+};
+
+struct Row {
+    std::string metric;
+    double baseline = 0;
+    double current = 0;
+    const Rule* rule = nullptr;
+    bool missing = false;
+    enum Verdict { OK, IMPROVED, REGRESSED } verdict = OK;
+};
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Cannot read " + path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+JsonValue load_json(const std::string& path) {
+    try {
+        return json_parse(read_file(path));
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error(path + ": " + e.what());
+    }
+}
+
+// Numeric leaves as "a.b.c" -> value; array elements are indexed by position
+void flatten(const JsonValue& value, const std::string& prefix, std::map<std::string, double>& out) {
+    if (value.type == JsonValue::Number) {
+        out[prefix] = value.number;
+    } else if (value.type == JsonValue::Object) {
+        for (const auto& [key, child] : value.object) {
+            flatten(child, prefix.empty() ? key : prefix + "." + key, out);
+        }
+    } else if (value.type == JsonValue::Array) {
+        for (size_t i = 0; i < value.array.size(); i++) {
+            flatten(value.array[i], prefix + "." + std::to_string(i), out);
+        }
+    }
+}
+
+bool matches(const std::string& pattern, const std::string& path) {
+    size_t p = 0, q = 0;
+    while (p <= pattern.size() && q <= path.size()) {
+        size_t pe = pattern.find('.', p);
+        size_t qe = path.find('.', q);
+        if (pe == std::string::npos)
+            pe = pattern.size();
+        if (qe == std::string::npos)
+            qe = path.size();
+        std::string seg = pattern.substr(p, pe - p);
+        if (seg != "*" && seg != path.substr(q, qe - q))
+            return false;
+        bool pattern_done = pe == pattern.size();
+        bool path_done = qe == path.size();
+        if (pattern_done || path_done)
+            return pattern_done && path_done;
+        p = pe + 1;
+        q = qe + 1;
+    }
+    return false;
+}
+
+// {"metrics": {"<pattern>": {"better": "lower|higher|equal", "tolerance": 0.1, "slack": 1}}}
+std::vector<Rule> load_rules(const std::string& path) {
+    JsonValue doc = load_json(path);
+    const JsonValue* metrics = doc.get("metrics");
+    if (!metrics || metrics->type != JsonValue::Object)
+        throw std::runtime_error(path + ": expected a \"metrics\" object");
+
+    std::vector<Rule> rules;
+    for (const auto& [pattern, spec] : metrics->object) {
+        Rule rule;
+        rule.pattern = pattern;
+        if (const JsonValue* better = spec.get("better")) {
+            if (better->string == "lower")
+                rule.better = Rule::LOWER;
+            else if (better->string == "higher")
+                rule.better = Rule::HIGHER;
+            else if (better->string == "equal")
+                rule.better = Rule::EQUAL;
+            else
+                throw std::runtime_error(path + ": " + pattern + ": \"better\" must be lower, higher or equal");
+        }
+        if (const JsonValue* tolerance = spec.get("tolerance"))
+            rule.tolerance = tolerance->number;
+        if (const JsonValue* slack = spec.get("slack"))
+            rule.slack = slack->number;
+        rules.push_back(rule);
+    }
+    return rules;
+}
+
+Row::Verdict judge(const Rule& rule, double baseline, double current) {
+    double allowed = std::fabs(baseline) * rule.tolerance + rule.slack;
+    double delta = current - baseline;
+    switch (rule.better) {
+        case Rule::LOWER:
+            return delta > allowed ? Row::REGRESSED : (delta < -allowed ? Row::IMPROVED : Row::OK);
+        case Rule::HIGHER:
+            return delta < -allowed ? Row::REGRESSED : (delta > allowed ? Row::IMPROVED : Row::OK);
+        case Rule::EQUAL:
+            return std::fabs(delta) > allowed ? Row::REGRESSED : Row::OK;
+    }
+    return Row::OK;
+}
+
+std::string format_value(double v) {
+    char buf[32];
+    if (v == std::floor(v) && std::fabs(v) < 1e15)
+        std::snprintf(buf, sizeof(buf), "%.0f", v);
+    else
+        std::snprintf(buf, sizeof(buf), "%.6g", v);
+    return buf;
+}
+
+std::string format_limit(const Rule& rule) {
+    char buf[48];
+    const char* sign = rule.better == Rule::LOWER ? "+" : (rule.better == Rule::HIGHER ? "-" : "±");
+    if (rule.slack > 0)
+        std::snprintf(buf, sizeof(buf), "%s%.0f%% %s%.6g", sign, rule.tolerance * 100, sign, rule.slack);
+    else
+        std::snprintf(buf, sizeof(buf), "%s%.0f%%", sign, rule.tolerance * 100);
+    return buf;
+}
+
+void print_table(const std::vector<Row>& rows) {
+    size_t width = 6;
+    for (const auto& row : rows) {
+        width = std::max(width, row.metric.size());
+    }
+    std::printf("%s%-*s %12s %12s %9s %12s  %s%s\n", Color::BOLD.c_str(), (int)width, "METRIC", "BASELINE", "CURRENT",
+                "CHANGE", "LIMIT", "RESULT", Color::RESET.c_str());
+    for (const auto& row : rows) {
+        std::string current = row.missing ? "-" : format_value(row.current);
+        std::string change = "-";
+        if (!row.missing && row.baseline != 0) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%+.1f%%", (row.current - row.baseline) / std::fabs(row.baseline) * 100);
+            change = buf;
+        }
+        std::string result;
+        if (row.missing)
+            result = Color::RED + "missing" + Color::RESET;
+        else if (row.verdict == Row::REGRESSED)
+            result = Color::RED + "REGRESSED" + Color::RESET;
+        else if (row.verdict == Row::IMPROVED)
+            result = Color::GREEN + "improved" + Color::RESET;
+        else
+            result = Color::DIM + "ok" + Color::RESET;
+        std::printf("%-*s %12s %12s %9s %12s  %s\n", (int)width, row.metric.c_str(), format_value(row.baseline).c_str(),
+                    current.c_str(), change.c_str(), format_limit(*row.rule).c_str(), result.c_str());
+    }
+}
+
+void show_usage(const std::string& prog_name) {
+    std::cout << Color::BOLD << "USAGE:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " <baseline.json> <current.json> [options]\n\n";
+    std::cout << Color::BOLD << "OPTIONS:" << Color::RESET << "\n";
+    std::cout << "  --tolerances <file>   Metrics to gate and how far they may move\n";
+    std::cout << "                        (default bench/tolerances.json)\n\n";
+    std::cout << "Exits 2 if any gated metric regressed or is missing from the current run.\n\n";
+    std::cout << Color::BOLD << "EXAMPLES:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " bench/baseline.json build/perf_current.json\n";
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            show_usage(argv[0]);
+            return 0;
+        } else if (arg == "--tolerances" && i + 1 < argc) {
+            opts.tolerances_file = argv[++i];
+        } else if (arg[0] != '-') {
+            positional.push_back(arg);
+        } else {
+            print_error("Unknown option: " + arg);
+            return 1;
+        }
+    }
+    if (positional.size() != 2) {
+        show_usage(argv[0]);
+        return 1;
+    }
+    opts.baseline_file = positional[0];
+    opts.current_file = positional[1];
+
+    try {
+        std::vector<Rule> rules = load_rules(opts.tolerances_file);
+        JsonValue baseline_doc = load_json(opts.baseline_file);
+        JsonValue current_doc = load_json(opts.current_file);
+
+        // Numbers from different setups aren't comparable
+        const JsonValue* base_model = baseline_doc.get("model");
+        const JsonValue* cur_model = current_doc.get("model");
+        if (base_model && cur_model && base_model->string != cur_model->string) {
+            print_error("Baseline was measured with " + base_model->string + ", current run with "
+                        + cur_model->string);
+            return 1;
+        }
+
+        std::map<std::string, double> baseline, current;
+        flatten(baseline_doc, "", baseline);
+        flatten(current_doc, "", current);
+
+        // First matching rule wins, so specific patterns go before wildcards
+        std::vector<Row> rows;
+        std::vector<bool> used(rules.size(), false);
+        for (const auto& [metric, value] : baseline) {
+            for (size_t i = 0; i < rules.size(); i++) {
+                if (!matches(rules[i].pattern, metric))
+                    continue;
+                used[i] = true;
+                Row row;
+                row.metric = metric;
+                row.baseline = value;
+                row.rule = &rules[i];
+                auto it = current.find(metric);
+                if (it == current.end()) {
+                    row.missing = true;
+                } else {
+                    row.current = it->second;
+                    row.verdict = judge(rules[i], value, it->second);
+                }
+                rows.push_back(row);
+                break;
+            }
+        }
+        for (size_t i = 0; i < rules.size(); i++) {
+            if (!used[i])
+                print_warning("No baseline metric matches " + rules[i].pattern);
+        }
+
+        print_table(rows);
+
+        size_t regressed = 0, improved = 0;
+        for (const auto& row : rows) {
+            if (row.missing || row.verdict == Row::REGRESSED)
+                regressed++;
+            else if (row.verdict == Row::IMPROVED)
+                improved++;
+        }
+        std::printf("\n");
+        if (regressed) {
+            std::printf("%s%zu of %zu metrics regressed%s\n", Color::RED.c_str(), regressed, rows.size(),
+                        Color::RESET.c_str());
+            return 2;
+        }
+        std::printf("%s%zu metrics within tolerance%s", Color::GREEN.c_str(), rows.size(), Color::RESET.c_str());
+        if (improved)
+            std::printf(", %zu improved beyond it; consider refreshing the baseline", improved);
+        std::printf("\n");
+    } catch (const std::exception& e) {
+        print_error(e.what());
+        return 1;
+    }
+    return 0;
+}
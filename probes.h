@@ -0,0 +1,36 @@
+#pragma once
+// USDT static probes under the "commitgen" provider, for bpftrace, perf and
+// systemtap. Each probe compiles to a single nop plus an ELF note, so they cost
+// nothing until a tracer attaches. Built in whenever <sys/sdt.h> is available
+// (systemtap-sdt-dev / systemtap-sdt-devel) unless COMMITGEN_NO_USDT is set.
+//
+//   request__accept   (request, diff_bytes, uid)
+//   request__dequeue  (request, queue_us)
+//   tokenize__start   (request, prompt_bytes)
+//   tokenize__end     (request, prompt_tokens)
+//   prefill__chunk    (request, chunk_tokens, pos)
+//   decode__step      (request, step, pos)
+//   sample            (request, token, step)
+//   response__write   (request, bytes)
+
+#if !defined(COMMITGEN_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define COMMITGEN_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef COMMITGEN_HAVE_USDT
+#define CG_PROBE2(name, a, b) DTRACE_PROBE2(commitgen, name, a, b)
+#define CG_PROBE3(name, a, b, c) DTRACE_PROBE3(commitgen, name, a, b, c)
+#else
+// sizeof keeps the arguments referenced without evaluating them
+#define CG_PROBE2(name, a, b)   \
+    do {                        \
+        (void)sizeof((a), (b)); \
+    } while (0)
+#define CG_PROBE3(name, a, b, c)     \
+    do {                             \
+        (void)sizeof((a), (b), (c)); \
+    } while (0)
+#endif
@@ -0,0 +1,217 @@
+#include "protocol.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr size_t MAX_HEADER_BYTES = 64 * 1024;
+constexpr size_t MAX_BODY_BYTES = 256 * 1024 * 1024;
+
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+std::string sanitize_field(const std::string& value) {
+    std::string out = value;
+    for (char& c : out) {
+        if (c == '\n' || c == '\r')
+            c = ' ';
+    }
+    return out;
+}
+
+}  // namespace
+
+std::string Message::get(const std::string& key, const std::string& fallback) const {
+    auto it = fields.find(key);
+    return it == fields.end() ? fallback : it->second;
+}
+
+std::string encode_message(const Message& msg) {
+    std::string out = msg.type + "\n";
+    for (const auto& [key, value] : msg.fields) {
+        if (key == "length")
+            continue;
+        out += key + ": " + sanitize_field(value) + "\n";
+    }
+    out += "length: " + std::to_string(msg.body.size()) + "\n\n";
+    out += msg.body;
+    return out;
+}
+
+Connection::Connection(int fd) : sock(fd) {}
+
+Connection::~Connection() {
+    if (sock >= 0)
+        close(sock);
+}
+
+bool Connection::fill() {
+    char chunk[64 * 1024];
+    ssize_t n;
+    do {
+        n = ::read(sock, chunk, sizeof(chunk));
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0)
+        return false;
+    buffer.append(chunk, n);
+    return true;
+}
+
+bool Connection::read(Message& msg) {
+    size_t header_end;
+    while ((header_end = buffer.find("\n\n")) == std::string::npos) {
+        if (buffer.size() > MAX_HEADER_BYTES || !fill())
+            return false;
+    }
+
+    msg = Message();
+    size_t length = 0;
+    size_t pos = 0;
+    bool first = true;
+    while (pos < header_end) {
+        size_t eol = buffer.find('\n', pos);
+        std::string line = buffer.substr(pos, eol - pos);
+        pos = eol + 1;
+
+        if (first) {
+            msg.type = line;
+            first = false;
+            continue;
+        }
+
+        size_t colon = line.find(": ");
+        if (colon == std::string::npos)
+            return false;
+        std::string key = line.substr(0, colon);
+        std::string value = line.substr(colon + 2);
+        if (key == "length") {
+            length = std::strtoull(value.c_str(), nullptr, 10);
+        } else {
+            msg.fields[key] = value;
+        }
+    }
+
+    if (msg.type.empty() || length > MAX_BODY_BYTES)
+        return false;
+
+    buffer.erase(0, header_end + 2);
+    while (buffer.size() < length) {
+        if (!fill())
+            return false;
+    }
+
+    if (buffer.size() == length) {
+        msg.body = std::move(buffer);
+        buffer.clear();
+    } else {
+        msg.body = buffer.substr(0, length);
+        buffer.erase(0, length);
+    }
+    return true;
+}
+
+bool Connection::write(const Message& msg) {
+    std::string data = encode_message(msg);
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(sock, data.data() + sent, data.size() - sent, SEND_FLAGS);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+bool Connection::wait_readable(int timeout_ms) {
+    if (!buffer.empty())
+        return true;
+
+    struct pollfd pfd = {sock, POLLIN, 0};
+    int ret;
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    return ret > 0;
+}
+
+bool get_peer_credentials(int fd, PeerCredentials& creds) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+        return false;
+    creds.pid = cred.pid;
+    creds.uid = cred.uid;
+    creds.gid = cred.gid;
+    return true;
+#else
+    return getpeereid(fd, &creds.uid, &creds.gid) == 0;
+#endif
+}
+
+int connect_server(const std::string& path) {
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int listen_server(const std::string& path) {
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path too long: " + path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0
+        || listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error("Failed to listen on " + path + ": " + std::strerror(err));
+    }
+
+    // Any local user may connect; identity comes from the peer credentials
+    chmod(path.c_str(), 0666);
+    return fd;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+
+// Unix socket shared by the server and its clients
+const std::string SOCKET_PATH = "/tmp/commitgen.sock";
+
+// One framed message: a type line, "key: value" fields, a blank line, then the body.
+// The body length travels in the reserved "length" field.
+struct Message {
+    std::string type;
+    std::map<std::string, std::string> fields;
+    std::string body;
+
+    std::string get(const std::string& key, const std::string& fallback = "") const;
+};
+
+std::string encode_message(const Message& msg);
+
+// Buffered reader/writer over a connected socket; owns and closes the fd
+class Connection {
+public:
+    explicit Connection(int fd);
+    ~Connection();
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    bool read(Message& msg);
+    bool write(const Message& msg);
+
+    // True once a message is (at least partly) available, false on timeout
+    bool wait_readable(int timeout_ms);
+
+    int fd() const { return sock; }
+
+private:
+    bool fill();
+
+    int sock;
+    std::string buffer;
+};
+
+struct PeerCredentials {
+    pid_t pid = -1;
+    uid_t uid = static_cast<uid_t>(-1);
+    gid_t gid = static_cast<gid_t>(-1);
+};
+
+// Identity of the process on the other end of a Unix socket
+bool get_peer_credentials(int fd, PeerCredentials& creds);
+
+// Returns a connected fd, or -1 if nothing is listening
+int connect_server(const std::string& path = SOCKET_PATH);
+
+// Binds a world-connectable listening socket; throws on failure
+int listen_server(const std::string& path = SOCKET_PATH);
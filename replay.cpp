@@ -0,0 +1,367 @@
+// replay.cpp - Replays a server capture log against a running server
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.h"
+#include "capture.h"
+#include "json.h"
+#include "protocol.h"
+
+// ANSI color codes
+namespace Color {
+const std::string RESET = "\033[0m";
+const std::string RED = "\033[31m";
+const std::string GREEN = "\033[32m";
+const std::string YELLOW = "\033[33m";
+const std::string CYAN = "\033[36m";
+const std::string BOLD = "\033[1m";
+const std::string DIM = "\033[2m";
+}  // namespace Color
+
+void print_status(const std::string& msg) {
+    std::cerr << Color::CYAN << "[" << Color::RESET << "•" << Color::CYAN << "] " << Color::RESET << msg << std::endl;
+}
+
+void print_error(const std::string& msg) {
+    std::cerr << Color::RED << "[✗] " << Color::RESET << msg << std::endl;
+}
+
+struct Options {
+    std::string capture_file;
+    std::string socket_path = SOCKET_PATH;
+    double speed = 1.0;  // 0 = back to back
+    size_t concurrency = 32;
+    size_t limit = 0;
+    bool list = false;
+    bool show_diffs = false;
+    bool json = false;
+};
+
+struct ReplayResult {
+    uint64_t id = 0;
+    double original_ms = 0;
+    double replay_ms = 0;
+    bool ok = false;
+    std::string error;
+    std::string original;
+    std::string output;
+};
+
+// Bounds the number of requests in flight
+class Slots {
+public:
+    explicit Slots(size_t n) : free(n) {}
+
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return free > 0; });
+        free--;
+    }
+
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            free++;
+        }
+        cv.notify_one();
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    size_t free;
+};
+
+ReplayResult replay_one(const CaptureRecord& record, const std::string& socket_path) {
+    ReplayResult result;
+    result.id = record.id;
+    result.original_ms = record.total_us / 1000.0;
+    result.original = record.output;
+
+    Message request;
+    request.type = "generate";
+    request.fields = record.fields;
+    // Only the final message is compared, so tokens need not be streamed back
+    request.fields.erase("trace");
+    request.fields.erase("stream");
+    request.body = record.diff;
+
+    int fd = connect_server(socket_path);
+    if (fd < 0) {
+        result.error = "cannot connect";
+        return result;
+    }
+    Connection conn(fd);
+    Message response;
+    if (!conn.write(request) || !conn.read(response)) {
+        result.error = "connection lost";
+        return result;
+    }
+    // Server-side arrival to finish, the same span the capture recorded; -1
+    // when the server does not report it
+    std::string total = response.get("total_ms");
+    result.replay_ms = total.empty() ? -1 : std::atof(total.c_str());
+    result.ok = response.get("status") == "ok";
+    if (!result.ok) {
+        result.error = response.body;
+    }
+    result.output = response.body;
+    return result;
+}
+
+namespace {
+
+// Unlike text_util's split_lines, keeps empty lines: they matter in a message diff
+std::vector<std::string> split_lines_keep_empty(const std::string& text) {
+    std::vector<std::string> lines;
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos)
+            end = text.size();
+        lines.push_back(text.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return lines;
+}
+
+}  // namespace
+
+// Line diff via longest common subsequence; commit messages are a few lines
+std::string line_diff(const std::string& before, const std::string& after) {
+    std::vector<std::string> a = split_lines_keep_empty(before);
+    std::vector<std::string> b = split_lines_keep_empty(after);
+    std::vector<std::vector<int>> lcs(a.size() + 1, std::vector<int>(b.size() + 1, 0));
+    for (size_t i = a.size(); i-- > 0;) {
+        for (size_t j = b.size(); j-- > 0;) {
+            lcs[i][j] = a[i] == b[j] ? lcs[i + 1][j + 1] + 1 : std::max(lcs[i + 1][j], lcs[i][j + 1]);
+        }
+    }
+
+    std::string out;
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        if (i < a.size() && j < b.size() && a[i] == b[j]) {
+            out += "  " + a[i++] + "\n";
+            j++;
+        } else if (j < b.size() && (i == a.size() || lcs[i][j + 1] >= lcs[i + 1][j])) {
+            out += Color::GREEN + "+ " + b[j++] + Color::RESET + "\n";
+        } else {
+            out += Color::RED + "- " + a[i++] + Color::RESET + "\n";
+        }
+    }
+    return out;
+}
+
+// Records are written as requests finish, so they are sorted back into
+// arrival order here; `limit` keeps the first n to arrive
+std::vector<CaptureRecord> read_records(const CaptureReader& reader, size_t limit) {
+    std::vector<CaptureRecord> records;
+    CaptureRecord record;
+    size_t offset = reader.begin();
+    while (reader.next(offset, record)) {
+        records.push_back(std::move(record));
+    }
+    std::stable_sort(records.begin(), records.end(), [](const CaptureRecord& a, const CaptureRecord& b) {
+        return a.arrival_unix_us < b.arrival_unix_us;
+    });
+    if (limit != 0 && records.size() > limit)
+        records.resize(limit);
+    return records;
+}
+
+void list_records(const std::vector<CaptureRecord>& records) {
+    std::printf("%-8s %-24s %8s %9s %9s %7s %7s  %s\n", "ID", "ARRIVAL", "UID", "QUEUE MS", "TOTAL MS", "PROMPT",
+                "OUTPUT", "STATUS");
+    for (const CaptureRecord& record : records) {
+        time_t seconds = record.arrival_unix_us / 1000000;
+        char when[32];
+        std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", std::localtime(&seconds));
+        std::printf("%-8llu %-24s %8u %9.1f %9.1f %7u %7u  %s\n", (unsigned long long)record.id, when, record.uid,
+                    record.queue_us / 1000.0, record.total_us / 1000.0, record.prompt_tokens,
+                    record.completion_tokens, record.failed ? "error" : "ok");
+    }
+}
+
+std::string format_number(double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6g", value);
+    return buf;
+}
+
+void print_report(const Options& opts, const std::vector<ReplayResult>& results, double wall_seconds) {
+    std::vector<double> original, replayed;
+    size_t ok = 0, identical = 0;
+    for (const auto& r : results) {
+        original.push_back(r.original_ms);
+        if (!r.ok)
+            continue;
+        ok++;
+        if (r.replay_ms >= 0)
+            replayed.push_back(r.replay_ms);
+        if (r.output == r.original)
+            identical++;
+    }
+    size_t changed = ok - identical;
+    Percentiles before = percentiles(original);
+    Percentiles after = percentiles(replayed);
+
+    if (opts.json) {
+        std::string out = "{\"requests\":" + std::to_string(results.size()) + ",\"ok\":" + std::to_string(ok)
+                          + ",\"errors\":" + std::to_string(results.size() - ok)
+                          + ",\"identical\":" + std::to_string(identical) + ",\"changed\":" + std::to_string(changed)
+                          + ",\"speed\":" + format_number(opts.speed)
+                          + ",\"wall_seconds\":" + format_number(wall_seconds)
+                          + ",\"original_latency_ms\":" + percentiles_json(before)
+                          + ",\"replay_latency_ms\":" + percentiles_json(after) + ",\"changes\":[";
+        bool first = true;
+        for (const auto& r : results) {
+            if (r.ok && r.output == r.original)
+                continue;
+            out += std::string(first ? "" : ",") + "{\"id\":" + std::to_string(r.id)
+                   + ",\"original\":" + json_string(r.original) + ",\"replay\":" + json_string(r.output)
+                   + (r.ok ? "" : ",\"error\":" + json_string(r.error)) + "}";
+            first = false;
+        }
+        out += "]}";
+        std::cout << out << std::endl;
+        return;
+    }
+
+    if (opts.show_diffs) {
+        for (const auto& r : results) {
+            if (!r.ok) {
+                std::cout << Color::BOLD << "Request " << r.id << Color::RESET << Color::RED << " failed: " << r.error
+                          << Color::RESET << "\n\n";
+            } else if (r.output != r.original) {
+                std::cout << Color::BOLD << "Request " << r.id << Color::RESET << "\n"
+                          << line_diff(r.original, r.output) << "\n";
+            }
+        }
+    }
+
+    std::printf("%sReplayed %zu requests in %.1fs%s\n", Color::BOLD.c_str(), results.size(), wall_seconds,
+                Color::RESET.c_str());
+    std::printf("  ok %zu, errors %zu, identical outputs %zu, changed %zu\n\n", ok, results.size() - ok, identical,
+                changed);
+    // Both rows are server-side, arrival to finish
+    std::printf("  %-10s %7s %9s %9s %9s %9s %9s\n", "LATENCY MS", "COUNT", "MEAN", "P50", "P90", "P99", "MAX");
+    for (const auto& [label, p] : {std::make_pair("original", before), std::make_pair("replay", after)}) {
+        std::printf("  %-10s %7zu %9.1f %9.1f %9.1f %9.1f %9.1f\n", label, p.count, p.mean, p.p50, p.p90, p.p99,
+                    p.max);
+    }
+}
+
+void show_usage(const std::string& prog_name) {
+    std::cout << Color::BOLD << "USAGE:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " <capture_file> [options]\n\n";
+    std::cout << Color::BOLD << "OPTIONS:" << Color::RESET << "\n";
+    std::cout << "  --speed <x>           Pacing relative to the capture: 1 = original (default),\n";
+    std::cout << "                        10 = ten times faster, 0 = back to back\n";
+    std::cout << "  --concurrency <n>     Max requests in flight (default 32)\n";
+    std::cout << "  --limit <n>           Replay only the first n requests\n";
+    std::cout << "  --socket <path>       Server socket (default " << SOCKET_PATH << ")\n";
+    std::cout << "  --diffs               Show how each changed message differs\n";
+    std::cout << "  --json                Print the report as JSON\n";
+    std::cout << "  --list                List the captured requests and exit\n\n";
+    std::cout << Color::BOLD << "EXAMPLES:" << Color::RESET << "\n";
+    std::cout << Color::DIM << "  # Record production traffic, then replay it 5x faster against a new model"
+              << Color::RESET << "\n";
+    std::cout << "  commitgen-server --start model.gguf --record traffic.cap\n";
+    std::cout << "  " << prog_name << " traffic.cap --speed 5 --diffs\n\n";
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            show_usage(argv[0]);
+            return 0;
+        } else if (arg == "--speed" && i + 1 < argc) {
+            opts.speed = std::atof(argv[++i]);
+        } else if (arg == "--concurrency" && i + 1 < argc) {
+            opts.concurrency = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--limit" && i + 1 < argc) {
+            opts.limit = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--socket" && i + 1 < argc) {
+            opts.socket_path = argv[++i];
+        } else if (arg == "--diffs") {
+            opts.show_diffs = true;
+        } else if (arg == "--json") {
+            opts.json = true;
+        } else if (arg == "--list") {
+            opts.list = true;
+        } else if (arg[0] != '-' && opts.capture_file.empty()) {
+            opts.capture_file = arg;
+        } else {
+            print_error("Unknown option: " + arg);
+            return 1;
+        }
+    }
+    if (opts.capture_file.empty()) {
+        show_usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        CaptureReader reader(opts.capture_file);
+        std::vector<CaptureRecord> records = read_records(reader, opts.limit);
+        if (opts.list) {
+            list_records(records);
+            return 0;
+        }
+
+        std::vector<ReplayResult> results;
+        std::mutex results_mtx;
+        std::vector<std::thread> threads;
+        Slots slots(opts.concurrency);
+
+        // Open loop: requests go out on the captured schedule whether or not
+        // earlier ones have finished, up to the concurrency limit
+        auto start = std::chrono::steady_clock::now();
+        for (const CaptureRecord& record : records) {
+            if (opts.speed > 0) {
+                auto delay = std::chrono::microseconds(
+                    static_cast<int64_t>((record.arrival_unix_us - records.front().arrival_unix_us) / opts.speed));
+                std::this_thread::sleep_until(start + delay);
+            }
+
+            slots.acquire();
+            threads.emplace_back([&, record] {
+                ReplayResult result = replay_one(record, opts.socket_path);
+                slots.release();
+                std::lock_guard<std::mutex> lock(results_mtx);
+                results.push_back(std::move(result));
+            });
+        }
+        if (threads.empty()) {
+            print_error("No requests in " + opts.capture_file);
+            return 1;
+        }
+        if (!opts.json) {
+            print_status("Sent " + std::to_string(threads.size()) + " requests, waiting for responses");
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::sort(results.begin(), results.end(),
+                  [](const ReplayResult& a, const ReplayResult& b) { return a.id < b.id; });
+        print_report(opts, results, wall);
+    } catch (const std::exception& e) {
+        print_error(e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "result_cache.h"
+
+ResultCache::ResultCache(size_t max_entries) : max_entries(max_entries) {}
+
+std::string ResultCache::key(const std::string& diff, bool summary) {
+    return (summary ? "s" : "m") + diff.substr(0, MAX_DIFF_BYTES);
+}
+
+bool ResultCache::find(const std::string& diff, bool summary, std::string& result) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = index.find(key(diff, summary));
+    if (it == index.end())
+        return false;
+    hit_count++;
+    lru.splice(lru.begin(), lru, it->second);
+    result = it->second->second;
+    return true;
+}
+
+bool ResultCache::contains(const std::string& diff, bool summary) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return index.count(key(diff, summary)) > 0;
+}
+
+void ResultCache::store(const std::string& diff, bool summary, const std::string& result) {
+    std::string k = key(diff, summary);
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = index.find(k);
+    if (it != index.end()) {
+        it->second->second = result;
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+    lru.emplace_front(k, result);
+    index[std::move(k)] = lru.begin();
+    if (lru.size() > max_entries) {
+        index.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+std::shared_ptr<Job> ResultCache::find_pending(const std::string& diff, bool summary) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = pending.find(key(diff, summary));
+    return it == pending.end() ? nullptr : it->second;
+}
+
+bool ResultCache::add_pending(const std::shared_ptr<Job>& job) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return pending.emplace(key(job->diff, job->summary), job).second;
+}
+
+void ResultCache::remove_pending(const Job& job) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = pending.find(key(job.diff, job.summary));
+    if (it != pending.end() && it->second.get() == &job)
+        pending.erase(it);
+}
+
+uint64_t ResultCache::hits() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return hit_count;
+}
+
+size_t ResultCache::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return lru.size();
+}
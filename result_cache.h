@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "scheduler.h"
+
+// Finished messages by diff, so a diff generated ahead of time (or asked for
+// twice) is answered without touching the model. Keys are the part of the diff
+// the model sees, the first MAX_DIFF_BYTES, and whether only the summary line
+// was asked for. Also tracks jobs still queued or running, so a request for the
+// same diff joins one instead of repeating it.
+class ResultCache {
+public:
+    explicit ResultCache(size_t max_entries = 256);
+
+    bool find(const std::string& diff, bool summary, std::string& result);
+    bool contains(const std::string& diff, bool summary) const;
+    void store(const std::string& diff, bool summary, const std::string& result);
+
+    std::shared_ptr<Job> find_pending(const std::string& diff, bool summary) const;
+    // False if a job for the same diff is already pending
+    bool add_pending(const std::shared_ptr<Job>& job);
+    void remove_pending(const Job& job);
+
+    uint64_t hits() const;
+    size_t size() const;
+
+private:
+    static std::string key(const std::string& diff, bool summary);
+
+    mutable std::mutex mtx;
+    size_t max_entries;
+    std::list<std::pair<std::string, std::string>> lru;  // most recent first
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> index;
+    std::unordered_map<std::string, std::shared_ptr<Job>> pending;
+    uint64_t hit_count = 0;
+};
@@ -0,0 +1,191 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+void Job::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        done = true;
+    }
+    cv.notify_all();
+}
+
+void Job::wait() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return done; });
+}
+
+void Job::push_piece(const std::string& piece) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        pending_text += piece;
+    }
+    cv.notify_all();
+}
+
+bool Job::take_pieces(std::string& out) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return done || !pending_text.empty(); });
+    if (pending_text.empty())
+        return false;
+    out = std::move(pending_text);
+    pending_text.clear();
+    return true;
+}
+
+FairScheduler::Flow& FairScheduler::flow_for(uid_t uid) {
+    Flow& flow = flows[uid];
+    flow.stats.uid = uid;
+    return flow;
+}
+
+void FairScheduler::set_weight(uid_t uid, double weight) {
+    std::lock_guard<std::mutex> lock(mtx);
+    flow_for(uid).stats.weight = std::max(weight, 0.01);
+}
+
+void FairScheduler::push(std::shared_ptr<Job> job) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (job->background) {
+            background.push_back(std::move(job));
+            cv.notify_one();
+            return;
+        }
+        Flow& flow = flow_for(job->uid);
+        flow.queue.push_back(std::move(job));
+        flow.stats.queued++;
+        pending++;
+    }
+    cv.notify_one();
+}
+
+void FairScheduler::promote(const std::shared_ptr<Job>& job) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        job->background = false;
+        auto it = std::find(background.begin(), background.end(), job);
+        if (it == background.end())
+            return;  // already running, or finished
+        background.erase(it);
+        Flow& flow = flow_for(job->uid);
+        flow.queue.push_back(job);
+        flow.stats.queued++;
+        pending++;
+    }
+    cv.notify_one();
+}
+
+bool FairScheduler::cancel(const std::shared_ptr<Job>& job) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = std::find(background.begin(), background.end(), job);
+    if (it == background.end())
+        return false;
+    background.erase(it);
+    return true;
+}
+
+std::shared_ptr<Job> FairScheduler::pop() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return stopped || pending > 0 || !background.empty(); });
+    return next();
+}
+
+std::shared_ptr<Job> FairScheduler::try_pop() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return next();
+}
+
+std::shared_ptr<Job> FairScheduler::next() {
+    if (stopped || (pending == 0 && background.empty()))
+        return nullptr;
+
+    if (pending == 0) {
+        std::shared_ptr<Job> job = std::move(background.front());
+        background.pop_front();
+        job->started = std::chrono::steady_clock::now();
+        return job;
+    }
+
+    // Pick the backlogged user with the smallest start tag; an idle user
+    // restarts at the current virtual time instead of banking credit
+    Flow* best = nullptr;
+    double best_start = 0;
+    for (auto& [uid, flow] : flows) {
+        if (flow.queue.empty())
+            continue;
+        double start = std::max(virtual_time, flow.finish);
+        if (!best || start < best_start
+            || (start == best_start && flow.queue.front()->enqueued < best->queue.front()->enqueued)) {
+            best = &flow;
+            best_start = start;
+        }
+    }
+
+    std::shared_ptr<Job> job = std::move(best->queue.front());
+    best->queue.pop_front();
+    best->stats.queued--;
+    pending--;
+
+    virtual_time = best_start;
+    best->finish = best_start + job->cost / best->stats.weight;
+    job->started = std::chrono::steady_clock::now();
+    return job;
+}
+
+void FairScheduler::complete(const Job& job) {
+    if (job.background)
+        return;
+    std::lock_guard<std::mutex> lock(mtx);
+    Flow& flow = flow_for(job.uid);
+
+    // Replace the estimate with what the job really consumed
+    flow.finish += (job.tokens - job.cost) / flow.stats.weight;
+
+    double queued = std::chrono::duration<double>(job.started - job.enqueued).count();
+    flow.stats.requests++;
+    flow.stats.tokens += job.tokens;
+    flow.stats.queue_seconds += queued;
+    flow.stats.max_queue_seconds = std::max(flow.stats.max_queue_seconds, queued);
+}
+
+std::vector<std::shared_ptr<Job>> FairScheduler::shutdown() {
+    std::vector<std::shared_ptr<Job>> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopped = true;
+        for (auto& [uid, flow] : flows) {
+            for (auto& job : flow.queue) {
+                abandoned.push_back(std::move(job));
+            }
+            flow.queue.clear();
+            flow.stats.queued = 0;
+        }
+        for (auto& job : background) {
+            abandoned.push_back(std::move(job));
+        }
+        background.clear();
+        pending = 0;
+    }
+    cv.notify_all();
+    return abandoned;
+}
+
+size_t FairScheduler::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return pending;
+}
+
+size_t FairScheduler::background_size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return background.size();
+}
+
+std::vector<UserStats> FairScheduler::user_stats() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<UserStats> result;
+    for (const auto& [uid, flow] : flows) {
+        result.push_back(flow.stats);
+    }
+    return result;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "commitgen.h"
+
+// A queued generation request and, once done, its result
+struct Job {
+    uint64_t id = 0;
+    uid_t uid = 0;
+    std::string diff;
+    double cost = 0;  // estimated tokens, charged against the user's share
+    bool trace = false;  // ship this job's spans back to the client
+    bool stream = false;  // hand pieces to the session as they are generated
+    bool summary = false;  // stop after the summary line
+    // Speculative work: runs only when no user is waiting and gives way to
+    // them mid-generation. Cleared once a request joins the job.
+    std::atomic<bool> background{false};
+    std::chrono::steady_clock::time_point enqueued;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point finished;
+
+    std::string result;
+    bool failed = false;
+    int tokens = 0;  // prompt + completion tokens actually consumed
+    GenerationStats stats;
+
+    void finish();
+    void wait();
+
+    // Worker side of streaming
+    void push_piece(const std::string& piece);
+    // Session side: blocks until there is new text or the job is done; false
+    // once the job is done and everything has been taken
+    bool take_pieces(std::string& out);
+
+private:
+    bool done = false;
+    std::string pending_text;
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+struct UserStats {
+    uid_t uid = 0;
+    double weight = 1.0;
+    uint64_t requests = 0;
+    uint64_t tokens = 0;
+    double queue_seconds = 0;
+    double max_queue_seconds = 0;
+    size_t queued = 0;
+};
+
+// Start-time fair queuing: each user gets a FIFO, and the user whose next job
+// has the smallest virtual start tag is served first. A user's tag advances by
+// cost / weight per job, so a burst from one user cannot starve the others.
+// Background jobs wait in a FIFO of their own, served only when every user
+// queue is empty, and are not charged to anyone.
+class FairScheduler {
+public:
+    void set_weight(uid_t uid, double weight);
+
+    void push(std::shared_ptr<Job> job);
+
+    // Turns a background job into an ordinary one for its user; a queued job
+    // moves to the user's queue
+    void promote(const std::shared_ptr<Job>& job);
+
+    // Takes a background job back out of the queue; false once it has started
+    bool cancel(const std::shared_ptr<Job>& job);
+
+    // Blocks until a job is available; returns nullptr after shutdown()
+    std::shared_ptr<Job> pop();
+    // nullptr when nothing is queued
+    std::shared_ptr<Job> try_pop();
+
+    // Charges the job's actual token count and records its queue time
+    void complete(const Job& job);
+
+    // Stops pop() and hands back the jobs that never started
+    std::vector<std::shared_ptr<Job>> shutdown();
+
+    size_t size() const;  // queued foreground jobs
+    size_t background_size() const;
+    std::vector<UserStats> user_stats() const;
+
+private:
+    struct Flow {
+        std::deque<std::shared_ptr<Job>> queue;
+        double finish = 0;
+        UserStats stats;
+    };
+
+    Flow& flow_for(uid_t uid);
+    std::shared_ptr<Job> next();  // caller holds mtx
+
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    std::map<uid_t, Flow> flows;
+    std::deque<std::shared_ptr<Job>> background;
+    double virtual_time = 0;
+    size_t pending = 0;
+    bool stopped = false;
+};
@@ -1,21 +1,60 @@
-// server.cpp - Simplified (no git commands, just processes diff text)
+// server.cpp - Generation server: diffs over the unix socket and HTTP, or read
+// in-process from a repository ("repo" requests, watched indexes); never runs git
 #include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <pwd.h>
 #include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/fsuid.h>
+#include <sys/signalfd.h>
+#endif
+
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
 #include <thread>
+#include <vector>
 
+#include "backend.h"
+#include "capture.h"
 #include "commitgen.h"
+#include "difffilter.h"
+#include "gitrepo.h"
+#include "http.h"
+#include "json.h"
+#include "logger.h"
+#include "metrics.h"
+#include "probes.h"
+#include "protocol.h"
+#include "result_cache.h"
+#include "scheduler.h"
+#include "stats_page.h"
+#include "text_util.h"
+#include "trace.h"
+#include "watcher.h"
 
 namespace fs = std::filesystem;
 
@@ -32,14 +71,72 @@ const std::string DIM = "\033[2m";
 }  // namespace Color
 
 // Paths
-const std::string REQUEST_PIPE = "/tmp/commitgen_request";
-const std::string RESPONSE_PIPE = "/tmp/commitgen_response";
 const std::string STATUS_FILE = "/tmp/commitgen_status";
 const std::string PID_FILE = "/tmp/commitgen_server.pid";
 
-// Global pointer for signal handling
 std::unique_ptr<CommitGen> generator;
-volatile sig_atomic_t running = 1;
+// Each sequence reserves its own 4096-token slice of KV memory up front
+constexpr int MAX_PARALLEL = 64;
+std::atomic<bool> running{true};
+std::atomic<bool> model_failed{false};
+
+// Set when a service manager passed in the listening socket; the path is then its to manage
+bool socket_inherited = false;
+
+// SIGINT/SIGTERM arrive here as a readable fd, so the event loop handles
+// shutdown and nothing runs in signal context
+int shutdown_fd = -1;
+
+// Open client connections, so shutdown can wake their readers and wait for them
+std::mutex sessions_mtx;
+std::condition_variable sessions_cv;
+std::set<int> sessions;
+std::chrono::steady_clock::time_point last_session_end = std::chrono::steady_clock::now();  // for --idle-timeout
+
+FairScheduler scheduler;
+std::atomic<uint64_t> next_job_id{1};
+std::chrono::steady_clock::time_point server_start = std::chrono::steady_clock::now();
+
+// Server-wide metrics, exported in Prometheus text format
+struct ServerMetrics {
+    Counter requests_ok;
+    Counter requests_failed;
+    Counter prompt_tokens;
+    Counter completion_tokens;
+    Counter cache_lookups;
+    Counter cache_hits;
+    Counter cached_tokens;
+    Counter result_cache_hits;
+    Counter speculative_started;
+    Counter speculative_preempted;
+    Counter speculative_joined;
+    Histogram queue_wait{latency_buckets()};
+    Histogram tokenize{latency_buckets()};
+    Histogram prefill_rate{throughput_buckets()};
+    Histogram decode_rate{throughput_buckets()};
+    Histogram first_token{latency_buckets()};
+    Histogram latency{latency_buckets()};
+    Gauge kv_used;
+    Gauge kv_size;
+    Gauge active;
+};
+ServerMetrics metrics;
+
+StatsPublisher stats_page;
+
+// Optional record of every generate request, for commitgen-replay
+CaptureWriter capture;
+
+// Hunks and HEAD trees shared by "repo" requests across users and checkouts
+GitCache git_cache;
+
+// Finished messages by diff, filled by every job including speculative ones
+ResultCache results;
+
+// Repositories registered with "watch" requests or --watch; their staged
+// changes are generated in the background as soon as the index settles
+std::unique_ptr<IndexWatcher> watcher;
+constexpr auto SPECULATE_QUIET = std::chrono::milliseconds(750);
 
 void print_banner() {
     std::cout << Color::CYAN;
@@ -54,40 +151,88 @@ void print_banner() {
     std::cout << Color::DIM << "  AI-powered commit message generator\n" << Color::RESET << std::endl;
 }
 
+// Runtime output goes through the async logger; see logger.h
 void print_status(const std::string& msg) {
-    std::cout << Color::CYAN << "[" << Color::RESET << "•" << Color::CYAN << "] " << Color::RESET << msg << std::endl;
+    logger::write(logger::Level::Info, "status", msg);
 }
 
 void print_success(const std::string& msg) {
-    std::cout << Color::GREEN << "[✓] " << Color::RESET << msg << std::endl;
+    logger::write(logger::Level::Info, "ok", msg);
 }
 
 void print_error(const std::string& msg) {
-    std::cerr << Color::RED << "[✗] " << Color::RESET << msg << std::endl;
+    logger::write(logger::Level::Error, "error", msg);
 }
 
-void print_request(const std::string& preview) {
-    std::cout << Color::YELLOW << "[→] " << Color::RESET << "Request: " << Color::DIM << preview << Color::RESET
-              << std::endl;
+void print_request(uint64_t id, const std::string& user, const std::string& preview, size_t bytes) {
+    logger::write(logger::Level::Info, "request", "Request from " + user + ": " + preview,
+                  {{"id", std::to_string(id)}, {"user", user}, {"bytes", std::to_string(bytes)}});
 }
 
-void print_response() {
-    std::cout << Color::GREEN << "[←] " << Color::RESET << "Response sent" << std::endl;
+void print_response(uint64_t id, const std::string& status, double ms) {
+    char elapsed[32];
+    std::snprintf(elapsed, sizeof(elapsed), "%.1f", ms);
+    logger::write(logger::Level::Info, "response", "Response sent",
+                  {{"id", std::to_string(id)}, {"status", status}, {"ms", elapsed}});
 }
 
-// Signal handler
-void signal_handler(int signum) {
-    std::cout << "\n";
-    print_status("Shutting down...");
-    running = 0;
+#ifndef __linux__
+int shutdown_pipe[2] = {-1, -1};
 
-    unlink(REQUEST_PIPE.c_str());
-    unlink(RESPONSE_PIPE.c_str());
-    unlink(STATUS_FILE.c_str());
-    unlink(PID_FILE.c_str());
+// Self-pipe fallback where signalfd is unavailable; write() is async-signal-safe
+void on_shutdown_signal(int signum) {
+    int saved = errno;
+    char c = static_cast<char>(signum);
+    (void)!write(shutdown_pipe[1], &c, 1);
+    errno = saved;
+}
+#endif
 
-    print_success("Server stopped");
-    exit(0);
+// Must run before any thread is spawned so that every thread inherits the mask
+bool open_shutdown_fd() {
+#ifdef __linux__
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+        return false;
+    }
+    shutdown_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    return shutdown_fd >= 0;
+#else
+    if (pipe(shutdown_pipe) != 0) {
+        return false;
+    }
+    for (int fd : shutdown_pipe) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    struct sigaction sa = {};
+    sa.sa_handler = on_shutdown_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    shutdown_fd = shutdown_pipe[0];
+    return true;
+#endif
+}
+
+// Returns the pending signal number, or 0 if there is none
+int read_shutdown_signal() {
+#ifdef __linux__
+    struct signalfd_siginfo info;
+    if (read(shutdown_fd, &info, sizeof(info)) != sizeof(info)) {
+        return 0;
+    }
+    return info.ssi_signo;
+#else
+    char c;
+    if (read(shutdown_fd, &c, 1) != 1) {
+        return 0;
+    }
+    return c;
+#endif
 }
 
 bool is_server_already_running() {
@@ -96,7 +241,7 @@ bool is_server_already_running() {
         std::ifstream pid_file(PID_FILE);
         pid_t existing_pid;
         if (pid_file >> existing_pid) {
-            if (kill(existing_pid, 0) == 0) {
+            if (kill(existing_pid, 0) == 0 || errno == EPERM) {
                 return true;
             }
         }
@@ -110,126 +255,1133 @@ void write_pid_file() {
     pid_file << getpid() << std::endl;
 }
 
-void cleanup() {
-    unlink(REQUEST_PIPE.c_str());
-    unlink(RESPONSE_PIPE.c_str());
+// Status, PID and stats files; the socket is left to whoever created it
+void remove_state_files() {
     unlink(STATUS_FILE.c_str());
     unlink(PID_FILE.c_str());
+    shm_unlink(STATS_SHM_NAME);
 }
 
-void start_server(const std::string& model_path) {
-    print_banner();
+// Run by the server itself, the only process that knows whether its socket
+// came from the service manager (which keeps it for the next activation)
+void cleanup() {
+    if (!socket_inherited) {
+        unlink(SOCKET_PATH.c_str());
+    }
+    remove_state_files();
+}
+
+std::string user_name(uid_t uid) {
+    struct passwd pwd;
+    struct passwd* result = nullptr;
+    char buf[1024];
+    if (getpwuid_r(uid, &pwd, buf, sizeof(buf), &result) == 0 && result) {
+        return result->pw_name;
+    }
+    return std::to_string(uid);
+}
+
+void record_metrics(const Job& job) {
+    const GenerationStats& stats = job.stats;
+    auto seconds = [](auto d) { return std::chrono::duration<double>(d).count(); };
+    double queued = seconds(job.started - job.enqueued);
+
+    (job.failed ? metrics.requests_failed : metrics.requests_ok).inc();
+    metrics.queue_wait.observe(queued);
+    metrics.latency.observe(seconds(job.finished - job.enqueued));
+    if (stats.prompt_tokens == 0)
+        return;
+
+    metrics.prompt_tokens.inc(stats.prompt_tokens);
+    metrics.completion_tokens.inc(stats.completion_tokens);
+    metrics.cache_lookups.inc();
+    if (stats.cached_tokens > 0) {
+        metrics.cache_hits.inc();
+        metrics.cached_tokens.inc(stats.cached_tokens);
+    }
+
+    metrics.tokenize.observe(stats.tokenize_seconds);
+    metrics.first_token.observe(queued + stats.first_token_seconds);
+    if (stats.prefill_seconds > 0)
+        metrics.prefill_rate.observe((stats.prompt_tokens - stats.cached_tokens) / stats.prefill_seconds);
+    if (stats.decode_seconds > 0 && stats.completion_tokens > 0)
+        metrics.decode_rate.observe(stats.completion_tokens / stats.decode_seconds);
+    metrics.kv_used.set(stats.context_used);
+    metrics.kv_size.set(stats.context_size);
+}
+
+std::string render_metrics() {
+    PromWriter w;
 
-    // Load model
-    print_status("Loading model: " + model_path);
-    std::cout << Color::DIM << "   This may take a moment..." << Color::RESET << std::flush;
+    w.header("commitgen_requests_total", "counter", "Generation requests by outcome");
+    w.sample("commitgen_requests_total", metrics.requests_ok.value(), "status=\"ok\"");
+    w.sample("commitgen_requests_total", metrics.requests_failed.value(), "status=\"error\"");
 
-    generator = std::make_unique<CommitGen>(model_path);
+    w.histogram("commitgen_queue_wait_seconds", "Time from arrival until the worker picks a request up",
+                metrics.queue_wait);
+    w.histogram("commitgen_tokenize_seconds", "Prompt build and tokenization time", metrics.tokenize);
+    w.histogram("commitgen_prefill_tokens_per_second", "Prompt processing throughput per request",
+                metrics.prefill_rate);
+    w.histogram("commitgen_decode_tokens_per_second", "Generation throughput per request", metrics.decode_rate);
+    w.histogram("commitgen_time_to_first_token_seconds", "Time from arrival until the first sampled token",
+                metrics.first_token);
+    w.histogram("commitgen_request_duration_seconds", "Time from arrival until the result is ready",
+                metrics.latency);
 
-    // Wait for model to load with spinner
-    const char spinner[] = "⠋⠙⠹⠸⠼⠴⠦⠧⠇⠏";
-    int spin_idx = 0;
+    w.counter("commitgen_prompt_tokens_total", "Prompt tokens processed or reused", metrics.prompt_tokens.value());
+    w.counter("commitgen_completion_tokens_total", "Tokens generated", metrics.completion_tokens.value());
+    w.counter("commitgen_prompt_cache_lookups_total", "Prompts checked against the KV prefix cache",
+              metrics.cache_lookups.value());
+    w.counter("commitgen_prompt_cache_hits_total", "Prompts that reused a cached KV prefix",
+              metrics.cache_hits.value());
+    w.counter("commitgen_prompt_cache_tokens_total", "Prompt tokens served from the KV prefix cache",
+              metrics.cached_tokens.value());
+
+    double kv_size = metrics.kv_size.value();
+    w.counter("commitgen_result_cache_hits_total", "Requests answered with an already generated message",
+              metrics.result_cache_hits.value());
+    w.counter("commitgen_speculative_jobs_total", "Background generations started for watched repositories",
+              metrics.speculative_started.value());
+    w.counter("commitgen_speculative_preempted_total", "Background generations interrupted by user requests",
+              metrics.speculative_preempted.value());
+    w.counter("commitgen_speculative_joined_total", "Requests that joined a background generation of their diff",
+              metrics.speculative_joined.value());
+    w.gauge("commitgen_watched_repositories", "Repositories watched for index changes",
+            watcher ? watcher->size() : 0);
+    w.counter("commitgen_git_hunk_cache_hits_total", "File diffs reused by repo requests", git_cache.hits());
+    w.counter("commitgen_git_hunk_cache_misses_total", "File diffs computed by repo requests", git_cache.misses());
+
+    w.gauge("commitgen_kv_cache_used_tokens", "KV cache cells in use after the last request", metrics.kv_used.value());
+    w.gauge("commitgen_kv_cache_size_tokens", "KV cache capacity", kv_size);
+    w.gauge("commitgen_kv_cache_usage_ratio", "KV cache utilization",
+            kv_size > 0 ? metrics.kv_used.value() / kv_size : 0);
+    w.gauge("commitgen_active_sequences", "Sequences currently being generated", metrics.active.value());
+    w.gauge("commitgen_queue_depth", "Requests waiting for the worker", scheduler.size());
+    w.gauge("commitgen_resident_memory_bytes", "Resident set size", resident_memory_bytes());
+    w.gauge("commitgen_uptime_seconds", "Seconds since the server started",
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - server_start).count());
+
+    auto users = scheduler.user_stats();
+    w.header("commitgen_user_requests_total", "counter", "Completed requests per user");
+    for (const auto& user : users) {
+        w.sample("commitgen_user_requests_total", user.requests, "user=\"" + prom_label(user_name(user.uid)) + "\"");
+    }
+    w.header("commitgen_user_tokens_total", "counter", "Tokens consumed per user");
+    for (const auto& user : users) {
+        w.sample("commitgen_user_tokens_total", user.tokens, "user=\"" + prom_label(user_name(user.uid)) + "\"");
+    }
+    w.header("commitgen_user_queue_seconds_total", "counter", "Total queue wait per user");
+    for (const auto& user : users) {
+        w.sample("commitgen_user_queue_seconds_total", user.queue_seconds,
+                 "user=\"" + prom_label(user_name(user.uid)) + "\"");
+    }
+
+    return w.str();
+}
+
+// Write atomically so a scraper never sees a half-written file
+void write_metrics_file(const std::string& path) {
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp);
+    out << render_metrics();
+    out.close();
+    if (out) {
+        std::rename(tmp.c_str(), path.c_str());
+    }
+}
+
+// Requests accepted while the model loads stay queued until it is ready;
+// false if loading failed or the server is stopping
+bool wait_for_model() {
+    auto start = std::chrono::steady_clock::now();
     while (!generator->is_ready()) {
-        std::cout << "\r" << Color::DIM << "   Loading " << spinner[spin_idx++ % 10] << Color::RESET << std::flush;
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (generator->load_failed() || !running) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
-    std::cout << "\r" << std::string(20, ' ') << "\r";
-    print_success("Model loaded");
 
-    // Create pipes
-    unlink(REQUEST_PIPE.c_str());
-    unlink(RESPONSE_PIPE.c_str());
-    mkfifo(REQUEST_PIPE.c_str(), 0666);
-    mkfifo(RESPONSE_PIPE.c_str(), 0666);
+    char elapsed[32];
+    std::snprintf(elapsed, sizeof(elapsed), "%.1fs",
+                  std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    print_success(std::string("Model loaded in ") + elapsed);
+    stats_page.update([](ServerStats& page) {
+        page.state = scheduler.size() > 0 ? STATE_BUSY : STATE_IDLE;
+        page.rss_bytes = resident_memory_bytes();
+    });
+    return true;
+}
 
-    // Status file
-    std::ofstream status(STATUS_FILE);
-    status << "running";
-    status.close();
+// A job the worker has started on the model
+struct RunningJob {
+    std::shared_ptr<Job> job;
+    uint32_t generated = 0;
+    bool preempted = false;
+    bool text_seen = false;  // for summaries: the summary line has started
+    std::chrono::steady_clock::time_point first_token;
+    int64_t start_us = 0;  // for the "generate" span; 0 when not tracing
+};
 
-    write_pid_file();
+using RunningJobs = std::map<uint64_t, std::unique_ptr<RunningJob>>;
 
-    std::cout << "\n";
-    print_success("Server running on PID " + std::to_string(getpid()));
-    std::cout << Color::DIM << "   Press Ctrl+C to stop\n" << Color::RESET << std::endl;
+// Hands a job that left the model back to its session, or to the background
+// queue if it gave way to a user
+void finish_job(RunningJob& run) {
+    const std::shared_ptr<Job>& job = run.job;
+    if (run.start_us > 0)
+        trace::record("generate", "server", run.start_us, trace::now_us() - run.start_us, job->id);
 
-    // Main loop
-    while (running) {
+    if (run.preempted) {
+        // Back of the background queue; the prompt prefix stays in the KV cache for the retry
+        metrics.speculative_preempted.inc();
+        job->result.clear();
+        job->stats = GenerationStats();
+        scheduler.push(job);
+        return;
+    }
+    job->tokens = job->stats.prompt_tokens + job->stats.completion_tokens;
+    job->finished = std::chrono::steady_clock::now();
+    if (job->summary && !job->failed)
+        job->result = first_line(job->result);
+    if (!job->failed)
+        results.store(job->diff, job->summary, job->result);
+    results.remove_pending(*job);
+
+    stats_page.update([&](ServerStats& page) {
+        size_t queued = scheduler.size();
+        page.state = queued > 0 ? STATE_BUSY : STATE_IDLE;
+        page.queue_depth = queued;
+        page.requests_total++;
+        page.tokens_total += job->tokens;
+        page.rss_bytes = resident_memory_bytes();
+        if (job->stats.decode_seconds > 0)
+            page.tokens_per_second = job->stats.completion_tokens / job->stats.decode_seconds;
+    });
+
+    auto ms = [](double seconds) { return std::to_string((int64_t)(seconds * 1000.0)); };
+    logger::write(logger::Level::Debug, "generate", "Generation finished",
+                  {{"id", std::to_string(job->id)},
+                   {"prompt_tokens", std::to_string(job->stats.prompt_tokens)},
+                   {"cached_tokens", std::to_string(job->stats.cached_tokens)},
+                   {"completion_tokens", std::to_string(job->stats.completion_tokens)},
+                   {"prefill_ms", ms(job->stats.prefill_seconds)},
+                   {"decode_ms", ms(job->stats.decode_seconds)}});
+
+    scheduler.complete(*job);
+    if (!job->background)
+        record_metrics(*job);
+    job->finish();
+}
+
+// Claims a sequence for the job; it joins the batch at the next step
+void start_job(std::shared_ptr<Job> job, RunningJobs& jobs) {
+    trace::RequestScope scope(job->id, job->trace);
+    CG_PROBE2(request__dequeue, job->id,
+              std::chrono::duration_cast<std::chrono::microseconds>(job->started - job->enqueued).count());
+    auto run = std::make_unique<RunningJob>();
+    run->job = job;
+    if (trace::active()) {
+        auto us = [](auto d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); };
+        int64_t waited = us(job->started - job->enqueued);
+        int64_t start = trace::now_us() - us(std::chrono::steady_clock::now() - job->enqueued);
+        trace::record("queue", "server", start, waited, job->id);
+        run->start_us = trace::now_us();
+    }
+
+    stats_page.update([&](ServerStats& page) {
+        page.state = STATE_BUSY;
+        page.queue_depth = scheduler.size();
+        page.current_request = job->id;
+        page.current_prompt_tokens = 0;
+        page.current_generated = 0;
+        page.current_max_tokens = MAX_NEW_TOKENS;
+    });
+
+    // Publish progress on every token; the seqlock write is a few hundred bytes
+    RunningJob* r = run.get();
+    auto on_token = [r, &jobs](const std::string& piece) {
+        Job& job = *r->job;
+        // Speculative work stops as soon as a user is waiting for its sequence
+        if (job.background && scheduler.size() > generator->parallel() - jobs.size()) {
+            r->preempted = true;
+            return false;
+        }
+        // A summary ends with its first line
+        size_t newline = piece.find('\n');
+        size_t text = piece.find_first_not_of(" \t\n");
+        if (job.summary && newline != std::string::npos && (r->text_seen || text < newline)) {
+            if (job.stream && newline > 0)
+                job.push_piece(piece.substr(0, newline));
+            return false;
+        }
+        r->text_seen = r->text_seen || text != std::string::npos;
+        if (job.stream)
+            job.push_piece(piece);
+        auto now = std::chrono::steady_clock::now();
+        if (r->generated++ == 0)
+            r->first_token = now;
+        double elapsed = std::chrono::duration<double>(now - r->first_token).count();
+        stats_page.update([&](ServerStats& page) {
+            page.current_request = job.id;
+            page.current_prompt_tokens = job.stats.prompt_tokens;
+            page.current_generated = r->generated;
+            if (elapsed > 0)
+                page.tokens_per_second = (r->generated - 1) / elapsed;
+        });
+        return true;
+    };
+
+    try {
+        if (!generator->start(job->id, job->diff, &job->stats, on_token))
+            throw std::runtime_error("No free sequence");
+    } catch (const std::exception& e) {
+        job->failed = true;
+        job->result = e.what();
+        finish_job(*run);
+        return;
+    }
+    jobs[job->id] = std::move(run);
+    metrics.active.set(jobs.size());
+}
+
+// Inference worker: the model is driven from this thread alone. Up to
+// --parallel jobs are generated together in one continuous batch, and the
+// scheduler decides who takes each sequence as it frees up.
+void run_worker() {
+    if (!wait_for_model()) {
+        if (running) {
+            print_error("Failed to load model");
+            model_failed = true;
+            running = false;
+        }
+        return;
+    }
+
+    RunningJobs jobs;
+    for (;;) {
+        // Only block for work when the model is idle
+        while (jobs.size() < generator->parallel()) {
+            std::shared_ptr<Job> job = jobs.empty() ? scheduler.pop() : scheduler.try_pop();
+            if (!job && jobs.empty())
+                return;
+            if (!job)
+                break;
+            start_job(std::move(job), jobs);
+        }
+        if (jobs.empty())
+            continue;
+
+        std::vector<CommitGen::Finished> finished;
         try {
-            int request_fd = open(REQUEST_PIPE.c_str(), O_RDONLY | O_NONBLOCK);
-            if (request_fd < 0) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-                continue;
+            finished = generator->step();
+        } catch (const std::exception& e) {
+            // The model dropped every sequence
+            for (auto& [id, run] : jobs) {
+                run->job->failed = true;
+                run->job->result = e.what();
+                run->preempted = false;
+                finish_job(*run);
             }
+            jobs.clear();
+        }
+        for (auto& done : finished) {
+            auto it = jobs.find(done.tag);
+            if (it == jobs.end())
+                continue;
+            it->second->job->result = std::move(done.result);
+            finish_job(*it->second);
+            jobs.erase(it);
+        }
+        metrics.active.set(jobs.size());
+    }
+}
 
-            // Wait for data with select
-            fd_set read_fds;
-            FD_ZERO(&read_fds);
-            FD_SET(request_fd, &read_fds);
+// Text generated for a "stream: 1" request goes to on_piece as it arrives,
+// before the result is returned; false means the client stopped listening
+using PieceSink = std::function<bool(uint64_t id, const std::string& text)>;
 
-            struct timeval tv;
-            tv.tv_sec = 0;
-            tv.tv_usec = 100000;  // 100ms
+Message handle_generate(const Message& request, const PeerCredentials& creds, const PieceSink& on_piece) {
+    std::string diff = request.body;
+    trim_right(diff, "\n\r");
+    // "summary: 1" asks for just the summary line, for short per-hunk descriptions
+    bool summary = request.get("summary") == "1";
 
-            if (select(request_fd + 1, &read_fds, nullptr, nullptr, &tv) <= 0) {
-                close(request_fd);
-                continue;
-            }
+    // Preview
+    std::string preview = diff.length() > 60 ? diff.substr(0, 57) + "..." : diff;
+    // Replace newlines in preview
+    for (char& c : preview) {
+        if (c == '\n')
+            c = ' ';
+    }
+    auto arrived = std::chrono::steady_clock::now();
+    int64_t arrived_unix_us = trace::now_us();
+    uint64_t id = next_job_id++;
+    print_request(id, user_name(creds.uid), preview, diff.size());
 
-            // Read request
-            std::string request;
-            char buffer[4096];
-            ssize_t bytes;
-            while ((bytes = read(request_fd, buffer, sizeof(buffer) - 1)) > 0) {
-                buffer[bytes] = '\0';
-                request += buffer;
-            }
-            close(request_fd);
+    Message response;
+    response.type = "result";
+    response.fields["status"] = "ok";
+    response.fields["id"] = std::to_string(id);
 
-            if (request.empty()) {
-                continue;
+    if (diff == "--test") {
+        response.body = "test: verify commit generation pipeline";
+    } else if (!looks_like_diff(diff)) {
+        response.fields["status"] = "error";
+        response.body = "Invalid request - expected git diff content";
+    } else if (std::string cached; results.find(diff, summary, cached)) {
+        // Generated ahead of time, or asked for before
+        metrics.result_cache_hits.inc();
+        response.fields["cached_result"] = "1";
+        response.fields["tokens"] = "0";
+        if (on_piece && request.get("stream") == "1")
+            on_piece(id, cached);
+        response.body = std::move(cached);
+    } else {
+        // The same diff may already be queued or running, speculatively or for someone else
+        std::shared_ptr<Job> job = results.find_pending(diff, summary);
+        bool joined = job != nullptr;
+        if (!joined) {
+            job = std::make_shared<Job>();
+            job->id = id;
+            job->uid = creds.uid;
+            job->diff = std::move(diff);
+            job->summary = summary;
+            job->cost = std::min(job->diff.size(), MAX_DIFF_BYTES) / 4.0 + (summary ? 24 : 128);
+            job->trace = request.get("trace") == "1";
+            job->stream = request.get("stream") == "1";
+            job->enqueued = std::chrono::steady_clock::now();
+        }
+        CG_PROBE3(request__accept, job->id, job->diff.size(), job->uid);
+
+        {
+            trace::RequestScope scope(job->id, job->trace);
+            trace::Span span("request", "server");
+            span.arg("bytes", (long long)job->diff.size());
+            if (joined) {
+                response.fields["id"] = std::to_string(job->id);
+                if (job->background)
+                    metrics.speculative_joined.inc();
+                scheduler.promote(job);
+            } else {
+                results.add_pending(job);
+                scheduler.push(job);
             }
+            stats_page.update([](ServerStats& page) { page.queue_depth = scheduler.size(); });
 
-            // Trim
-            while (!request.empty() && (request.back() == '\n' || request.back() == '\r')) {
-                request.pop_back();
+            std::string pieces;
+            bool writable = true;
+            while (!joined && job->stream && job->take_pieces(pieces)) {
+                // A client that went away still gets its job finished
+                writable = writable && on_piece(job->id, pieces);
             }
+            job->wait();
+            if (joined && on_piece && request.get("stream") == "1" && !job->failed)
+                on_piece(job->id, job->result);
+        }
+
+        // Server side of the client's --profile breakdown
+        const GenerationStats& stats = job->stats;
+        auto ms = [](double seconds) { return std::to_string(seconds * 1000.0); };
+        double queued = std::chrono::duration<double>(job->started - job->enqueued).count();
+        response.fields["tokens"] = std::to_string(job->tokens);
+        response.fields["queue_ms"] = ms(queued);
+        response.fields["tokenize_ms"] = ms(stats.tokenize_seconds);
+        response.fields["prompt_tokens"] = std::to_string(stats.prompt_tokens);
+        response.fields["cached_tokens"] = std::to_string(stats.cached_tokens);
+        response.fields["prefill_tokens"] = std::to_string(stats.prompt_tokens - stats.cached_tokens);
+        response.fields["prefill_ms"] = ms(stats.prefill_seconds);
+        response.fields["decode_tokens"] = std::to_string(stats.completion_tokens);
+        response.fields["decode_ms"] = ms(stats.decode_seconds);
+        response.fields["ttft_ms"] = ms(queued + stats.first_token_seconds);
+        // Arrival to finish, the latency the capture log records
+        response.fields["total_ms"] = ms(std::chrono::duration<double>(job->finished - arrived).count());
+        if (job->failed) {
+            response.fields["status"] = "error";
+            logger::write(logger::Level::Error, "error", job->result, {{"id", std::to_string(job->id)}});
+        }
+        response.body = job->result;
+        if (job->trace) {
+            response.fields["trace"] = trace::take_request(job->id);
+        }
 
-            // Preview
-            std::string preview = request.length() > 60 ? request.substr(0, 57) + "..." : request;
-            // Replace newlines in preview
-            for (char& c : preview) {
-                if (c == '\n')
-                    c = ' ';
+        if (capture.is_open()) {
+            auto us = [](auto d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); };
+            CaptureRecord record;
+            record.id = job->id;
+            record.arrival_unix_us = arrived_unix_us;
+            record.queue_us = us(job->started - job->enqueued);
+            record.total_us = us(job->finished - arrived);
+            record.uid = creds.uid;
+            record.failed = job->failed;
+            record.prompt_tokens = stats.prompt_tokens;
+            record.completion_tokens = stats.completion_tokens;
+            record.fields = request.fields;
+            record.diff = request.body;
+            record.output = job->result;
+            if (!capture.append(record)) {
+                print_error("Failed to append to capture file");
             }
-            print_request(preview);
-
-            // Generate
-            std::string commit_msg;
-            if (request == "--test") {
-                commit_msg = "test: verify commit generation pipeline";
-            } else if (request.find("diff") != std::string::npos || request.find("+++") != std::string::npos
-                       || request.find("---") != std::string::npos) {
-                commit_msg = generator->generate(request);
+        }
+    }
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - arrived).count();
+    if (!response.fields.count("total_ms"))
+        response.fields["total_ms"] = std::to_string(elapsed_ms);
+    print_response(id, response.fields["status"], elapsed_ms);
+    return response;
+}
+
+// Opens files with the caller's permissions for the life of the guard. A server
+// running as the caller needs nothing; a root server switches this thread's
+// filesystem ids and groups (setfsuid and the raw setgroups syscall are
+// per-thread, unlike glibc's setgroups). Anything else cannot read safely.
+class CallerFiles {
+public:
+    explicit CallerFiles(const PeerCredentials& creds) {
+        if (creds.uid == geteuid())
+            return;
+        if (geteuid() != 0)
+            throw GitUnsupported("Server runs as a different user");
+
+        struct passwd pwd;
+        struct passwd* result = nullptr;
+        char buf[1024];
+        if (getpwuid_r(creds.uid, &pwd, buf, sizeof(buf), &result) != 0 || !result)
+            throw GitUnsupported("Unknown user " + std::to_string(creds.uid));
+        std::vector<gid_t> groups(64);
+        int count = (int)groups.size();
+        if (getgrouplist(pwd.pw_name, creds.gid, groups.data(), &count) < 0) {
+            groups.resize(count);
+            getgrouplist(pwd.pw_name, creds.gid, groups.data(), &count);
+        }
+        groups.resize(count);
+
+        saved_groups.resize(getgroups(0, nullptr));
+        saved_groups.resize(std::max(0, getgroups((int)saved_groups.size(), saved_groups.data())));
+        if (syscall(SYS_setgroups, groups.size(), groups.data()) != 0)
+            throw GitUnsupported("Cannot switch to the caller's groups");
+        switched = true;
+        setfsgid(creds.gid);
+        setfsuid(creds.uid);
+        if ((uid_t)setfsuid(-1) != creds.uid || (gid_t)setfsgid(-1) != creds.gid) {
+            restore();
+            throw GitUnsupported("Cannot switch to the caller's user");
+        }
+    }
+
+    ~CallerFiles() {
+        if (switched)
+            restore();
+    }
+
+    CallerFiles(const CallerFiles&) = delete;
+    CallerFiles& operator=(const CallerFiles&) = delete;
+
+private:
+    void restore() {
+        setfsuid(geteuid());
+        setfsgid(getegid());
+        syscall(SYS_setgroups, saved_groups.size(), saved_groups.data());
+    }
+
+    bool switched = false;
+    std::vector<gid_t> saved_groups;
+};
+
+Message repo_error(const std::string& code, const std::string& message) {
+    Message response;
+    response.type = "result";
+    response.fields["status"] = "error";
+    if (!code.empty())
+        response.fields["code"] = code;
+    response.body = message;
+    return response;
+}
+
+// A "repo" request names a checkout ("path", "mode" staged or unstaged, and an
+// optional "file") instead of carrying a diff; the server reads the index and
+// objects itself, then generates exactly as for "generate"
+Message handle_repo(const Message& request, const PeerCredentials& creds, const PieceSink& on_piece) {
+    std::string path = request.get("path");
+    if (path.empty() || path[0] != '/')
+        return repo_error("", "Repository path must be absolute");
+    DiffSide side = request.get("mode", "staged") == "unstaged" ? DiffSide::Unstaged : DiffSide::Staged;
+
+    auto started = std::chrono::steady_clock::now();
+    RepoDiff diff;
+    try {
+        CallerFiles access(creds);
+        GitRepo repo(path);
+        diff = repo.diff(side, request.get("file"), &git_cache);
+        diff.text = DiffFilter::load(path).apply(diff.text);
+    } catch (const GitUnsupported& e) {
+        return repo_error("unsupported", e.what());
+    } catch (const GitError& e) {
+        return repo_error("", e.what());
+    }
+    double diff_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    if (diff.text.empty())
+        return repo_error("empty", side == DiffSide::Staged ? "No staged changes" : "No unstaged changes");
+
+    Message generate;
+    generate.type = "generate";
+    generate.fields = request.fields;
+    generate.body = std::move(diff.text);
+    Message response = handle_generate(generate, creds, on_piece);
+    response.fields["files"] = std::to_string(diff.files);
+    response.fields["diff_ms"] = std::to_string(diff_ms);
+    return response;
+}
+
+// Watcher callback: queue a background generation for a repository's staged
+// changes unless their message is already cached or on its way. Only the
+// watcher thread calls this.
+void speculate(const IndexWatcher::Repo& repo) {
+    static std::map<std::string, std::shared_ptr<Job>> latest;  // by git dir
+
+    RepoDiff staged;
+    try {
+        CallerFiles access(repo.owner);
+        staged = GitRepo(repo.path).diff(DiffSide::Staged, "", &git_cache);
+        staged.text = DiffFilter::load(repo.path).apply(staged.text);
+    } catch (const GitError& e) {
+        logger::write(logger::Level::Debug, "speculate", e.what(), {{"repo", repo.path}});
+        return;
+    }
+    std::string diff = std::move(staged.text);
+    trim_right(diff, "\n\r");
+    if (diff.empty() || results.contains(diff, false) || results.find_pending(diff, false))
+        return;
+
+    // Staging more supersedes a speculation that has not started yet
+    auto previous = latest.find(repo.git_dir);
+    if (previous != latest.end() && previous->second->background && scheduler.cancel(previous->second)) {
+        results.remove_pending(*previous->second);
+        previous->second->failed = true;
+        previous->second->result = "Superseded";
+        previous->second->finish();
+    }
+
+    auto job = std::make_shared<Job>();
+    job->id = next_job_id++;
+    job->uid = repo.owner.uid;
+    job->diff = std::move(diff);
+    job->cost = std::min(job->diff.size(), MAX_DIFF_BYTES) / 4.0 + 128;
+    job->background = true;
+    job->enqueued = std::chrono::steady_clock::now();
+    if (!results.add_pending(job))
+        return;
+    latest[repo.git_dir] = job;
+    metrics.speculative_started.inc();
+    logger::write(logger::Level::Debug, "speculate", "Pre-generating staged changes",
+                  {{"id", std::to_string(job->id)}, {"repo", repo.path}, {"bytes", std::to_string(job->diff.size())}});
+    scheduler.push(job);
+}
+
+// "watch" registers a checkout ("path") for speculative generation, read with
+// the caller's permissions like "repo"
+Message handle_watch(const Message& request, const PeerCredentials& creds) {
+    std::string path = request.get("path");
+    if (path.empty() || path[0] != '/')
+        return repo_error("", "Repository path must be absolute");
+    if (!watcher)
+        return repo_error("unsupported", "Repository watching is not available");
+    try {
+        CallerFiles access(creds);
+        GitRepo repo(path);
+        watcher->add({path, repo.git_dir(), creds});
+    } catch (const GitUnsupported& e) {
+        return repo_error("unsupported", e.what());
+    } catch (const std::exception& e) {
+        return repo_error("", e.what());
+    }
+    logger::write(logger::Level::Info, "watch", "Watching " + path, {{"user", user_name(creds.uid)}});
+
+    Message response;
+    response.type = "result";
+    response.fields["status"] = "ok";
+    response.body = "Watching " + path;
+    return response;
+}
+
+Message handle_stats() {
+    Message response;
+    response.type = "stats";
+    response.fields["status"] = "ok";
+    response.fields["queued"] = std::to_string(scheduler.size());
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-16s %6s %9s %10s %10s %10s %6s\n", "USER", "WEIGHT", "REQUESTS", "TOKENS",
+                  "AVG QUEUE", "MAX QUEUE", "QUEUED");
+    response.body = line;
+    for (const auto& user : scheduler.user_stats()) {
+        double avg = user.requests ? user.queue_seconds / user.requests : 0.0;
+        std::snprintf(line, sizeof(line), "%-16s %6.2f %9llu %10llu %9.2fs %9.2fs %6zu\n",
+                      user_name(user.uid).c_str(), user.weight, (unsigned long long)user.requests,
+                      (unsigned long long)user.tokens, avg, user.max_queue_seconds, user.queued);
+        response.body += line;
+    }
+    return response;
+}
+
+// Removes a connection from the session set before its fd is closed
+struct SessionGuard {
+    int fd;
+    ~SessionGuard() {
+        {
+            std::lock_guard<std::mutex> lock(sessions_mtx);
+            sessions.erase(fd);
+            last_session_end = std::chrono::steady_clock::now();
+        }
+        sessions_cv.notify_all();
+    }
+};
+
+// Serve one client connection until it hangs up
+void handle_client(int fd) {
+    Connection conn(fd);
+    SessionGuard session{fd};
+
+    PeerCredentials creds;
+    if (!get_peer_credentials(fd, creds)) {
+        print_error("Rejected connection without peer credentials");
+        return;
+    }
+
+    Message request;
+    while (running && conn.read(request)) {
+        // "token" messages carry new text, then the usual result follows
+        auto send_piece = [&](uint64_t id, const std::string& text) {
+            Message token;
+            token.type = "token";
+            token.fields["id"] = std::to_string(id);
+            token.body = text;
+            return conn.write(token);
+        };
+
+        Message response;
+        if (request.type == "generate") {
+            response = handle_generate(request, creds, send_piece);
+        } else if (request.type == "repo") {
+            response = handle_repo(request, creds, send_piece);
+        } else if (request.type == "watch") {
+            response = handle_watch(request, creds);
+        } else if (request.type == "stats") {
+            response = handle_stats();
+        } else if (request.type == "metrics") {
+            response.type = "metrics";
+            response.fields["status"] = "ok";
+            response.body = render_metrics();
+        } else {
+            response.type = "result";
+            response.fields["status"] = "error";
+            response.body = "Unknown request type: " + request.type;
+        }
+
+        if (!conn.write(response)) {
+            break;
+        }
+        CG_PROBE2(response__write, std::strtoull(response.get("id", "0").c_str(), nullptr, 10), response.body.size());
+        trace::flush();
+    }
+}
+
+// HTTP endpoint (--http): the same generate path and scheduler as the native
+// protocol, with JSON bodies and server-sent events for streaming
+const std::string JSON_TYPE = "application/json";
+constexpr size_t MAX_HTTP_BATCH = 256;
+
+std::string error_json(const std::string& message) {
+    return "{\"status\":\"error\",\"error\":" + json_string(message) + "}";
+}
+
+// Result fields as a JSON object; the stats are already plain numbers
+std::string result_json(const Message& response) {
+    static const char* const STATS[] = {"tokens",        "queue_ms",      "tokenize_ms",   "prompt_tokens",
+                                        "cached_tokens", "prefill_tokens", "prefill_ms",   "decode_tokens",
+                                        "decode_ms",     "ttft_ms"};
+    bool ok = response.get("status") == "ok";
+    std::string out = "{\"id\":" + response.get("id", "0") + ",\"status\":" + json_string(response.get("status"));
+    out += (ok ? ",\"message\":" : ",\"error\":") + json_string(response.body);
+    for (const char* key : STATS) {
+        auto it = response.fields.find(key);
+        if (it != response.fields.end())
+            out += ",\"" + std::string(key) + "\":" + it->second;
+    }
+    return out + "}";
+}
+
+int http_status(const Message& response) {
+    if (response.get("status") == "ok")
+        return 200;
+    // Rejected before it was queued, so the input was at fault
+    if (response.fields.count("tokens") == 0)
+        return 400;
+    return running ? 500 : 503;
+}
+
+Message http_generate_request(const std::string& diff, bool stream) {
+    Message request;
+    request.type = "generate";
+    request.fields["via"] = "http";
+    if (stream)
+        request.fields["stream"] = "1";
+    request.body = diff;
+    return request;
+}
+
+// POST /v1/generate with {"diff": "...", "stream": true} or {"diffs": ["...", ...]}
+bool serve_generate(HttpConnection& conn, const HttpRequest& req, const PeerCredentials& creds, bool keep_alive) {
+    JsonValue body;
+    try {
+        body = json_parse(req.body);
+    } catch (const std::exception& e) {
+        return conn.respond(400, JSON_TYPE, error_json(e.what()), keep_alive);
+    }
+    const JsonValue* diff = body.get("diff");
+    const JsonValue* diffs = body.get("diffs");
+    const JsonValue* stream = body.get("stream");
+    bool streaming = stream && stream->type == JsonValue::Bool && stream->boolean;
+
+    if (diffs && diffs->type == JsonValue::Array && !diff && !streaming) {
+        if (diffs->array.size() > MAX_HTTP_BATCH)
+            return conn.respond(400, JSON_TYPE, error_json("At most " + std::to_string(MAX_HTTP_BATCH) + " diffs"),
+                                keep_alive);
+        for (const auto& item : diffs->array) {
+            if (item.type != JsonValue::String)
+                return conn.respond(400, JSON_TYPE, error_json("\"diffs\" must hold strings"), keep_alive);
+        }
+
+        // One job per diff, so a batch is fair-queued exactly like separate requests
+        std::vector<Message> responses(diffs->array.size());
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < responses.size(); i++) {
+            threads.emplace_back([&, i] {
+                responses[i] = handle_generate(http_generate_request(diffs->array[i].string, false), creds, nullptr);
+            });
+        }
+        std::string out = "{\"results\":[";
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i].join();
+            out += (i ? "," : "") + result_json(responses[i]);
+        }
+        return conn.respond(200, JSON_TYPE, out + "]}", keep_alive);
+    }
+
+    if (!diff || diff->type != JsonValue::String)
+        return conn.respond(400, JSON_TYPE, error_json("Expected {\"diff\": \"...\"} or {\"diffs\": [...]}"),
+                            keep_alive);
+
+    Message request = http_generate_request(diff->string, streaming);
+    if (!streaming) {
+        Message response = handle_generate(request, creds, nullptr);
+        return conn.respond(http_status(response), JSON_TYPE, result_json(response), keep_alive);
+    }
+
+    // "token" events carry new text, then a "result" event carries the usual JSON
+    if (!conn.start_events())
+        return false;
+    Message response = handle_generate(request, creds, [&conn](uint64_t, const std::string& text) {
+        return conn.send_event("token", "{\"text\":" + json_string(text) + "}");
+    });
+    return conn.send_event("result", result_json(response)) && conn.end_events();
+}
+
+// Serve one HTTP connection until it hangs up or asks to close
+void handle_http_client(int fd) {
+    HttpConnection conn(fd);
+    SessionGuard session{fd};
+
+    // Loopback TCP has no SO_PEERCRED; the kernel's socket table names the owner
+    struct sockaddr_storage local;
+    socklen_t len = sizeof(local);
+    bool tcp = getsockname(fd, reinterpret_cast<struct sockaddr*>(&local), &len) == 0 && local.ss_family == AF_INET;
+    PeerCredentials creds;
+    if (tcp ? !tcp_peer_uid(fd, creds.uid) : !get_peer_credentials(fd, creds)) {
+        print_error("Rejected HTTP connection from an unknown user");
+        conn.respond(403, JSON_TYPE, error_json("Cannot identify the connecting user"), false);
+        return;
+    }
+
+    HttpRequest req;
+    while (running && conn.read(req)) {
+        bool keep_alive = req.keep_alive();
+        std::string path = req.target.substr(0, req.target.find('?'));
+        auto only = [&](const std::string& method) {
+            return conn.respond(405, JSON_TYPE, error_json("Use " + method), keep_alive, "Allow: " + method + "\r\n");
+        };
+
+        // Loopback alone does not keep browsers out: any page the user opens
+        // can post here, and DNS rebinding lets it read the answers. Browsers
+        // always send Origin on those requests and the page's own name as Host.
+        if (!req.header("origin").empty() || (tcp && !req.loopback_host())) {
+            logger::write(logger::Level::Warn, "http", "Rejected browser or non-loopback request",
+                          {{"host", req.header("host")}, {"origin", req.header("origin")}});
+            conn.respond(403, JSON_TYPE, error_json("Cross-origin requests are not allowed"), false);
+            break;
+        }
+
+        bool ok;
+        if (path == "/v1/generate") {
+            if (req.method != "POST") {
+                ok = only("POST");
+            } else if (req.media_type() != "application/json") {
+                // A JSON body keeps even Origin-less form posts out
+                ok = conn.respond(415, JSON_TYPE, error_json("Use Content-Type: application/json"), keep_alive);
             } else {
-                commit_msg = "ERROR: Invalid request - expected git diff content";
+                ok = serve_generate(conn, req, creds, keep_alive);
             }
+        } else if (path == "/health") {
+            std::string body = "{\"status\":\"ok\",\"queued\":" + std::to_string(scheduler.size()) + "}";
+            ok = req.method == "GET" ? conn.respond(200, JSON_TYPE, body, keep_alive) : only("GET");
+        } else if (path == "/metrics") {
+            ok = req.method == "GET" ? conn.respond(200, "text/plain; version=0.0.4", render_metrics(), keep_alive)
+                                     : only("GET");
+        } else {
+            ok = conn.respond(404, JSON_TYPE, error_json("No such endpoint: " + path), keep_alive);
+        }
+
+        if (!ok || !keep_alive)
+            break;
+        trace::flush();
+    }
+    if (conn.error_status() != 0)
+        conn.respond(conn.error_status(), JSON_TYPE, error_json("Malformed request"), false);
+}
+
+// Registers the connection so shutdown can wait for it, then serves it on its own thread
+void accept_session(int listen_fd, void (*serve)(int)) {
+    int client_fd = accept(listen_fd, nullptr, nullptr);
+    if (client_fd < 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sessions_mtx);
+        sessions.insert(client_fd);
+    }
+    std::thread(serve, client_fd).detach();
+}
+
+struct ServerOptions {
+    std::string model_path;
+    std::map<uid_t, double> weights;
+    std::string metrics_file;
+    std::string trace_file;
+    std::string record_file;
+    std::string http;
+    int idle_timeout = 0;  // seconds without a connection before exiting; 0 = never
+    size_t parallel = 1;   // messages generated at once
+    std::vector<std::string> watch;  // repositories to pre-generate for, as the server's user
+    logger::Level log_level = logger::Level::Info;
+    bool log_json = false;
+};
 
-            // Send response
-            std::ofstream response_pipe(RESPONSE_PIPE);
-            response_pipe << commit_msg;
-            response_pipe.close();
+// systemd-style socket activation: a listening socket passed in as fd 3
+int inherited_listen_fd() {
+    const char* pid = getenv("LISTEN_PID");
+    const char* fds = getenv("LISTEN_FDS");
+    if (!pid || !fds || std::atol(pid) != getpid() || std::atoi(fds) < 1) {
+        return -1;
+    }
+    // Not for our children
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    fcntl(3, F_SETFD, FD_CLOEXEC);
+    return 3;
+}
+
+// Returns false if the model failed to load
+bool start_server(const ServerOptions& options) {
+    logger::configure(options.log_level, options.log_json);
+    if (!options.log_json) {
+        print_banner();
+    }
+
+    trace::set_process_name("commitgen-server");
+    if (!options.trace_file.empty()) {
+        trace::enable(options.trace_file);
+        print_status("Tracing to " + options.trace_file);
+    }
+    if (!options.record_file.empty()) {
+        capture.open(options.record_file);
+        print_status("Recording requests to " + options.record_file);
+    }
+
+    // Live stats for --status
+    if (stats_page.open()) {
+        stats_page.update([&](ServerStats& page) {
+            page.state = STATE_LOADING;
+            page.pid = getpid();
+            std::strncpy(page.model, options.model_path.c_str(), sizeof(page.model) - 1);
+            page.started_unix_ms = unix_ms();
+            page.rss_bytes = resident_memory_bytes();
+        });
+    } else {
+        print_error("Shared memory stats unavailable; --status will show less detail");
+    }
+
+    // Listen first: clients connect at once and generate requests wait in the
+    // queue while the model loads
+    int listen_fd = inherited_listen_fd();
+    if (listen_fd >= 0) {
+        socket_inherited = true;
+        print_status("Using the listening socket passed in by the service manager");
+    } else {
+        listen_fd = listen_server(SOCKET_PATH);
+    }
+    int http_fd = -1;
+    std::string http_address;
+    if (!options.http.empty()) {
+        http_fd = listen_http(options.http, http_address);
+        print_success("HTTP endpoint on " + http_address);
+    }
 
-            print_response();
+    // Status file
+    std::ofstream status(STATUS_FILE);
+    status << "running";
+    status.close();
 
+    write_pid_file();
+
+    for (const auto& [uid, weight] : options.weights) {
+        scheduler.set_weight(uid, weight);
+    }
+
+    // Loads in the background; the worker picks it up when ready
+    print_status("Loading model: " + options.model_path);
+    set_backend_logging(false);
+    generator = std::make_unique<CommitGen>(options.model_path, options.parallel);
+
+    watcher = std::make_unique<IndexWatcher>(SPECULATE_QUIET, speculate);
+    try {
+        watcher->start();
+    } catch (const std::exception& e) {
+        print_error(std::string("Repository watching disabled: ") + e.what());
+        watcher.reset();
+    }
+    PeerCredentials self;
+    self.pid = getpid();
+    self.uid = getuid();
+    self.gid = getgid();
+    for (const auto& path : watcher ? options.watch : std::vector<std::string>()) {
+        try {
+            watcher->add({path, GitRepo(path).git_dir(), self});
+            print_status("Watching " + path);
         } catch (const std::exception& e) {
-            print_error(e.what());
+            print_error("Cannot watch " + path + ": " + e.what());
+        }
+    }
+
+    print_success("Server running on PID " + std::to_string(getpid()));
+    if (options.idle_timeout > 0) {
+        print_status("Exiting after " + std::to_string(options.idle_timeout) + "s without connections");
+    }
+    if (!options.log_json) {
+        std::cout << Color::DIM << "   Press Ctrl+C to stop\n" << Color::RESET << std::endl;
+    }
+
+    // From here on request threads never wait for the terminal
+    logger::start();
+
+    std::thread worker(run_worker);
+    server_start = std::chrono::steady_clock::now();
+    auto metrics_written = server_start;
+
+    // Main loop
+    while (running) {
+        if (!options.metrics_file.empty()
+            && std::chrono::steady_clock::now() - metrics_written > std::chrono::seconds(5)) {
+            write_metrics_file(options.metrics_file);
+            metrics_written = std::chrono::steady_clock::now();
+        }
+
+        if (options.idle_timeout > 0) {
+            std::lock_guard<std::mutex> lock(sessions_mtx);
+            if (generator->is_ready() && sessions.empty() && scheduler.size() == 0
+                && std::chrono::steady_clock::now() - last_session_end > std::chrono::seconds(options.idle_timeout)) {
+                logger::write(logger::Level::Info, "shutdown", "Idle, shutting down...",
+                              {{"idle_timeout", std::to_string(options.idle_timeout)}});
+                running = false;
+                break;
+            }
+        }
+
+        // poll() skips the HTTP entry while it is -1
+        struct pollfd pfds[3] = {{listen_fd, POLLIN, 0}, {shutdown_fd, POLLIN, 0}, {http_fd, POLLIN, 0}};
+        if (poll(pfds, 3, 100) <= 0) {
+            continue;
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            int signum = read_shutdown_signal();
+            if (signum != 0) {
+                logger::write(logger::Level::Info, "shutdown", "Shutting down...", {{"signal", strsignal(signum)}});
+                running = false;
+                break;
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            accept_session(listen_fd, handle_client);
+        }
+        if (pfds[2].revents & POLLIN) {
+            accept_session(http_fd, handle_http_client);
+        }
+    }
+
+    // Stop taking connections, let the job in flight finish and fail the ones
+    // still queued, then give every session the chance to write its response
+    close(listen_fd);
+    if (!socket_inherited) {
+        unlink(SOCKET_PATH.c_str());
+    }
+    if (http_fd >= 0) {
+        close(http_fd);
+        if (http_address.rfind("http://", 0) != 0) {
+            unlink(http_address.c_str());
+        }
+    }
+    stats_page.update([](ServerStats& page) { page.state = STATE_STOPPING; });
+
+    if (watcher) {
+        watcher->stop();
+    }
+    auto fail_jobs = [](const std::vector<std::shared_ptr<Job>>& jobs) {
+        for (auto& job : jobs) {
+            job->failed = true;
+            job->result = model_failed ? "Model failed to load" : "Server is shutting down";
+            job->started = job->finished = std::chrono::steady_clock::now();
+            job->finish();
+        }
+    };
+    auto abandoned = scheduler.shutdown();
+    fail_jobs(abandoned);
+    worker.join();
+    // A background job interrupted during shutdown went back to the queue
+    fail_jobs(scheduler.shutdown());
 
-            std::ofstream response_pipe(RESPONSE_PIPE);
-            response_pipe << "ERROR: " << e.what();
-            response_pipe.close();
+    {
+        std::unique_lock<std::mutex> lock(sessions_mtx);
+        for (int fd : sessions) {
+            shutdown(fd, SHUT_RD);
+        }
+        if (!sessions_cv.wait_for(lock, std::chrono::seconds(5), [] { return sessions.empty(); })) {
+            logger::write(logger::Level::Warn, "shutdown", "Sessions still open at exit",
+                          {{"sessions", std::to_string(sessions.size())}});
         }
     }
+
+    if (!options.metrics_file.empty()) {
+        write_metrics_file(options.metrics_file);
+    }
+    trace::close();
+    stats_page.close();
+    cleanup();
+
+    logger::write(logger::Level::Info, "ok", "Server stopped", {{"abandoned", std::to_string(abandoned.size())}});
+    logger::stop();
+    return !model_failed;
 }
 
 void stop_server() {
@@ -241,14 +1393,26 @@ void stop_server() {
     std::ifstream pid_file(PID_FILE);
     pid_t server_pid;
     if (pid_file >> server_pid) {
-        if (kill(server_pid, SIGTERM) == 0) {
-            print_success("Stop signal sent to PID " + std::to_string(server_pid));
-        } else {
+        if (kill(server_pid, SIGTERM) != 0) {
             print_error("Failed to stop server");
+            return;
+        }
+        print_status("Stop signal sent to PID " + std::to_string(server_pid));
+
+        // The server finishes the request in flight before it exits
+        for (int i = 0; i < 300 && kill(server_pid, 0) == 0; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        if (kill(server_pid, 0) == 0) {
+            print_error("Server is still shutting down");
+            return;
         }
+        print_success("Server stopped");
     }
 
-    cleanup();
+    // The server removed its own socket unless it was socket-activated, in
+    // which case the path must stay for the next activation
+    remove_state_files();
 }
 
 void check_status() {
@@ -258,18 +1422,70 @@ void check_status() {
         if (pid_file >> server_pid) {
             print_success("Server running (PID: " + std::to_string(server_pid) + ")");
         }
+
+        ServerStats stats;
+        if (read_server_stats(stats)) {
+            std::cout << "\n";
+            for (const auto& [label, value] : describe_stats(stats)) {
+                std::cout << "  " << Color::DIM << label << std::string(10 - label.size(), ' ') << Color::RESET
+                          << value << "\n";
+            }
+        }
+
+        // Per-user usage
+        int fd = connect_server();
+        if (fd < 0) {
+            return;
+        }
+        Connection conn(fd);
+        Message request;
+        request.type = "stats";
+        Message response;
+        if (conn.write(request) && conn.read(response)) {
+            std::cout << "\n" << Color::DIM << "Queued requests: " << response.get("queued", "0") << Color::RESET
+                      << "\n\n";
+            std::cout << response.body << std::flush;
+        }
     } else {
         print_error("Server is not running");
     }
 }
 
+void show_metrics() {
+    int fd = connect_server();
+    if (fd < 0) {
+        print_error("Server is not running");
+        return;
+    }
+    Connection conn(fd);
+    Message request;
+    request.type = "metrics";
+    Message response;
+    if (!conn.write(request) || !conn.read(response)) {
+        print_error("Failed to read metrics");
+        return;
+    }
+    std::cout << response.body << std::flush;
+}
+
 void show_usage(const std::string& prog_name) {
     print_banner();
 
     std::cout << Color::BOLD << "USAGE:" << Color::RESET << "\n";
     std::cout << "  " << prog_name << " --start <model_path>   Start the server\n";
+    std::cout << "      --weight <user>=<n>                Fair-share weight for a user (default 1)\n";
+    std::cout << "      --metrics-file <path>              Also write metrics to a file every 5s\n";
+    std::cout << "      --trace <path>                     Record spans as Chrome trace JSON\n";
+    std::cout << "      --record <path>                    Append every request to a capture log for replay\n";
+    std::cout << "      --log-level <level>                debug, info, warn or error (default info)\n";
+    std::cout << "      --log-json                         Log one JSON object per line\n";
+    std::cout << "      --http <[host:]port|unix:path>     Also serve HTTP on loopback or a Unix socket\n";
+    std::cout << "      --idle-timeout <seconds>           Exit after this long without connections\n";
+    std::cout << "      --parallel <n>                     Generate up to n messages at once (default 1)\n";
+    std::cout << "      --watch <repo>                     Pre-generate for staged changes in a repository\n";
     std::cout << "  " << prog_name << " --stop                 Stop the server\n";
-    std::cout << "  " << prog_name << " --status               Check server status\n\n";
+    std::cout << "  " << prog_name << " --status               Check server status\n";
+    std::cout << "  " << prog_name << " --metrics              Print metrics in Prometheus text format\n\n";
 
     std::cout << Color::BOLD << "EXAMPLES:" << Color::RESET << "\n";
     std::cout << Color::DIM << "  # Start with a GGUF model" << Color::RESET << "\n";
@@ -277,6 +1493,15 @@ void show_usage(const std::string& prog_name) {
 
     std::cout << Color::DIM << "  # Start with an Ollama model blob" << Color::RESET << "\n";
     std::cout << "  " << prog_name << " --start ~/.ollama/models/blobs/sha256-abc123\n\n";
+
+    std::cout << Color::DIM << "  # Give the CI user twice the share of everyone else" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " --start ~/models/model.gguf --weight ci=2\n\n";
+
+    std::cout << Color::DIM << "  # Up to 8 messages at once, e.g. for commitgen --repos" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " --start ~/models/model.gguf --parallel 8\n\n";
+
+    std::cout << Color::DIM << "  # Accept HTTP requests on 127.0.0.1:8080" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " --start ~/models/model.gguf --http 8080\n\n";
 }
 
 int main(int argc, char** argv) {
@@ -294,19 +1519,81 @@ int main(int argc, char** argv) {
             return 1;
         }
 
+        ServerOptions options;
+        options.model_path = argv[2];
+        for (int i = 3; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--weight" && i + 1 < argc) {
+                std::string spec = argv[++i];
+                size_t eq = spec.find('=');
+                struct passwd* pw = eq == std::string::npos ? nullptr : getpwnam(spec.substr(0, eq).c_str());
+                double weight = eq == std::string::npos ? 0.0 : std::atof(spec.c_str() + eq + 1);
+                if (!pw || weight <= 0) {
+                    print_error("Invalid weight: " + spec);
+                    return 1;
+                }
+                options.weights[pw->pw_uid] = weight;
+            } else if (arg == "--metrics-file" && i + 1 < argc) {
+                options.metrics_file = argv[++i];
+            } else if (arg == "--trace" && i + 1 < argc) {
+                options.trace_file = argv[++i];
+            } else if (arg == "--record" && i + 1 < argc) {
+                options.record_file = argv[++i];
+            } else if (arg == "--log-level" && i + 1 < argc) {
+                std::string level = argv[++i];
+                if (!logger::parse_level(level, options.log_level)) {
+                    print_error("Invalid log level: " + level);
+                    return 1;
+                }
+            } else if (arg == "--idle-timeout" && i + 1 < argc) {
+                options.idle_timeout = std::atoi(argv[++i]);
+                if (options.idle_timeout <= 0) {
+                    print_error("Invalid idle timeout: " + std::string(argv[i]));
+                    return 1;
+                }
+            } else if (arg == "--parallel" && i + 1 < argc) {
+                int parallel = std::atoi(argv[++i]);
+                if (parallel < 1 || parallel > MAX_PARALLEL) {
+                    print_error("Invalid parallel count: " + std::string(argv[i]));
+                    return 1;
+                }
+                options.parallel = parallel;
+            } else if (arg == "--http" && i + 1 < argc) {
+                options.http = argv[++i];
+            } else if (arg == "--watch" && i + 1 < argc) {
+                char resolved[PATH_MAX];
+                if (!realpath(argv[++i], resolved)) {
+                    print_error("No such repository: " + std::string(argv[i]));
+                    return 1;
+                }
+                options.watch.push_back(resolved);
+            } else if (arg == "--log-json") {
+                options.log_json = true;
+            } else {
+                print_error("Unknown option: " + arg);
+                return 1;
+            }
+        }
+
         if (is_server_already_running()) {
             print_error("Server is already running");
             return 1;
         }
 
-        signal(SIGINT, signal_handler);
-        signal(SIGTERM, signal_handler);
         signal(SIGHUP, SIG_IGN);
+        signal(SIGPIPE, SIG_IGN);
+        if (!open_shutdown_fd()) {
+            print_error(std::string("Cannot set up signal handling: ") + strerror(errno));
+            return 1;
+        }
 
         try {
-            start_server(argv[2]);
+            if (!start_server(options)) {
+                return 1;
+            }
         } catch (const std::exception& e) {
             print_error(std::string("Fatal: ") + e.what());
+            logger::stop();
             cleanup();
             return 1;
         }
@@ -317,6 +1604,9 @@ int main(int argc, char** argv) {
     } else if (cmd == "--status") {
         check_status();
 
+    } else if (cmd == "--metrics") {
+        show_metrics();
+
     } else if (cmd == "--help" || cmd == "-h") {
         show_usage(argv[0]);
 
@@ -0,0 +1,145 @@
+// startup.cpp - Measures process start-to-exit time of a command
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench_util.h"
+
+extern char** environ;
+
+// ANSI color codes
+namespace Color {
+const std::string RESET = "\033[0m";
+const std::string RED = "\033[31m";
+const std::string CYAN = "\033[36m";
+const std::string BOLD = "\033[1m";
+}  // namespace Color
+
+void print_status(const std::string& msg) {
+    std::cerr << Color::CYAN << "[" << Color::RESET << "•" << Color::CYAN << "] " << Color::RESET << msg << std::endl;
+}
+
+void print_error(const std::string& msg) {
+    std::cerr << Color::RED << "[✗] " << Color::RESET << msg << std::endl;
+}
+
+struct Options {
+    int runs = 200;
+    int warmup = 10;
+    bool json = false;
+    std::vector<std::string> command;
+};
+
+// The client installed next to this binary
+std::string sibling_client() {
+    char self[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (n <= 0)
+        return "commitgen";
+    std::string path(self, n);
+    return path.substr(0, path.rfind('/') + 1) + "commitgen";
+}
+
+// Spawns the command with output discarded and waits for it; returns the wall
+// time in milliseconds, or a negative value if it could not run or failed
+double run_once(const std::vector<std::string>& command) {
+    std::vector<char*> argv;
+    for (const auto& arg : command) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid;
+    int rc = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0)
+        return -1;
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? ms : -1;
+}
+
+void show_usage(const std::string& prog_name) {
+    std::cout << Color::BOLD << "USAGE:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << " [options] [-- <command> [args...]]\n\n";
+    std::cout << Color::BOLD << "OPTIONS:" << Color::RESET << "\n";
+    std::cout << "  --runs <n>            Timed launches (default 200)\n";
+    std::cout << "  --warmup <n>          Untimed launches first (default 10)\n";
+    std::cout << "  --json                Print results as JSON\n\n";
+    std::cout << "Without a command, times `commitgen --help` from this binary's directory.\n";
+    std::cout << "The command must exit 0.\n\n";
+    std::cout << Color::BOLD << "EXAMPLES:" << Color::RESET << "\n";
+    std::cout << "  " << prog_name << "\n";
+    std::cout << "  " << prog_name << " --runs 50 -- ./build/commitgen --status\n";
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            show_usage(argv[0]);
+            return 0;
+        } else if (arg == "--runs" && i + 1 < argc) {
+            opts.runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            opts.warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--json") {
+            opts.json = true;
+        } else if (arg == "--") {
+            opts.command.assign(argv + i + 1, argv + argc);
+            break;
+        } else {
+            print_error("Unknown option: " + arg);
+            return 1;
+        }
+    }
+    if (opts.command.empty())
+        opts.command = {sibling_client(), "--help"};
+
+    std::string shown;
+    for (const auto& arg : opts.command) {
+        shown += (shown.empty() ? "" : " ") + arg;
+    }
+    print_status("Timing " + std::to_string(opts.runs) + " launches of: " + shown);
+
+    std::vector<double> samples;
+    for (int i = 0; i < opts.warmup + opts.runs; i++) {
+        double ms = run_once(opts.command);
+        if (ms < 0) {
+            print_error("Command failed: " + shown);
+            return 1;
+        }
+        if (i >= opts.warmup)
+            samples.push_back(ms);
+    }
+    Percentiles p = percentiles(samples);
+
+    if (opts.json) {
+        std::cout << "{\"runs\":" << opts.runs << ",\"startup_ms\":" << percentiles_json(p) << "}" << std::endl;
+    } else {
+        std::printf("%sstartup ms%s  min %.2f  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f\n", Color::BOLD.c_str(),
+                    Color::RESET.c_str(), p.min, p.p50, p.p95, p.p99, p.max);
+    }
+    return 0;
+}
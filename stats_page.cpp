@@ -0,0 +1,154 @@
+#include "stats_page.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+constexpr uint32_t STATS_VERSION = 1;
+
+struct StatsPage {
+    std::atomic<uint32_t> seq;  // odd while a write is in progress
+    uint32_t reserved;
+    ServerStats data;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock needs a lock-free counter");
+
+StatsPublisher::~StatsPublisher() {
+    if (page)
+        munmap(page, sizeof(StatsPage));
+}
+
+bool StatsPublisher::open() {
+    shm_unlink(STATS_SHM_NAME);
+    int fd = shm_open(STATS_SHM_NAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return false;
+
+    // Readable by every user regardless of umask
+    fchmod(fd, 0644);
+    if (ftruncate(fd, sizeof(StatsPage)) != 0) {
+        ::close(fd);
+        shm_unlink(STATS_SHM_NAME);
+        return false;
+    }
+
+    void* mem = mmap(nullptr, sizeof(StatsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        shm_unlink(STATS_SHM_NAME);
+        return false;
+    }
+
+    page = new (mem) StatsPage();
+    page->data.version = STATS_VERSION;
+    return true;
+}
+
+void StatsPublisher::close() {
+    if (page) {
+        munmap(page, sizeof(StatsPage));
+        page = nullptr;
+    }
+    shm_unlink(STATS_SHM_NAME);
+}
+
+void StatsPublisher::update(const std::function<void(ServerStats&)>& fn) {
+    if (!page)
+        return;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t seq = page->seq.load(std::memory_order_relaxed);
+    page->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    fn(page->data);
+    page->data.updated_unix_ms = unix_ms();
+
+    page->seq.store(seq + 2, std::memory_order_release);
+}
+
+bool read_server_stats(ServerStats& out) {
+    int fd = shm_open(STATS_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    void* mem = mmap(nullptr, sizeof(StatsPage), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+        return false;
+
+    const StatsPage* p = static_cast<const StatsPage*>(mem);
+    bool ok = false;
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        uint32_t before = p->seq.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+        std::memcpy(&out, &p->data, sizeof(ServerStats));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (p->seq.load(std::memory_order_relaxed) == before) {
+            ok = out.version == STATS_VERSION;
+            break;
+        }
+    }
+
+    munmap(mem, sizeof(StatsPage));
+    return ok;
+}
+
+const char* state_name(uint32_t state) {
+    switch (state) {
+        case STATE_LOADING:
+            return "loading model";
+        case STATE_IDLE:
+            return "idle";
+        case STATE_BUSY:
+            return "generating";
+        case STATE_STOPPING:
+            return "stopping";
+    }
+    return "unknown";
+}
+
+std::vector<std::pair<std::string, std::string>> describe_stats(const ServerStats& stats) {
+    std::vector<std::pair<std::string, std::string>> rows;
+    char buf[128];
+
+    rows.emplace_back("State", state_name(stats.state));
+    rows.emplace_back("Model", std::string(stats.model, strnlen(stats.model, sizeof(stats.model))));
+
+    int64_t uptime = (unix_ms() - stats.started_unix_ms) / 1000;
+    std::snprintf(buf, sizeof(buf), "%lldh %02lldm %02llds", (long long)(uptime / 3600), (long long)(uptime / 60 % 60),
+                  (long long)(uptime % 60));
+    rows.emplace_back("Uptime", buf);
+
+    rows.emplace_back("Queue", std::to_string(stats.queue_depth) + " waiting");
+    std::snprintf(buf, sizeof(buf), "%llu requests, %llu tokens", (unsigned long long)stats.requests_total,
+                  (unsigned long long)stats.tokens_total);
+    rows.emplace_back("Served", buf);
+
+    if (stats.state == STATE_BUSY) {
+        std::snprintf(buf, sizeof(buf), "#%llu: %u prompt tokens, %u/%u generated, %.1f tok/s",
+                      (unsigned long long)stats.current_request, stats.current_prompt_tokens,
+                      stats.current_generated, stats.current_max_tokens, stats.tokens_per_second);
+        rows.emplace_back("Current", buf);
+    } else if (stats.tokens_per_second > 0) {
+        std::snprintf(buf, sizeof(buf), "%.1f tok/s (last request)", stats.tokens_per_second);
+        rows.emplace_back("Decode", buf);
+    }
+
+    std::snprintf(buf, sizeof(buf), "%.1f MiB", stats.rss_bytes / (1024.0 * 1024.0));
+    rows.emplace_back("Memory", buf);
+    return rows;
+}
+
+int64_t unix_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
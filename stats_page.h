@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Live server stats published in POSIX shared memory so --status can read them
+// in microseconds without talking to the (possibly busy) server. The server is
+// the only writer; updates are guarded by a seqlock and readers simply retry.
+const char* const STATS_SHM_NAME = "/commitgen_stats";
+
+struct StatsPage;
+
+enum ServerState : uint32_t {
+    STATE_LOADING = 0,
+    STATE_IDLE = 1,
+    STATE_BUSY = 2,
+    STATE_STOPPING = 3,
+};
+
+// Plain data only: the layout is shared between processes
+struct ServerStats {
+    uint32_t version;
+    uint32_t state;
+    int32_t pid;
+    char model[256];
+    int64_t started_unix_ms;
+    int64_t updated_unix_ms;
+    uint32_t queue_depth;
+    uint64_t requests_total;
+    uint64_t tokens_total;
+
+    // Request currently being generated
+    uint64_t current_request;
+    uint32_t current_prompt_tokens;
+    uint32_t current_generated;
+    uint32_t current_max_tokens;
+    double tokens_per_second;
+
+    uint64_t rss_bytes;
+};
+
+class StatsPublisher {
+public:
+    ~StatsPublisher();
+
+    // Creates (or recreates) the segment; false if shared memory is unavailable
+    bool open();
+    void close();
+
+    // Applies fn to the page under the seqlock
+    void update(const std::function<void(ServerStats&)>& fn);
+
+private:
+    StatsPage* page = nullptr;
+    std::mutex mtx;  // one writer at a time within the server
+};
+
+// Consistent snapshot of the page; false if no server publishes one
+bool read_server_stats(ServerStats& out);
+
+const char* state_name(uint32_t state);
+
+// Label/value rows for status displays
+std::vector<std::pair<std::string, std::string>> describe_stats(const ServerStats& stats);
+
+int64_t unix_ms();
@@ -0,0 +1,48 @@
+#include "text_util.h"
+
+#include <cstring>
+
+std::string read_all(FILE* stream) {
+    std::string result;
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), stream)) > 0) {
+        result.append(buffer, n);
+    }
+    return result;
+}
+
+std::vector<std::string> split_lines(const std::string& text) {
+    std::vector<std::string> lines;
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* line_end = nl ? nl : end;
+        if (line_end > p)
+            lines.emplace_back(p, line_end);
+        p = line_end + 1;
+    }
+    return lines;
+}
+
+void trim_right(std::string& s, const char* chars) {
+    size_t last = s.find_last_not_of(chars);
+    s.resize(last == std::string::npos ? 0 : last + 1);
+}
+
+std::string first_line(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos)
+        return "";
+    std::string line = text.substr(start, text.find('\n', start) - start);
+    trim_right(line, " \t\r");
+    return line;
+}
+
+bool looks_like_diff(const std::string& text) {
+    // Three memchr-driven scans beat one byte-at-a-time pass, and real diffs
+    // start with "diff" so the first one returns immediately
+    return text.find("diff") != std::string::npos || text.find("+++") != std::string::npos
+           || text.find("---") != std::string::npos;
+}
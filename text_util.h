@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// String helpers on the diff path, shared by the client, server and
+// generator; commitgen-microbench measures them over large diffs
+
+// Reads a stream to EOF in large blocks
+std::string read_all(FILE* stream);
+
+// Non-empty lines of text, without their newlines
+std::vector<std::string> split_lines(const std::string& text);
+
+// Drops any trailing characters that appear in `chars`
+void trim_right(std::string& s, const char* chars);
+
+// First non-blank line, trimmed
+std::string first_line(const std::string& text);
+
+// True if the text contains a diff marker ("diff", "+++" or "---")
+bool looks_like_diff(const std::string& text);
@@ -0,0 +1,208 @@
+#include "trace.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+
+#include "json.h"
+
+namespace trace {
+namespace {
+
+struct Event {
+    std::string name;
+    std::string category;
+    int64_t ts;
+    int64_t dur;
+    int tid;
+    uint64_t request;
+    std::string args;
+};
+
+std::atomic<bool> file_enabled{false};
+std::atomic<int> next_tid{1};
+
+std::mutex mtx;
+std::string file_path;
+std::string process = "commitgen";
+std::vector<Event> events;
+std::string raw_events;
+bool file_started = false;
+
+thread_local uint64_t tl_request = 0;
+thread_local bool tl_capture = false;
+thread_local int tl_tid = 0;
+
+int thread_id() {
+    if (tl_tid == 0)
+        tl_tid = next_tid++;
+    return tl_tid;
+}
+
+std::string process_metadata() {
+    return "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + std::to_string(getpid())
+           + ",\"args\":{\"name\":" + json_string(process) + "}}";
+}
+
+std::string format_event(const Event& e) {
+    std::string out = "{\"name\":" + json_string(e.name) + ",\"cat\":" + json_string(e.category)
+                      + ",\"ph\":\"X\",\"ts\":" + std::to_string(e.ts) + ",\"dur\":" + std::to_string(e.dur)
+                      + ",\"pid\":" + std::to_string(getpid()) + ",\"tid\":" + std::to_string(e.tid)
+                      + ",\"args\":{\"request\":" + std::to_string(e.request);
+    if (!e.args.empty())
+        out += "," + e.args;
+    out += "}}";
+    return out;
+}
+
+// Caller holds mtx
+void append_to_file(const std::string& events_json) {
+    if (events_json.empty())
+        return;
+    std::ofstream out(file_path, file_started ? std::ios::app : std::ios::trunc);
+    if (!file_started) {
+        out << "[\n" << process_metadata();
+        file_started = true;
+    }
+    out << ",\n" << events_json;
+}
+
+}  // namespace
+
+void set_process_name(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mtx);
+    process = name;
+}
+
+void enable(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mtx);
+    file_path = path;
+    file_enabled = true;
+}
+
+bool enabled() {
+    return file_enabled.load(std::memory_order_relaxed);
+}
+
+void flush() {
+    if (!enabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string out;
+    for (const auto& e : events) {
+        if (!out.empty())
+            out += ",\n";
+        out += format_event(e);
+    }
+    if (!raw_events.empty()) {
+        if (!out.empty())
+            out += ",\n";
+        out += raw_events;
+    }
+    events.clear();
+    raw_events.clear();
+    append_to_file(out);
+}
+
+void close() {
+    if (!enabled())
+        return;
+
+    flush();
+    std::lock_guard<std::mutex> lock(mtx);
+    if (file_started) {
+        std::ofstream out(file_path, std::ios::app);
+        out << "\n]\n";
+    }
+    file_enabled = false;
+}
+
+int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+RequestScope::RequestScope(uint64_t request, bool capture) : prev_request(tl_request), prev_capture(tl_capture) {
+    tl_request = request;
+    tl_capture = capture;
+}
+
+RequestScope::~RequestScope() {
+    tl_request = prev_request;
+    tl_capture = prev_capture;
+}
+
+uint64_t current_request() {
+    return tl_request;
+}
+
+bool active() {
+    return tl_capture || enabled();
+}
+
+void record(const std::string& name, const std::string& category, int64_t start_us, int64_t dur_us,
+            uint64_t request, const std::string& args) {
+    Event e{name, category, start_us, dur_us, thread_id(), request, args};
+    std::lock_guard<std::mutex> lock(mtx);
+    events.push_back(std::move(e));
+}
+
+std::string take_request(uint64_t request) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string out = process_metadata();
+    std::vector<Event> rest;
+    for (auto& e : events) {
+        if (e.request == request) {
+            out += "," + format_event(e);
+            if (file_enabled)
+                rest.push_back(std::move(e));
+        } else {
+            rest.push_back(std::move(e));
+        }
+    }
+    events = std::move(rest);
+    return out;
+}
+
+void add_raw(const std::string& json) {
+    if (json.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!raw_events.empty())
+        raw_events += ",\n";
+    raw_events += json;
+}
+
+Span::Span(const char* n, const char* c) : name(n), category(c), recording(active()) {
+    if (recording) {
+        start = now_us();
+        request = tl_request;
+    }
+}
+
+Span::~Span() {
+    if (recording)
+        record(name, category, start, now_us() - start, request, args);
+}
+
+void Span::arg(const std::string& key, long long value) {
+    if (!recording)
+        return;
+    if (!args.empty())
+        args += ",";
+    args += json_string(key) + ":" + std::to_string(value);
+}
+
+void Span::arg(const std::string& key, const std::string& value) {
+    if (!recording)
+        return;
+    if (!args.empty())
+        args += ",";
+    args += json_string(key) + ":" + json_string(value);
+}
+
+}  // namespace trace
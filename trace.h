@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Optional span tracing, written as Chrome trace-event JSON that loads in
+// chrome://tracing and ui.perfetto.dev. Spans are only recorded when a trace
+// file is enabled, or on threads inside a RequestScope that asked for capture.
+namespace trace {
+
+// Label for this process's track in the viewer
+void set_process_name(const std::string& name);
+
+// Start recording this process's spans into path
+void enable(const std::string& path);
+bool enabled();
+
+// Appends recorded spans to the trace file
+void flush();
+// Flushes and terminates the JSON array
+void close();
+
+// Wall clock in microseconds; shared time base so client and server line up
+int64_t now_us();
+
+// Spans recorded on this thread are tagged with a request id, and captured
+// for shipping back to the client when `capture` is set
+class RequestScope {
+public:
+    RequestScope(uint64_t request, bool capture);
+    ~RequestScope();
+
+private:
+    uint64_t prev_request;
+    bool prev_capture;
+};
+
+uint64_t current_request();
+bool active();
+
+void record(const std::string& name, const std::string& category, int64_t start_us, int64_t dur_us,
+            uint64_t request, const std::string& args = "");
+
+// Takes the spans of one request as comma-separated JSON events
+std::string take_request(uint64_t request);
+
+// Adds comma-separated JSON events produced by another process
+void add_raw(const std::string& events);
+
+class Span {
+public:
+    explicit Span(const char* name, const char* category = "commitgen");
+    ~Span();
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    void set_request(uint64_t id) { request = id; }
+    void arg(const std::string& key, long long value);
+    void arg(const std::string& key, const std::string& value);
+
+private:
+    const char* name;
+    const char* category;
+    bool recording;
+    int64_t start = 0;
+    uint64_t request = 0;
+    std::string args;
+};
+
+}  // namespace trace
@@ -0,0 +1,141 @@
+#include "watcher.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// One watch per repository; the kernel default allows 8192 per user
+constexpr size_t MAX_WATCHED = 256;
+
+}  // namespace
+
+IndexWatcher::IndexWatcher(std::chrono::milliseconds quiet, Callback on_change)
+    : quiet(quiet), on_change(std::move(on_change)) {}
+
+IndexWatcher::~IndexWatcher() {
+    stop();
+}
+
+void IndexWatcher::start() {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0)
+        throw std::runtime_error(std::string("inotify_init1: ") + std::strerror(errno));
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        int err = errno;
+        close(inotify_fd);
+        inotify_fd = -1;
+        throw std::runtime_error(std::string("eventfd: ") + std::strerror(err));
+    }
+    thread = std::thread(&IndexWatcher::run, this);
+}
+
+void IndexWatcher::stop() {
+    if (!thread.joinable())
+        return;
+    stopping = true;
+    wake();
+    thread.join();
+    close(inotify_fd);
+    close(wake_fd);
+    inotify_fd = wake_fd = -1;
+}
+
+void IndexWatcher::add(const Repo& repo) {
+    if (inotify_fd < 0)
+        throw std::runtime_error("Watcher is not running");
+    std::lock_guard<std::mutex> lock(mtx);
+    if (repos.size() >= MAX_WATCHED)
+        throw std::runtime_error("Too many watched repositories");
+
+    int wd = inotify_add_watch(inotify_fd, repo.git_dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd < 0)
+        throw std::runtime_error("Cannot watch " + repo.git_dir + ": " + std::strerror(errno));
+    // The same directory gives the same descriptor; the latest caller owns it
+    repos[wd] = repo;
+    due[wd] = std::chrono::steady_clock::now();
+    wake();
+}
+
+void IndexWatcher::wake() {
+    uint64_t one = 1;
+    // Fails only when the counter is already huge, which wakes the thread anyway
+    (void)!write(wake_fd, &one, sizeof(one));
+}
+
+size_t IndexWatcher::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return repos.size();
+}
+
+void IndexWatcher::run() {
+    alignas(struct inotify_event) char buf[16 * 1024];
+    while (true) {
+        int timeout = -1;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto now = std::chrono::steady_clock::now();
+            for (const auto& [wd, when] : due) {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(when - now).count();
+                int ms = (int)std::max<int64_t>(0, wait + 1);
+                timeout = timeout < 0 ? ms : std::min(timeout, ms);
+            }
+        }
+
+        struct pollfd pfds[2] = {{inotify_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        if (poll(pfds, 2, timeout) < 0 && errno != EINTR)
+            return;
+        if (stopping)
+            return;
+        if (pfds[1].revents & POLLIN) {
+            uint64_t value;
+            (void)!read(wake_fd, &value, sizeof(value));
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            ssize_t n;
+            while ((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+                std::lock_guard<std::mutex> lock(mtx);
+                for (char* p = buf; p < buf + n;) {
+                    auto* event = reinterpret_cast<struct inotify_event*>(p);
+                    p += sizeof(struct inotify_event) + event->len;
+                    if (event->mask & IN_IGNORED) {
+                        // Directory removed or unmounted
+                        repos.erase(event->wd);
+                        due.erase(event->wd);
+                        continue;
+                    }
+                    std::string name = event->len ? event->name : "";
+                    if ((name == "index" || name == "HEAD") && repos.count(event->wd))
+                        due[event->wd] = std::chrono::steady_clock::now() + quiet;
+                }
+            }
+        }
+
+        std::vector<Repo> ready;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = due.begin(); it != due.end();) {
+                if (it->second <= now) {
+                    ready.push_back(repos[it->first]);
+                    it = due.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        for (const auto& repo : ready) {
+            on_change(repo);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "protocol.h"
+
+// Tells the server when a registered repository's staged changes may have
+// changed: on_change runs on the watcher thread once the repository's index
+// and HEAD have been quiet for `quiet`. It watches the git directory rather
+// than the index itself, because git replaces the index by renaming
+// index.lock over it.
+class IndexWatcher {
+public:
+    struct Repo {
+        std::string path;     // top of the checkout
+        std::string git_dir;  // its index and HEAD
+        PeerCredentials owner;
+    };
+    using Callback = std::function<void(const Repo& repo)>;
+
+    IndexWatcher(std::chrono::milliseconds quiet, Callback on_change);
+    ~IndexWatcher();
+
+    // Creates the inotify instance and starts the thread; throws on failure
+    void start();
+    void stop();
+
+    // Watches a repository and schedules a first on_change for it. The watch
+    // is added with the calling thread's file permissions. Throws on failure.
+    void add(const Repo& repo);
+    size_t size() const;
+
+private:
+    void run();
+    void wake();
+
+    std::chrono::milliseconds quiet;
+    Callback on_change;
+    int inotify_fd = -1;
+    int wake_fd = -1;  // eventfd: a repository was added, or stop()
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    mutable std::mutex mtx;
+    std::map<int, Repo> repos;  // by watch descriptor
+    std::map<int, std::chrono::steady_clock::time_point> due;
+};